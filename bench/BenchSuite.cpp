@@ -0,0 +1,569 @@
+// Benchmark suite with five levels, results written as JSON for tracking
+// regressions between builds:
+//   kernel  XOR bytes per second for every kernel the CPU runs, and KeyMaterial::apply
+//   cipher  the cipher known-answer tests, then bytes per second of every cipher
+//           implementation the CPU runs, and of the lz4 codec on log-like text
+//   file    executeCryption on small, medium and huge files, cold and warm page cache
+//   e2e     files/s and MB/s of the worker pool for 1..N workers on a synthetic tree,
+//           in place and out of place (--output, buffered and O_DIRECT)
+//   numa    the same pool pinned to the CPUs of the first 1..N NUMA nodes, against the
+//           same worker count unpinned, to show how a run scales from one socket to more
+// Every file-level and end-to-end run is an encrypt + decrypt round trip that is
+// checked against a hash of the original contents.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "Cryption.hpp"
+#include "XorKernel.hpp"
+#include "KeyMaterial.hpp"
+#include "Cipher.hpp"
+#include "Container.hpp"
+#include "Lz4.hpp"
+#include "DirectoryWalker.hpp"
+#include "TaskScheduler.hpp"
+#include "WorkerEngine.hpp"
+#include "Topology.hpp"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct SuiteOptions {
+    std::string levels = "kernel,cipher,file,e2e";
+    std::string cipher = "xor"; // The cipher of the file, e2e and numa levels
+    std::string output = "bench_results.json";
+    std::string root = "bench_suite_tree";
+    size_t maxWorkers = 0; // 0: online CPUs
+    size_t e2eFiles = 1000;
+    std::string distribution = "4K:850,64K:120,1M:25,16M:5";
+    size_t hugeSize = 256 << 20;
+    std::string engine = "processes";
+    bool uring = false;
+    Placement placement = Placement::NONE;
+    size_t numaNodes = 0;
+    int repeat = 3; // Runs per measurement, the best one is reported
+};
+
+// One result object: a flat list of already formatted JSON members
+struct Result {
+    std::vector<std::pair<std::string, std::string>> fields;
+
+    Result &text(const std::string &key, const std::string &value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        fields.push_back({key, "\"" + escaped + "\""});
+        return *this;
+    }
+    Result &number(const std::string &key, double value) {
+        std::ostringstream out;
+        if (value == static_cast<double>(static_cast<uint64_t>(value))) {
+            out << static_cast<uint64_t>(value); // Counts and sizes stay exact
+        } else {
+            out << std::setprecision(6) << value;
+        }
+        fields.push_back({key, out.str()});
+        return *this;
+    }
+};
+
+static std::vector<Result> results;
+static bool allVerified = true;
+
+static void report(const Result &result) {
+    results.push_back(result);
+    for (size_t i = 0; i < result.fields.size(); i++) {
+        std::cerr << (i ? " " : "") << result.fields[i].first << "=" << result.fields[i].second;
+    }
+    std::cerr << std::endl;
+}
+
+// 64-bit multiplicative hash over the file contents, enough to catch a bad round trip
+static uint64_t hashFile(const std::string &path) {
+    std::ifstream f(path, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    uint64_t hash = 1469598103934665603ull;
+    while (f) {
+        f.read(buffer.data(), buffer.size());
+        std::streamsize n = f.gcount();
+        for (std::streamsize i = 0; i < n; i++) {
+            hash = (hash ^ static_cast<uint8_t>(buffer[i])) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+static void writeRandomFile(const std::string &path, size_t size, std::mt19937_64 &gen) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    std::vector<uint64_t> block(1 << 14);
+    while (size > 0) {
+        for (uint64_t &word : block) word = gen();
+        size_t n = std::min(size, block.size() * sizeof(uint64_t));
+        f.write(reinterpret_cast<const char *>(block.data()), n);
+        size -= n;
+    }
+}
+
+// Write back and drop the file's pages so the next pass reads from the device
+static void dropCache(const std::string &path) {
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd == -1) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// "4K:850,64K:120" -> sizes with integer weights
+static std::vector<std::pair<size_t, size_t>> parseDistribution(const std::string &spec) {
+    std::vector<std::pair<size_t, size_t>> buckets;
+    std::stringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) throw std::runtime_error("Invalid distribution entry: " + item);
+        std::string size = item.substr(0, colon);
+        size_t shift = 0;
+        switch (std::toupper(static_cast<unsigned char>(size.back()))) {
+            case 'K': shift = 10; break;
+            case 'M': shift = 20; break;
+            case 'G': shift = 30; break;
+        }
+        if (shift != 0) size.pop_back();
+        buckets.push_back({std::stoull(size) << shift, std::stoull(item.substr(colon + 1))});
+    }
+    if (buckets.empty()) throw std::runtime_error("Empty size distribution");
+    return buckets;
+}
+
+// Best of three runs of rounds passes over bytes each
+static double measurePasses(size_t rounds, size_t bytes, const std::function<void(size_t round)> &pass) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        auto start = Clock::now();
+        for (size_t r = 0; r < rounds; r++) pass(r);
+        best = std::max(best, rounds * bytes / secondsSince(start));
+    }
+    return best;
+}
+
+static void benchKernels() {
+    std::vector<uint8_t> key(KEY_LENGTH);
+    std::mt19937 gen(1);
+    for (uint8_t &b : key) b = static_cast<uint8_t>(gen());
+    std::vector<uint8_t> doubled(key);
+    doubled.insert(doubled.end(), key.begin(), key.end());
+
+    // 1 MiB stays in L2, so this is the kernel and not the memory system
+    std::vector<uint8_t> buffer(CRYPTION_BLOCK_SIZE, 0x5a);
+    const size_t rounds = 1024;
+    auto measure = [&](const std::function<void(size_t round)> &pass) {
+        return measurePasses(rounds, buffer.size(), pass);
+    };
+
+    for (const XorKernel &kernel : availableXorKernels()) {
+        double bytesPerSecond = measure([&](size_t r) {
+            for (size_t done = 0; done < buffer.size(); done += KEY_LENGTH) {
+                kernel.fn(buffer.data() + done, doubled.data() + (r % KEY_LENGTH), KEY_LENGTH);
+            }
+        });
+        report(Result().text("level", "kernel").text("name", kernel.name).number("bytes_per_second", bytesPerSecond));
+    }
+
+    const KeyMaterial &material = KeyMaterial::get();
+    double bytesPerSecond = measure([&](size_t r) { material.apply(buffer.data(), buffer.size(), r); });
+    const Cipher &cipher = material.cipher();
+    std::string name = std::string(cipher.name()) == "xor" ? "" : std::string(cipher.name()) + "_";
+    report(Result().text("level", "kernel").text("name", "key_material_" + name + cipher.implementation())
+               .number("bytes_per_second", bytesPerSecond));
+}
+
+// Known answers first: a fast cipher that is wrong is not worth timing
+static void benchCiphers() {
+    std::ostringstream log;
+    bool passed = runCipherSelfTest(log);
+    std::cerr << log.str();
+    allVerified = allVerified && passed;
+    report(Result().text("level", "cipher").text("name", "known_answer_tests").text("verified", passed ? "yes" : "no"));
+
+    std::vector<uint8_t> buffer(CRYPTION_BLOCK_SIZE, 0x5a);
+    const size_t rounds = 256;
+    for (const std::string &name : cipherNames()) {
+        for (const std::string &implementation : cipherImplementations(name)) {
+            std::unique_ptr<Cipher> cipher = createCipher(name, "bench-suite", implementation);
+            // The portable kernels are slow: fewer rounds keep the level short
+            size_t passes = implementation == "portable" || implementation == "scalar" ? rounds / 16 : rounds;
+            double bytesPerSecond = measurePasses(passes, buffer.size(), [&](size_t r) {
+                cipher->apply(buffer.data(), buffer.size(), r * buffer.size());
+            });
+            report(Result().text("level", "cipher").text("name", name + "_" + implementation)
+                       .number("bytes_per_second", bytesPerSecond));
+        }
+    }
+}
+
+// Container chunks of log lines: the text --compress is for
+static void benchCodec() {
+    std::string text;
+    std::mt19937 gen(3);
+    char line[128];
+    while (text.size() < CONTAINER_CHUNK_SIZE) {
+        snprintf(line, sizeof(line), "2026-01-01 12:%02u:%02u INFO worker %u processed task %u bytes=%u\n",
+                 static_cast<unsigned>(gen() % 60), static_cast<unsigned>(gen() % 60), static_cast<unsigned>(gen() % 8),
+                 static_cast<unsigned>(text.size()), static_cast<unsigned>(gen() % (1 << 20)));
+        text += line;
+    }
+    text.resize(CONTAINER_CHUNK_SIZE);
+    const uint8_t *input = reinterpret_cast<const uint8_t *>(text.data());
+    std::vector<uint8_t> compressed(lz4Bound(text.size()));
+    std::vector<uint8_t> decompressed(text.size());
+    size_t compressedSize = 0;
+    const size_t rounds = 64;
+
+    double compressRate = measurePasses(rounds, text.size(), [&](size_t) {
+        compressedSize = lz4Compress(input, text.size(), compressed.data(), compressed.size());
+    });
+    bool verified = true;
+    double decompressRate = measurePasses(rounds, text.size(), [&](size_t) {
+        verified &= lz4Decompress(compressed.data(), compressedSize, decompressed.data(), decompressed.size());
+    });
+    verified = verified && std::memcmp(decompressed.data(), input, text.size()) == 0;
+    allVerified = allVerified && verified;
+    report(Result().text("level", "cipher").text("name", "lz4_compress").number("bytes_per_second", compressRate)
+               .number("ratio", static_cast<double>(text.size()) / compressedSize));
+    report(Result().text("level", "cipher").text("name", "lz4_decompress").number("bytes_per_second", decompressRate)
+               .text("verified", verified ? "yes" : "no"));
+}
+
+// Encrypt then decrypt every file with executeCryption; only the encrypt pass is timed
+static void benchFileClass(const SuiteOptions &options, const char *name, size_t size, size_t count) {
+    fs::path dir = fs::path(options.root) / name;
+    fs::create_directories(dir);
+    std::mt19937_64 gen(size);
+    std::vector<std::string> files;
+    std::vector<uint64_t> hashes;
+    for (size_t i = 0; i < count; i++) {
+        files.push_back((dir / ("f" + std::to_string(i))).string());
+        writeRandomFile(files.back(), size, gen);
+        hashes.push_back(hashFile(files.back()));
+    }
+
+    for (bool cold : {true, false}) {
+        double best = 0;
+        for (int run = 0; run < options.repeat; run++) {
+            if (cold) {
+                for (const std::string &file : files) dropCache(file);
+            }
+            auto start = Clock::now();
+            for (const std::string &file : files) executeCryption(file + ",ENCRYPT");
+            double seconds = secondsSince(start);
+            best = best == 0 ? seconds : std::min(best, seconds);
+            for (const std::string &file : files) executeCryption(file + ",DECRYPT");
+        }
+        bool verified = true;
+        for (size_t i = 0; i < files.size(); i++) {
+            verified = verified && hashFile(files[i]) == hashes[i];
+        }
+        allVerified = allVerified && verified;
+        report(Result().text("level", "file").text("name", name).text("cache", cold ? "cold" : "warm")
+                   .number("file_size", size).number("files", count)
+                   .number("files_per_second", count / best)
+                   .number("mb_per_second", count * size / best / (1 << 20))
+                   .text("verified", verified ? "yes" : "no"));
+    }
+    fs::remove_all(dir);
+}
+
+static void benchFiles(const SuiteOptions &options) {
+    benchFileClass(options, "small", 4 << 10, 2000);
+    benchFileClass(options, "medium", 1 << 20, 64);
+    benchFileClass(options, "huge", options.hugeSize, 1);
+}
+
+// One pass of the worker pool over a tree, as the CLI runs it; with an output root
+// the tree is mirrored there instead of being rewritten
+static double runPool(const SuiteOptions &options, size_t workers, Action action, const std::string &tree,
+                      const std::string &output = std::string()) {
+    // Workers log every task on stdout; keep that out of the bench output
+    std::cout.flush();
+    int savedStdout = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+
+    auto start = Clock::now();
+    EngineOptions engineOptions;
+    engineOptions.queueDepth = 1024;
+    engineOptions.uring = options.uring;
+    engineOptions.placement = options.placement;
+    engineOptions.numaNodes = options.numaNodes;
+    std::unique_ptr<WorkerEngine> engine = createWorkerEngine(options.engine, engineOptions);
+    engine->createWorkers(static_cast<int>(workers));
+    std::vector<WalkEntry> files;
+    DirectoryWalker walker(WalkOptions{});
+    walker.walk(tree, [&files](const std::vector<WalkEntry> &batch) {
+        files.insert(files.end(), batch.begin(), batch.end());
+    });
+    SchedulePlan plan = planBySize(files, action, 64 << 20);
+    for (Task &task : plan.tasks) {
+        task.outputRoot = output;
+        task.sourcePrefix = tree.size() + 1;
+    }
+    engine->submitTasks(plan.tasks);
+    engine->waitForWorkers();
+    double seconds = secondsSince(start);
+
+    std::cout.flush();
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+    return seconds;
+}
+
+// The synthetic tree of the end-to-end levels: files of the size distribution spread
+// over two directory levels, 32 entries per directory. Returns the path and contents
+// hash of every file.
+static std::vector<std::pair<std::string, uint64_t>> writeTree(const SuiteOptions &options, size_t &totalBytes) {
+    std::vector<std::pair<size_t, size_t>> buckets = parseDistribution(options.distribution);
+    size_t totalWeight = 0;
+    for (const auto &bucket : buckets) totalWeight += bucket.second;
+
+    fs::path root(options.root);
+    std::mt19937_64 gen(12345);
+    totalBytes = 0;
+    std::vector<std::pair<std::string, uint64_t>> hashes;
+    for (size_t i = 0; i < options.e2eFiles; i++) {
+        size_t pick = gen() % totalWeight;
+        size_t size = buckets.back().first;
+        for (const auto &bucket : buckets) {
+            if (pick < bucket.second) { size = bucket.first; break; }
+            pick -= bucket.second;
+        }
+        fs::path dir = root / ("d" + std::to_string(i / 1024)) / ("d" + std::to_string(i / 32 % 32));
+        fs::create_directories(dir);
+        std::string path = (dir / ("f" + std::to_string(i))).string();
+        writeRandomFile(path, size, gen);
+        hashes.push_back({path, hashFile(path)});
+        totalBytes += size;
+    }
+    return hashes;
+}
+
+static void benchEndToEnd(const SuiteOptions &options) {
+    fs::path root(options.root);
+    size_t totalBytes;
+    std::vector<std::pair<std::string, uint64_t>> hashes = writeTree(options, totalBytes);
+
+    size_t maxWorkers = options.maxWorkers;
+    if (maxWorkers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        maxWorkers = cpus > 0 ? cpus : 1;
+    }
+    // Out of place, the timed pass writes a fresh copy; decrypting the copy in place
+    // must then give the original contents, and the tree itself must be untouched
+    std::string outRoot = root.string() + "_out";
+    const char *modes[] = {"in_place", "out_of_place", "out_of_place_direct"};
+    for (const char *mode : modes) {
+        bool outOfPlace = mode != modes[0];
+        setDirectCopies(mode == modes[2]);
+        for (size_t workers = 1; workers <= maxWorkers; workers++) {
+            double best = 0;
+            bool verified = true;
+            for (int run = 0; run < options.repeat; run++) {
+                fs::remove_all(outRoot);
+                double seconds = runPool(options, workers, Action::ENCRYPT, root.string(), outOfPlace ? outRoot : "");
+                best = best == 0 ? seconds : std::min(best, seconds);
+                runPool(options, workers, Action::DECRYPT, outOfPlace ? outRoot : root.string());
+            }
+            for (const auto &file : hashes) {
+                verified = verified && hashFile(file.first) == file.second;
+                if (outOfPlace) {
+                    std::string copy = outRoot + file.first.substr(root.string().size());
+                    verified = verified && hashFile(copy) == file.second;
+                }
+            }
+            allVerified = allVerified && verified;
+            report(Result().text("level", "e2e").text("name", options.engine)
+                       .text("io", options.uring ? "uring" : "sync").text("mode", mode)
+                       .text("distribution", options.distribution).text("cache", "warm")
+                       .number("workers", workers).number("files", options.e2eFiles).number("bytes", totalBytes)
+                       .number("files_per_second", options.e2eFiles / best)
+                       .number("mb_per_second", totalBytes / best / (1 << 20))
+                       .text("verified", verified ? "yes" : "no"));
+        }
+    }
+    setDirectCopies(false);
+    fs::remove_all(outRoot);
+    fs::remove_all(root);
+}
+
+// In place, with the workers of 1..N nodes: every CPU of them, or --workers per node.
+// Each pinned run is paired with an unpinned one of as many workers, so the gain of
+// the placement shows apart from the gain of the extra workers.
+static void benchNuma(const SuiteOptions &options) {
+    fs::path root(options.root);
+    size_t totalBytes;
+    std::vector<std::pair<std::string, uint64_t>> hashes = writeTree(options, totalBytes);
+    const Topology &topology = Topology::get();
+    Placement pinned = options.placement == Placement::NONE ? Placement::CORE : options.placement;
+
+    double oneNode[2] = {0, 0}; // Best seconds on one node, unpinned and pinned
+    size_t workers = 0;
+    for (size_t nodes = 1; nodes <= topology.nodes().size(); nodes++) {
+        const NumaNode &added = topology.nodes()[nodes - 1];
+        workers += options.maxWorkers != 0 ? options.maxWorkers : added.cpus.size();
+        for (Placement placement : {Placement::NONE, pinned}) {
+            SuiteOptions run = options;
+            run.placement = placement;
+            run.numaNodes = nodes;
+            double best = 0;
+            for (int repeat = 0; repeat < options.repeat; repeat++) {
+                double seconds = runPool(run, workers, Action::ENCRYPT, root.string());
+                best = best == 0 ? seconds : std::min(best, seconds);
+                runPool(run, workers, Action::DECRYPT, root.string());
+            }
+            bool verified = true;
+            for (const auto &file : hashes) {
+                verified = verified && hashFile(file.first) == file.second;
+            }
+            allVerified = allVerified && verified;
+            double &baseline = oneNode[placement == Placement::NONE ? 0 : 1];
+            if (nodes == 1) baseline = best;
+            report(Result().text("level", "numa").text("name", options.engine)
+                       .text("io", options.uring ? "uring" : "sync").text("placement", placementName(placement))
+                       .number("nodes", nodes).number("workers", workers).number("files", options.e2eFiles)
+                       .number("bytes", totalBytes)
+                       .number("files_per_second", options.e2eFiles / best)
+                       .number("mb_per_second", totalBytes / best / (1 << 20))
+                       .number("speedup_vs_one_node", baseline / best)
+                       .text("verified", verified ? "yes" : "no"));
+        }
+    }
+    fs::remove_all(root);
+}
+
+static void writeJson(const SuiteOptions &options) {
+    std::ofstream out(options.output);
+    char timestamp[32];
+    time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    out << "{\n  \"timestamp\": \"" << timestamp << "\",\n"
+        << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+        << "  \"kernel\": \"" << selectXorKernel().name << "\",\n"
+        << "  \"online_cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << "    {";
+        for (size_t f = 0; f < results[i].fields.size(); f++) {
+            out << (f ? ", " : "") << "\"" << results[i].fields[f].first << "\": " << results[i].fields[f].second;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --levels LIST         kernel,cipher,file,e2e,numa (default: kernel,cipher,file,e2e)\n"
+              << "  --cipher NAME         cipher of the file, e2e and numa levels (default: xor)\n"
+              << "  --output FILE         JSON results (default: bench_results.json, '-' for stdout)\n"
+              << "  --workers N           end-to-end runs for 1..N workers (default: online CPUs);\n"
+              << "                        numa runs with N workers per node (default: its CPUs)\n"
+              << "  --files N             files in the end-to-end tree (default: 1000)\n"
+              << "  --distribution SPEC   SIZE:WEIGHT,... (default: 4K:850,64K:120,1M:25,16M:5)\n"
+              << "  --huge-size BYTES     size of the huge file-level case (default: 256 MiB)\n"
+              << "  --engine NAME         processes or threads\n"
+              << "  --io sync|uring       worker I/O of the process engine\n"
+              << "  --pin none|core|node  worker placement of the e2e level (numa: core unless node)\n"
+              << "  --repeat N            runs per measurement, best reported (default: 3)\n";
+}
+
+int main(int argc, char *argv[]) {
+    SuiteOptions options;
+    static const struct option longOptions[] = {
+        {"levels", required_argument, nullptr, 'l'},
+        {"output", required_argument, nullptr, 'o'},
+        {"workers", required_argument, nullptr, 'j'},
+        {"files", required_argument, nullptr, 'n'},
+        {"distribution", required_argument, nullptr, 'd'},
+        {"huge-size", required_argument, nullptr, 's'},
+        {"engine", required_argument, nullptr, 'e'},
+        {"io", required_argument, nullptr, 'i'},
+        {"pin", required_argument, nullptr, 'p'},
+        {"repeat", required_argument, nullptr, 'r'},
+        {"cipher", required_argument, nullptr, 'c'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:o:j:n:d:s:e:i:p:r:c:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'l': options.levels = optarg; break;
+            case 'o': options.output = optarg; break;
+            case 'j': options.maxWorkers = std::stoul(optarg); break;
+            case 'n': options.e2eFiles = std::stoul(optarg); break;
+            case 'd': options.distribution = optarg; break;
+            case 's': options.hugeSize = std::stoull(optarg); break;
+            case 'e': options.engine = optarg; break;
+            case 'i': options.uring = std::string(optarg) == "uring"; break;
+            case 'p':
+                if (!parsePlacement(optarg, options.placement)) {
+                    printUsage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'r': options.repeat = std::max(1, std::stoi(optarg)); break;
+            case 'c':
+                if (!isCipherName(optarg)) {
+                    printUsage(argv[0]);
+                    return 2;
+                }
+                options.cipher = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.output == "-") options.output = "/dev/stdout";
+
+    auto wants = [&options](const char *level) {
+        return ("," + options.levels + ",").find(std::string(",") + level + ",") != std::string::npos;
+    };
+
+    setRunCipher(options.cipher);
+    KeyMaterial::load();
+    fs::remove_all(options.root);
+    if (wants("kernel")) benchKernels();
+    if (wants("cipher")) {
+        benchCiphers();
+        benchCodec();
+    }
+    if (wants("file")) benchFiles(options);
+    if (wants("e2e")) benchEndToEnd(options);
+    if (wants("numa")) benchNuma(options);
+    fs::remove_all(options.root);
+
+    writeJson(options);
+    if (!allVerified) {
+        std::cerr << "Round trip check failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
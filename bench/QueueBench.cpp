@@ -0,0 +1,210 @@
+// Microbenchmark of the worker task queue: tasks per second and
+// enqueue-to-dequeue latency for the shared-memory TaskRing against the
+// previous named-semaphore queue, with forked consumers doing no work.
+// The ring carries binary task records through SharedTaskQueue; the legacy
+// queue carries the old fixed 256-byte task strings.
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "SharedTaskQueue.hpp"
+
+static uint64_t nowNs() {
+    // steady_clock is CLOCK_MONOTONIC, comparable across processes
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct alignas(64) ConsumerStats {
+    uint64_t tasks;
+    uint64_t totalLatencyNs;
+    uint64_t maxLatencyNs;
+};
+
+static void record(ConsumerStats &stats, uint64_t submittedNs) {
+    uint64_t latency = nowNs() - submittedNs;
+    stats.tasks++;
+    stats.totalLatencyNs += latency;
+    stats.maxLatencyNs = std::max(stats.maxLatencyNs, latency);
+}
+
+// The queue as ProcessManagement used to implement it: named semaphores, a
+// per-process std::mutex, and consumers polling sem_trywait with a 10 ms sleep.
+// Only change: consumers also exit on an empty queue after the producer has
+// finished, which the original livelocked on.
+struct LegacyQueue {
+    struct Shared {
+        std::atomic<size_t> size;
+        char tasks[1000][256];
+        int front;
+        int rear;
+        std::atomic<bool> producerFinished;
+    };
+
+    Shared *shared;
+    sem_t *items;
+    sem_t *emptySlots;
+    std::mutex queueLock;
+
+    LegacyQueue() {
+        sem_unlink("/bench_items");
+        sem_unlink("/bench_empty_slots");
+        items = sem_open("/bench_items", O_CREAT, 0666, 0);
+        emptySlots = sem_open("/bench_empty_slots", O_CREAT, 0666, 1000);
+        shared = static_cast<Shared *>(mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+        shared->size.store(0);
+        shared->front = 0;
+        shared->rear = 0;
+        shared->producerFinished.store(false);
+    }
+
+    ~LegacyQueue() {
+        munmap(shared, sizeof(Shared));
+        sem_close(items);
+        sem_close(emptySlots);
+        sem_unlink("/bench_items");
+        sem_unlink("/bench_empty_slots");
+    }
+
+    void push(uint64_t timestamp) {
+        std::string task = "bench/file," + std::to_string(timestamp);
+        sem_wait(emptySlots);
+        std::unique_lock<std::mutex> lock(queueLock);
+        strcpy(shared->tasks[shared->rear], task.c_str());
+        shared->rear = (shared->rear + 1) % 1000;
+        shared->size.fetch_add(1);
+        lock.unlock();
+        sem_post(items);
+    }
+
+    bool pop(uint64_t &timestamp) {
+        char task[256];
+        while (true) {
+            if (sem_trywait(items) == -1) {
+                if (shared->producerFinished.load() && shared->size.load() == 0) return false;
+                usleep(10000);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(queueLock);
+            if (shared->size.load() == 0) {
+                lock.unlock();
+                if (shared->producerFinished.load()) return false;
+                sem_post(items);
+                continue;
+            }
+            strcpy(task, shared->tasks[shared->front]);
+            shared->front = (shared->front + 1) % 1000;
+            shared->size.fetch_sub(1);
+            lock.unlock();
+            sem_post(emptySlots);
+            timestamp = strtoull(strchr(task, ',') + 1, nullptr, 10);
+            return true;
+        }
+    }
+
+    void finish(size_t consumers) {
+        shared->producerFinished.store(true);
+        for (size_t i = 0; i < consumers; i++) sem_post(items);
+    }
+};
+
+struct RingQueue {
+    void *region;
+    size_t regionSize;
+    SharedTaskQueue *queue;
+
+    RingQueue() {
+        size_t arenaBytes = SharedTaskQueue::defaultArenaBytes(DEFAULT_QUEUE_DEPTH);
+        regionSize = SharedTaskQueue::regionSize(DEFAULT_QUEUE_DEPTH, arenaBytes);
+        region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        queue = new SharedTaskQueue(region, DEFAULT_QUEUE_DEPTH, arenaBytes);
+    }
+    ~RingQueue() {
+        delete queue;
+        munmap(region, regionSize);
+    }
+
+    // The submit time rides in the record's offset field
+    void push(uint64_t timestamp) { queue->push(Action::ENCRYPT, "bench/file", timestamp, 0); }
+    bool pop(uint64_t &timestamp) {
+        const TaskRecord *record = queue->pop();
+        if (record == nullptr) return false;
+        timestamp = record->offset;
+        queue->release(record);
+        return true;
+    }
+    void finish(size_t) { queue->finish(); }
+};
+
+// pacedNs > 0 spaces submissions out so the queue stays near empty,
+// which is where wake-up latency shows
+template <typename Queue>
+static void run(const char *name, size_t consumers, size_t tasks, uint64_t pacedNs) {
+    Queue queue;
+    ConsumerStats *stats = static_cast<ConsumerStats *>(mmap(nullptr, sizeof(ConsumerStats) * consumers,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+
+    std::vector<pid_t> pids;
+    for (size_t i = 0; i < consumers; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            uint64_t submitted;
+            while (queue.pop(submitted)) record(stats[i], submitted);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+
+    uint64_t start = nowNs();
+    for (size_t i = 0; i < tasks; i++) {
+        if (pacedNs > 0) {
+            uint64_t due = start + i * pacedNs;
+            while (nowNs() < due) {}
+        }
+        queue.push(nowNs());
+    }
+    queue.finish(consumers);
+    for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+    double seconds = (nowNs() - start) / 1e9;
+
+    ConsumerStats total = {0, 0, 0};
+    for (size_t i = 0; i < consumers; i++) {
+        total.tasks += stats[i].tasks;
+        total.totalLatencyNs += stats[i].totalLatencyNs;
+        total.maxLatencyNs = std::max(total.maxLatencyNs, stats[i].maxLatencyNs);
+    }
+    munmap(stats, sizeof(ConsumerStats) * consumers);
+
+    std::cout << std::left << std::setw(8) << name
+              << " consumers=" << consumers
+              << (pacedNs > 0 ? " paced " : " burst ")
+              << " tasks=" << total.tasks << "/" << tasks
+              << " tasks/s=" << static_cast<uint64_t>(total.tasks / seconds)
+              << " mean latency us=" << (total.tasks ? total.totalLatencyNs / total.tasks / 1000.0 : 0)
+              << " max latency us=" << total.maxLatencyNs / 1000.0 << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t tasks = argc > 1 ? std::stoul(argv[1]) : 20000;
+    size_t maxConsumers = argc > 2 ? std::stoul(argv[2]) : 4;
+    const uint64_t pacedNs = 200000; // one task every 200 us
+
+    for (size_t consumers = 1; consumers <= maxConsumers; consumers *= 2) {
+        run<LegacyQueue>("legacy", consumers, tasks, 0);
+        run<RingQueue>("ring", consumers, tasks, 0);
+        run<LegacyQueue>("legacy", consumers, tasks / 20, pacedNs);
+        run<RingQueue>("ring", consumers, tasks / 20, pacedNs);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Small-file I/O benchmark: the synchronous executeCryption path against the
+// io_uring pipeline on a tree of many small files (like makeDirs.py creates).
+// Reports files per second and syscalls per file for both paths; syscalls are
+// counted by tracing a child process with ptrace.
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <filesystem>
+#include <csignal>
+#include <memory>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Cryption.hpp"
+#include "UringCryption.hpp"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+// Run fn in a traced child and count the syscalls it makes (-1 if ptrace is not permitted)
+static long countSyscalls(const std::function<void()> &fn) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) == -1) _exit(1);
+        raise(SIGSTOP);
+        fn();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFSTOPPED(status)) return -1;
+    ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+
+    long count = 0;
+    bool inSyscall = false;
+    while (true) {
+        ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr);
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) || WIFSIGNALED(status)) break;
+        if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            if (!inSyscall) count++; // Count entries only
+            inSyscall = !inSyscall;
+        }
+    }
+    return count;
+}
+
+static void runSync(const std::vector<std::string> &files, const char *action) {
+    for (const std::string &file : files) {
+        executeCryption(file + "," + action);
+    }
+}
+
+static size_t runUring(const std::vector<std::string> &files, Action action) {
+    UringCryption pipeline(KeyMaterial::get());
+    if (!pipeline.isAvailable()) return 0;
+
+    // Records as the shared queue would hand them out
+    std::vector<std::unique_ptr<uint64_t[]>> records;
+    for (const std::string &file : files) {
+        records.emplace_back(new uint64_t[TaskRecord::sizeFor(file.size()) / 8]);
+        TaskRecord::write(records.back().get(), 0, action, file, 0, 0);
+    }
+    size_t next = 0;
+    pipeline.run(
+        [&](bool) -> const TaskRecord * {
+            if (next == records.size()) return nullptr;
+            return reinterpret_cast<const TaskRecord *>(records[next++].get());
+        },
+        [](const TaskRecord *) {});
+    return pipeline.filesDone();
+}
+
+static std::vector<char> readAll(const std::string &path) {
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char *argv[]) {
+    size_t fileCount = argc > 1 ? std::stoul(argv[1]) : 2000;
+    size_t fileSize = argc > 2 ? std::stoul(argv[2]) : 4096;
+    const fs::path root = "uring_bench_tree";
+
+    // Build the tree
+    fs::remove_all(root);
+    fs::create_directories(root);
+    std::mt19937 gen(7);
+    std::vector<std::string> files;
+    std::vector<std::vector<char>> originals;
+    for (size_t i = 0; i < fileCount; i++) {
+        std::string path = (root / ("f" + std::to_string(i))).string();
+        std::vector<char> data(fileSize);
+        for (char &c : data) c = static_cast<char>(gen());
+        std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+        files.push_back(path);
+        originals.push_back(std::move(data));
+    }
+
+    auto start = Clock::now();
+    runSync(files, "ENCRYPT");
+    double syncSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    size_t uringFiles = runUring(files, Action::DECRYPT);
+    double uringSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (uringFiles == 0) {
+        std::cout << "io_uring unavailable, only the synchronous path was measured" << std::endl;
+        runSync(files, "DECRYPT");
+    }
+
+    // Sync encrypt + io_uring decrypt must give back the input
+    bool restored = true;
+    for (size_t i = 0; i < fileCount; i++) {
+        if (readAll(files[i]) != originals[i]) restored = false;
+    }
+
+    long syncSyscalls = countSyscalls([&] { runSync(files, "ENCRYPT"); });
+    long uringSyscalls = uringFiles ? countSyscalls([&] { runUring(files, Action::DECRYPT); }) : -1;
+    if (uringFiles == 0) runSync(files, "DECRYPT");
+
+    fs::remove_all(root);
+
+    std::cout << "files=" << fileCount << " size=" << fileSize << std::endl;
+    std::cout << "sync:     " << fileCount / syncSeconds << " files/s";
+    if (syncSyscalls >= 0) std::cout << ", " << static_cast<double>(syncSyscalls) / fileCount << " syscalls/file";
+    std::cout << std::endl;
+    if (uringFiles) {
+        std::cout << "io_uring: " << fileCount / uringSeconds << " files/s";
+        if (uringSyscalls >= 0) std::cout << ", " << static_cast<double>(uringSyscalls) / fileCount << " syscalls/file";
+        std::cout << std::endl;
+    }
+
+    if (!restored) {
+        std::cerr << "io_uring output does not undo the synchronous path" << std::endl;
+        return 1;
+    }
+    return 0;
+}
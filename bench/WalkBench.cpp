@@ -0,0 +1,102 @@
+// Enumeration benchmark: the recursive_directory_iterator loop main.cpp used
+// against DirectoryWalker, on a generated tree of small files. Both must find
+// the same files; reports files/s and the walker's stat calls per file.
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include "DirectoryWalker.hpp"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// fanout^depth leaf directories below root, filesPerDir empty files in every directory
+static size_t buildTree(const fs::path &dir, size_t fanout, size_t depth, size_t filesPerDir) {
+    fs::create_directories(dir);
+    size_t files = 0;
+    for (size_t i = 0; i < filesPerDir; i++) {
+        std::ofstream(dir / ("file" + std::to_string(i) + ".dat")) << i;
+        files++;
+    }
+    if (depth == 0) return files;
+    for (size_t i = 0; i < fanout; i++) {
+        files += buildTree(dir / ("dir" + std::to_string(i)), fanout, depth - 1, filesPerDir);
+    }
+    return files;
+}
+
+static std::vector<std::string> iteratorWalk(const std::string &root) {
+    std::vector<std::string> files;
+    size_t bytes = 0;
+    for (const auto &entry : fs::recursive_directory_iterator(root)) {
+        if (entry.is_regular_file()) {
+            bytes += entry.file_size();
+            files.push_back(entry.path().string());
+        }
+    }
+    return files;
+}
+
+static std::vector<std::string> walkerWalk(const std::string &root, WalkOptions options, size_t &statCalls) {
+    std::vector<std::string> files;
+    DirectoryWalker walker(options);
+    walker.walk(root, [&files](const std::vector<WalkEntry> &batch) {
+        for (const WalkEntry &entry : batch) files.push_back(entry.path);
+    });
+    statCalls = walker.statCalls();
+    return files;
+}
+
+int main(int argc, char *argv[]) {
+    size_t fanout = argc > 1 ? std::stoul(argv[1]) : 8;
+    size_t depth = argc > 2 ? std::stoul(argv[2]) : 3;
+    size_t filesPerDir = argc > 3 ? std::stoul(argv[3]) : 50;
+    const std::string root = "walk_bench_tree";
+
+    fs::remove_all(root);
+    size_t total = buildTree(root, fanout, depth, filesPerDir);
+    std::cout << "tree: " << total << " files, fanout " << fanout << ", depth " << depth << std::endl;
+
+    // Warm the dentry cache so every run reads the same cached metadata
+    iteratorWalk(root);
+
+    auto start = Clock::now();
+    std::vector<std::string> expected = iteratorWalk(root);
+    double iteratorSeconds = secondsSince(start);
+    std::cout << "recursive_directory_iterator: " << static_cast<size_t>(expected.size() / iteratorSeconds)
+              << " files/s" << std::endl;
+    std::sort(expected.begin(), expected.end());
+
+    bool same = true;
+    for (bool sizes : {true, false}) {
+        for (unsigned threads : {1u, 4u}) {
+            WalkOptions options;
+            options.threads = threads;
+            options.needSizes = sizes;
+            size_t statCalls = 0;
+            start = Clock::now();
+            std::vector<std::string> found = walkerWalk(root, options, statCalls);
+            double seconds = secondsSince(start);
+            std::sort(found.begin(), found.end());
+            same = same && found == expected;
+            std::cout << "walker threads=" << threads << (sizes ? " sizes" : " no sizes") << ": "
+                      << static_cast<size_t>(found.size() / seconds) << " files/s, "
+                      << static_cast<double>(statCalls) / found.size() << " stat calls/file" << std::endl;
+        }
+    }
+
+    fs::remove_all(root);
+    if (!same) {
+        std::cerr << "Walker and iterator found different files" << std::endl;
+        return 1;
+    }
+    std::cout << "Walker finds the same files as the iterator" << std::endl;
+    return 0;
+}
@@ -1,13 +1,37 @@
 #include <iostream>
+#include <fstream>
 #include <filesystem>
 #include <algorithm>
-#include "./src/app/processes/ProcessManagement.hpp"
+#include "./src/app/processes/WorkerEngine.hpp"
+#include "./src/app/processes/SharedTaskQueue.hpp"
 #include "./src/app/processes/Task.hpp"
+#include "./src/app/processes/TaskScheduler.hpp"
+#include "./src/app/processes/WorkerMetrics.hpp"
+#include "./src/app/processes/Journal.hpp"
+#include "./src/app/processes/Autotune.hpp"
+#include "./src/app/processes/Topology.hpp"
+#include "./src/app/processes/Trace.hpp"
+#include "./src/app/processes/FailureLog.hpp"
+#include "./src/app/encryptDecrypt/Cryption.hpp"
+#include "./src/app/encryptDecrypt/KeyMaterial.hpp"
+#include "./src/app/encryptDecrypt/Container.hpp"
+#include "./src/app/fileHandling/DirectoryWalker.hpp"
+#include "./src/app/fileHandling/Manifest.hpp"
+#include "./src/app/fileHandling/BufferPool.hpp"
+#include "./src/app/cli/CommandLine.hpp"
 #include <limits> // For numeric_limits
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
-int main(int argv, char **argc) {
+// Failed files named in the summary at the end of a run
+const size_t FAILURES_LISTED = 20;
+
+// The original prompts, kept for runs without arguments
+static bool readInteractive(RunOptions &options) {
     std::string directory;
     std::string action;
     int numWorkers;
@@ -18,48 +42,473 @@ int main(int argv, char **argc) {
     std::cout << "Enter the action (encrypt/decrypt): ";
     std::getline(std::cin, action);
 
-    std::cout << "Enter the number of worker processes: ";
-    while (!(std::cin >> numWorkers) || numWorkers <= 0) {
-        std::cout << "Invalid input. Please enter a positive integer for the number of workers: ";
+    std::cout << "Enter the number of worker processes (0 to tune it automatically): ";
+    while (!(std::cin >> numWorkers) || numWorkers < 0) {
+        std::cout << "Invalid input. Please enter a non-negative integer for the number of workers: ";
         std::cin.clear(); // Clear error flags
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
     }
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Consume the newline after reading numWorkers
 
-    try {
-        if (!(fs::exists(directory) && fs::is_directory(directory))) {
-            std::cerr << "Error: Invalid directory path." << std::endl;
+    if (!(fs::exists(directory) && fs::is_directory(directory))) {
+        std::cerr << "Error: Invalid directory path." << std::endl;
+        return false;
+    }
+    if (!parseAction(action, options.action)) {
+        std::cerr << "Error: Invalid action: " << action << std::endl;
+        return false;
+    }
+    options.haveAction = true;
+    if (numWorkers == 0) {
+        options.autotune = true;
+    } else {
+        options.workers = numWorkers;
+        options.workersSet = true;
+    }
+    options.paths.push_back(directory);
+    return true;
+}
+
+// Where a job's files go with --output: DIR/basename(PATH)/..., so several PATHs sit
+// side by side in DIR the way cp -r puts them
+struct JobOutput {
+    std::string root;         // Empty: in place
+    size_t sourcePrefix = 0;  // Characters of each walked path replaced by root
+};
+
+static JobOutput jobOutput(const RunOptions &options, const Job &job) {
+    JobOutput output;
+    output.root = options.output;
+    std::string path = job.path;
+    while (path.size() > 1 && path.back() == '/') path.pop_back();
+    size_t slash = path.rfind('/');
+    output.sourcePrefix = slash == std::string::npos ? 0 : slash + 1;
+    return output;
+}
+
+// The output tree must not be walked as part of the source tree
+static bool outputInsideSource(const RunOptions &options, const std::string &source) {
+    if (options.output.empty()) return false;
+    std::error_code error;
+    fs::path out = fs::weakly_canonical(options.output, error);
+    fs::path in = fs::weakly_canonical(source, error);
+    auto mismatch = std::mismatch(in.begin(), in.end(), out.begin(), out.end());
+    return mismatch.first == in.end();
+}
+
+// Manifest keys are absolute paths, so a file keeps its entry however a run names it.
+// Out of place the key is the output file, which is what the entry describes.
+struct ManifestKeys {
+    std::string source;   // The job path without trailing slashes, as walked paths start
+    std::string absolute; // Its absolute form
+    std::string output;   // Absolute output root, empty in place
+    size_t sourcePrefix;
+    bool checked = false; // The first in-place key was compared with its file
+    bool broken = false;  // ... and did not name it
+
+    ManifestKeys(const Job &job, const JobOutput &jobOutput) : source(job.path), sourcePrefix(jobOutput.sourcePrefix) {
+        while (source.size() > 1 && source.back() == '/') source.pop_back();
+        absolute = fs::absolute(source).lexically_normal().string();
+        while (absolute.size() > 1 && absolute.back() == '/') absolute.pop_back();
+        if (!jobOutput.root.empty()) {
+            output = fs::absolute(jobOutput.root).lexically_normal().string();
+        }
+    }
+
+    // Walked paths are the job path followed by "/name", except under "/" itself, where
+    // the job path is the slash. An absolute root of "/" (from "/..") adds no slash of its own.
+    std::string key(const std::string &path) const {
+        if (!output.empty()) {
+            return output + "/" + path.substr(sourcePrefix);
+        }
+        return (absolute == "/" ? std::string() : absolute) + path.substr(source == "/" ? 0 : source.size());
+    }
+};
+
+// A key naming some other file (or none) would get the entry dropped at commit, and
+// the file processed again by the next run. The mapping is the same for every file of
+// a job, so the first file walked is checked against its key before any is submitted.
+static bool keyNames(const std::string &key, const WalkEntry &file) {
+    struct stat st;
+    return stat(key.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_ino) == file.inode;
+}
+
+// Drop the files the manifest shows in the job's target state and unchanged since
+// (out of place, their output must also still be there), and expect the rest to
+// reach that state by the end of the run. Nothing is left to do once the keys of the
+// job turned out wrong.
+static std::vector<WalkEntry> consultManifest(Manifest &manifest, ManifestKeys &keys, Action action,
+                                              const std::vector<WalkEntry> &files, size_t &skipped) {
+    FileState target = action == Action::ENCRYPT ? FileState::ENCRYPTED : FileState::PLAIN;
+    std::vector<WalkEntry> todo;
+    if (!keys.checked && keys.output.empty() && !files.empty()) {
+        keys.checked = true;
+        std::string key = keys.key(files.front().path);
+        if (!keyNames(key, files.front())) {
+            std::cerr << "Manifest key " << key << " does not name " << files.front().path
+                      << ": not processing " << keys.source << std::endl;
+            keys.broken = true;
+        }
+    }
+    if (keys.broken) {
+        return todo;
+    }
+    for (const WalkEntry &file : files) {
+        std::string key = keys.key(file.path);
+        if (manifest.isCurrent(key, file.size, file.mtimeNs, file.inode, target) &&
+            (keys.output.empty() || access(key.c_str(), F_OK) == 0)) {
+            skipped++;
+            continue;
+        }
+        manifest.expect(key, file.path, target);
+        todo.push_back(file);
+    }
+    return todo;
+}
+
+// On --resume, drop the files the journal shows done and plan the ranges an interrupted
+// run left of the files it started; files it never reached go on to be planned as usual
+static std::vector<WalkEntry> consultJournal(const Journal &journal, Action action, size_t chunkSize,
+                                             const std::vector<WalkEntry> &files, SchedulePlan &partial,
+                                             size_t &done) {
+    std::vector<WalkEntry> todo;
+    for (const WalkEntry &file : files) {
+        std::vector<std::pair<uint64_t, uint64_t>> gaps = journal.remaining(file.path, file.size);
+        if (gaps.size() == 1 && gaps[0].first == 0 && gaps[0].second == file.size) {
+            todo.push_back(file);
+            continue;
+        }
+        if (gaps.empty()) {
+            done++;
+        }
+        for (const auto &gap : gaps) {
+            size_t step = chunkSize == 0 ? gap.second : chunkSize;
+            for (uint64_t offset = gap.first; offset < gap.first + gap.second; offset += step) {
+                size_t length = std::min<uint64_t>(step, gap.first + gap.second - offset);
+                partial.add(Task(file.path, action, offset, length), length);
+            }
+        }
+    }
+    return todo;
+}
+
+static void submitPlan(WorkerEngine &engine, SchedulePlan plan, const JobOutput &output) {
+    if (!output.root.empty()) {
+        for (Task &task : plan.tasks) {
+            task.outputRoot = output.root;
+            task.sourcePrefix = output.sourcePrefix;
+        }
+    }
+    if (engine.submitTasks(plan.tasks) != plan.size()) {
+        std::cerr << "Failed to submit some of " << plan.size() << " tasks" << std::endl;
+    }
+}
+
+// Walk one directory (or take one file) and hand its tasks to the running pool.
+// False when the job could not be run as asked.
+static bool runJob(WorkerEngine &engine, const RunOptions &options, Manifest *manifest, const Journal *journal,
+                   const Job &job) {
+    struct stat st;
+    if (stat(job.path.c_str(), &st) == -1) {
+        std::cerr << "Unable to open " << job.path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    JobOutput output = jobOutput(options, job);
+    ManifestKeys keys(job, output);
+    size_t skipped = 0;
+    size_t resumedDone = 0;
+    bool resuming = journal != nullptr && journal->resuming();
+    auto unprocessed = [&](const std::vector<WalkEntry> &found) {
+        std::vector<WalkEntry> todo = manifest ? consultManifest(*manifest, keys, job.action, found, skipped) : found;
+        if (!resuming) {
+            return todo;
+        }
+        SchedulePlan partial;
+        todo = consultJournal(*journal, job.action, options.chunkSize, todo, partial, resumedDone);
+        if (partial.size() > 0) {
+            submitPlan(engine, std::move(partial), output);
+        }
+        return todo;
+    };
+
+    std::vector<WalkEntry> files;
+    if (S_ISREG(st.st_mode)) {
+        int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        files = unprocessed({{job.path, static_cast<size_t>(st.st_size), mtimeNs, static_cast<uint64_t>(st.st_ino)}});
+    } else if (S_ISDIR(st.st_mode)) {
+        if (outputInsideSource(options, job.path)) {
+            std::cerr << "Skipping " << job.path << ": the output directory is inside it" << std::endl;
+            return false;
+        }
+        // Sizes are needed to split files into chunks and to order tasks by size,
+        // and the manifest compares sizes, mtimes and inodes
+        WalkOptions walkOptions = options.walk;
+        walkOptions.needSizes = options.chunkSize != 0 || options.bySize || options.scheduleReport || manifest ||
+                                resuming;
+        DirectoryWalker walker(walkOptions);
+        uint64_t walkStart = monotonicNs();
+        size_t walked = walker.walk(job.path, [&](const std::vector<WalkEntry> &found) {
+            std::vector<WalkEntry> batch = unprocessed(found);
+            if (options.bySize || options.scheduleReport) {
+                files.insert(files.end(), batch.begin(), batch.end());
+            }
+            if (!options.bySize && !batch.empty()) {
+                // Walk order, a batch of walked files at a time
+                submitPlan(engine, planInOrder(batch, job.action, options.chunkSize), output);
+            }
+        });
+        TRACE_SPAN("walk", walkStart, monotonicNs(), "files", walked);
+        std::cout << "Walked " << walked << " files in " << walker.directoriesVisited() << " directories of "
+                  << job.path << "." << std::endl;
+        if (manifest) {
+            std::cout << "Skipped " << skipped << " files the manifest shows unchanged and already "
+                      << (job.action == Action::ENCRYPT ? "encrypted" : "decrypted") << "." << std::endl;
+        }
+        if (resuming) {
+            std::cout << "Skipped " << resumedDone << " files the journal shows done." << std::endl;
+        }
+        if (!options.bySize && !options.scheduleReport) {
+            return !keys.broken;
+        }
+    } else {
+        std::cerr << "Skipping " << job.path << ": not a file or directory" << std::endl;
+        return false;
+    }
+
+    if (options.scheduleReport) {
+        printScheduleReport(std::cout, "walk order",
+            simulateSchedule(planInOrder(files, job.action, options.chunkSize), options.workers));
+        printScheduleReport(std::cout, "size order",
+            simulateSchedule(planBySize(files, job.action, options.chunkSize), options.workers));
+    }
+    if (options.bySize) {
+        submitPlan(engine, planBySize(files, job.action, options.chunkSize), output);
+    } else if (S_ISREG(st.st_mode)) {
+        submitPlan(engine, planInOrder(files, job.action, options.chunkSize), output);
+    }
+    return !keys.broken;
+}
+
+// Probe the input and settle what has to be fixed before the workers start: the
+// backend, the chunk size and how many workers to create. Returns how many of them
+// start out active; the WorkerTuner moves that during the run.
+static size_t autotune(RunOptions &options) {
+    size_t cpus = Topology::get().cpuCount();
+    size_t maxWorkers = options.workersSet ? options.workers : 4 * cpus;
+    WorkloadProbe probe = probeWorkload(options.paths);
+    TunedSettings tuned = chooseSettings(probe, cpus, maxWorkers);
+
+    std::cout << "Autotune: " << tuned.workload;
+    if (tuned.sampled) {
+        std::cout << " (" << probe.files << " files sampled, median " << probe.medianSize / 1024 << " KiB, largest "
+                  << probe.largestSize / 1024 << " KiB, reads "
+                  << static_cast<uint64_t>(probe.readBytesPerSecond / 1048576) << " MB/s, processing "
+                  << static_cast<uint64_t>(probe.cpuBytesPerSecond / 1048576) << " MB/s per CPU)";
+        if (!options.chunkSet) {
+            options.chunkSize = tuned.chunkSize;
+        }
+        if (!options.ioSet) {
+            options.uring = tuned.uring;
+        }
+    }
+    std::cout << ": " << (options.uring ? "io_uring" : "synchronous I/O") << ", chunks of "
+              << options.chunkSize / 1048576 << " MiB, " << tuned.workers << " of " << maxWorkers
+              << " workers active at first" << std::endl;
+    options.workers = static_cast<int>(maxWorkers);
+    return tuned.workers;
+}
+
+static void writeSummary(const WorkerEngine &engine, const std::string &path, double elapsedSeconds) {
+    if (path == "-") {
+        writeSummaryJson(std::cout, engine.workerStats(), elapsedSeconds);
+        return;
+    }
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Unable to write the summary: " << path << std::endl;
+        return;
+    }
+    writeSummaryJson(out, engine.workerStats(), elapsedSeconds);
+}
+
+// Jobs from a job file, or from stdin as they arrive: the pool is already running.
+// False when the file cannot be read or any job failed.
+static bool runJobList(WorkerEngine &engine, const RunOptions &options, Manifest *manifest,
+                       const Journal *journal) {
+    std::ifstream file;
+    if (options.jobFile != "-") {
+        file.open(options.jobFile);
+        if (!file.is_open()) {
+            std::cerr << "Unable to open the job file: " << options.jobFile << std::endl;
+            return false;
+        }
+    }
+    std::istream &in = options.jobFile == "-" ? std::cin : file;
+
+    std::string line;
+    Job job;
+    bool ok = true;
+    while (std::getline(in, line)) {
+        if (parseJobLine(line, options, job)) {
+            ok = runJob(engine, options, manifest, journal, job) && ok;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    RunOptions options = defaultRunOptions();
+    if (argc == 1) {
+        if (!readInteractive(options) || !resolveCipher(options)) {
             return 1; // Indicate error
         }
+    } else {
+        int status = parseCommandLine(argc, argv, options);
+        if (status >= 0) {
+            return status;
+        }
+    }
+
+    bool jobsOk = true;
+    size_t failedFiles = 0;
+    bool stoppedEarly = false;
+    try {
+        // Read .env and key the cipher once; forked workers inherit it along with the settings
+        setRunCipher(options.cipher);
+        KeyMaterial::load();
+        const Cipher &cipher = KeyMaterial::get().cipher();
+        std::cout << "Cipher: " << cipher.name() << " (" << cipher.implementation() << ")" << std::endl;
+        setSyncMappedWrites(options.msync);
+        setDirectCopies(options.direct);
+        setContainerFormat(options.container);
+        setCompressContainers(options.compress);
+        setHugePageBuffers(options.hugePages);
+        if (options.container && options.direct) {
+            std::cout << "Containers are written through the page cache: --direct has no effect" << std::endl;
+        }
+
+        size_t startWorkers = 0;
+        if (options.autotune) {
+            startWorkers = autotune(options);
+        }
+
+        EngineOptions engineOptions;
+        engineOptions.queueDepth = options.queueDepth;
+        engineOptions.uring = options.uring;
+        engineOptions.logTasks = options.logTasks;
+        engineOptions.placement = options.placement;
+        engineOptions.numaNodes = options.numaNodes;
+        if (options.uring && !options.journal.empty()) {
+            // Its blocks are in flight several at a time, which the journal slots cannot describe
+            std::cout << "io_uring runs are not journaled: using synchronous I/O with --journal" << std::endl;
+            engineOptions.uring = false;
+        }
+        std::unique_ptr<WorkerEngine> engine = createWorkerEngine(options.engine, engineOptions);
+
+        // Rings for every worker, the producer and the directory walker threads, mapped
+        // before the workers fork
+        std::unique_ptr<Trace> trace;
+        if (!options.trace.empty()) {
+            if (!TRACE_POINTS) {
+                std::cout << "Built without trace points (TRACE=0): --trace records nothing" << std::endl;
+            }
+            unsigned walkThreads = options.walk.threads != 0 ? options.walk.threads : std::thread::hardware_concurrency();
+            trace = std::make_unique<Trace>(options.workers, walkThreads + 1);
+            Trace::activate(trace.get());
+            Trace::attachThread("producer");
+        }
+
+        // Recovering an interrupted run repairs its files with the key, so after loading it
+        std::unique_ptr<Journal> journal;
+        if (!options.journal.empty()) {
+            journal = std::make_unique<Journal>(options.journal, options.workers, options.resume);
+            Journal::activate(journal.get());
+        }
+
+        std::unique_ptr<Manifest> manifest;
+        if (!options.manifest.empty()) {
+            manifest = std::make_unique<Manifest>(options.manifest);
+        }
 
-        ProcessManagement processManagement;
+        // Workers report the files they fail on here
+        FailureLog failures;
+        FailureLog::activate(&failures);
 
-        // 1. Create worker processes first
-        processManagement.createWorkerProcesses(numWorkers);
+        // 1. Create workers first, one pool for every job of the run
+        uint64_t startNs = monotonicNs();
+        engine->createWorkers(options.workers);
+        if (journal) {
+            journal->startGroupCommit();
+        }
+        std::unique_ptr<WorkerTuner> tuner;
+        if (options.autotune) {
+            tuner = std::make_unique<WorkerTuner>(*engine, startWorkers, options.workers);
+        }
+        std::unique_ptr<ProgressReporter> progress;
+        if (options.progressInterval > 0) {
+            progress = std::make_unique<ProgressReporter>(*engine, options.progressInterval);
+        }
 
         std::cout << "Producer (main process) starting to add tasks..." << std::endl;
         // 2. Producer adds tasks to the queue
-        for (const auto &entry : fs::recursive_directory_iterator(directory)) {
-            if (entry.is_regular_file()) {
-                std::string filePath = entry.path().string();
-                // We no longer need to open the fstream here in the producer
-                // The task will be recreated by the consumer process when it pulls the string
-                // This prevents issues with fstream ownership across processes.
-                Task tempTask(filePath, std::fstream(), action); // Create a temporary task to get the string
-                std::string taskString = tempTask.toString(); // Get the string representation
-
-                if (!processManagement.submitTaskToSharedQueue(taskString)) {
-                    std::cerr << "Failed to submit task for: " << filePath << std::endl;
-                    // Decide how to handle this error (e.g., retry, log, exit)
-                }
-            }
+        for (const std::string &path : options.paths) {
+            jobsOk = runJob(*engine, options, manifest.get(), journal.get(), {options.action, path}) && jobsOk;
+        }
+        if (!options.jobFile.empty()) {
+            jobsOk = runJobList(*engine, options, manifest.get(), journal.get()) && jobsOk;
         }
         std::cout << "Producer finished adding all tasks." << std::endl;
 
-        // 3. Wait for all worker processes to finish
-        processManagement.waitForWorkers();
+        // 3. Wait for all workers to finish
+        engine->waitForWorkers();
+        if (tuner) {
+            tuner->stop();
+        }
+        if (progress) {
+            progress->stop();
+        }
 
         std::cout << "All tasks processed and workers finished." << std::endl;
+        std::vector<FailedFile> failed = failures.files();
+        failedFiles = failed.size();
+        stoppedEarly = engine->stoppedEarly();
+        if (journal) {
+            journal->finish(failed.empty() && !stoppedEarly);
+        }
+        if (manifest) {
+            // Only now do the processed files have their final mtimes
+            std::vector<std::string> failedPaths;
+            for (const FailedFile &file : failed) failedPaths.push_back(file.path);
+            if (manifest->commit(failedPaths)) {
+                std::cout << "Manifest " << options.manifest << ": " << manifest->recorded() << " files recorded, "
+                          << manifest->entries() << " tracked." << std::endl;
+            }
+        }
+        if (!options.summaryJson.empty()) {
+            writeSummary(*engine, options.summaryJson, (monotonicNs() - startNs) / 1e9);
+        }
+        if (trace && trace->writeChromeJson(options.trace)) {
+            std::cout << "Trace " << options.trace << ": " << trace->events() << " events";
+            if (trace->dropped() > 0) {
+                std::cout << " (" << trace->dropped() << " older ones overwritten)";
+            }
+            std::cout << "." << std::endl;
+        }
+        if (!failed.empty()) {
+            std::cerr << failed.size() << " file" << (failed.size() == 1 ? "" : "s")
+                      << " did not reach the target state:" << std::endl;
+            for (size_t i = 0; i < failed.size() && i < FAILURES_LISTED; i++) {
+                std::cerr << "  " << failed[i].path;
+                if (!failed[i].note.empty()) {
+                    std::cerr << " (" << failed[i].note << ")";
+                }
+                std::cerr << std::endl;
+            }
+            if (failed.size() > FAILURES_LISTED) {
+                std::cerr << "  ... and " << failed.size() - FAILURES_LISTED << " more" << std::endl;
+            }
+        }
 
     } catch (const fs::filesystem_error &ex) {
         std::cerr << "Filesystem error: " << ex.what() << std::endl;
@@ -69,5 +518,5 @@ int main(int argv, char **argc) {
         return 1;
     }
 
-    return 0;
-}
\ No newline at end of file
+    return jobsOk && failedFiles == 0 && !stoppedEarly ? 0 : 1;
+}
@@ -0,0 +1,467 @@
+#include "CommandLine.hpp"
+#include "../processes/SharedTaskQueue.hpp"
+#include "../encryptDecrypt/Cipher.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <getopt.h>
+#include <unistd.h>
+
+// Comma separated list from the environment, e.g. CRYPTION_INCLUDE="*.txt,docs/*"
+static std::vector<std::string> listFromEnv(const char *name) {
+    std::vector<std::string> items;
+    const char *value = std::getenv(name);
+    if (value == nullptr) return items;
+    std::string list(value);
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+static bool envIs(const char *name, const char *expected) {
+    const char *value = std::getenv(name);
+    return value != nullptr && std::string(value) == expected;
+}
+
+static size_t sizeFromEnv(const char *name, size_t fallback) {
+    const char *value = std::getenv(name);
+    if (value == nullptr) return fallback;
+    try {
+        return std::stoull(value);
+    } catch (const std::exception &) {
+        std::cerr << "Ignoring invalid " << name << ": " << value << std::endl;
+        return fallback;
+    }
+}
+
+// Files larger than this are split into chunk tasks of this size so several
+// workers can share one big file.
+const size_t DEFAULT_CHUNK_SIZE = 64 << 20;
+
+RunOptions defaultRunOptions() {
+    RunOptions options;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options.workers = cpus > 0 ? static_cast<int>(cpus) : 1;
+
+    const char *engine = std::getenv("CRYPTION_ENGINE");
+    options.engine = engine ? engine : "processes";
+    options.queueDepth = sizeFromEnv("CRYPTION_QUEUE_DEPTH", DEFAULT_QUEUE_DEPTH);
+    options.chunkSize = sizeFromEnv("CRYPTION_CHUNK_SIZE", DEFAULT_CHUNK_SIZE);
+    options.chunkSet = std::getenv("CRYPTION_CHUNK_SIZE") != nullptr;
+    options.uring = envIs("CRYPTION_IO", "uring");
+    options.ioSet = std::getenv("CRYPTION_IO") != nullptr;
+    options.autotune = envIs("CRYPTION_AUTOTUNE", "1");
+    options.placement = Placement::NONE;
+    const char *pin = std::getenv("CRYPTION_PIN");
+    if (pin != nullptr && !parsePlacement(pin, options.placement)) {
+        std::cerr << "Ignoring invalid CRYPTION_PIN: " << pin << std::endl;
+    }
+    options.numaNodes = sizeFromEnv("CRYPTION_NUMA_NODES", 0);
+    options.cipher = "xor";
+    const char *cipher = std::getenv("CRYPTION_CIPHER");
+    if (cipher != nullptr) {
+        if (isCipherName(cipher)) options.cipher = cipher;
+        else std::cerr << "Ignoring invalid CRYPTION_CIPHER: " << cipher << std::endl;
+    }
+    options.msync = envIs("CRYPTION_MSYNC", "1");
+    const char *output = std::getenv("CRYPTION_OUTPUT");
+    if (output != nullptr) options.output = output;
+    options.direct = envIs("CRYPTION_DIRECT", "1");
+    options.container = envIs("CRYPTION_CONTAINER", "1");
+    options.compress = envIs("CRYPTION_COMPRESS", "1");
+    options.hugePages = envIs("CRYPTION_HUGE_PAGES", "1");
+    const char *manifest = std::getenv("CRYPTION_MANIFEST");
+    if (manifest != nullptr) options.manifest = manifest;
+    const char *journal = std::getenv("CRYPTION_JOURNAL");
+    if (journal != nullptr) options.journal = journal;
+    options.resume = envIs("CRYPTION_RESUME", "1");
+    options.bySize = !envIs("CRYPTION_SCHEDULE", "walk");
+    options.scheduleReport = envIs("CRYPTION_SCHEDULE_REPORT", "1");
+    options.logTasks = envIs("CRYPTION_LOG_TASKS", "1");
+    options.progressInterval = 1.0;
+    const char *interval = std::getenv("CRYPTION_PROGRESS_INTERVAL");
+    if (interval != nullptr) options.progressInterval = std::atof(interval);
+    const char *summary = std::getenv("CRYPTION_SUMMARY_JSON");
+    if (summary != nullptr) options.summaryJson = summary;
+    const char *trace = std::getenv("CRYPTION_TRACE");
+    if (trace != nullptr) options.trace = trace;
+
+    const char *depth = std::getenv("CRYPTION_MAX_DEPTH");
+    if (depth != nullptr) options.walk.maxDepth = std::atoi(depth);
+    options.walk.threads = sizeFromEnv("CRYPTION_WALK_THREADS", 0);
+    options.walk.include = listFromEnv("CRYPTION_INCLUDE");
+    options.walk.exclude = listFromEnv("CRYPTION_EXCLUDE");
+    return options;
+}
+
+bool parseAction(std::string text, Action &action) {
+    for (char &c : text) c = std::toupper(static_cast<unsigned char>(c));
+    if (text == "ENCRYPT") action = Action::ENCRYPT;
+    else if (text == "DECRYPT") action = Action::DECRYPT;
+    else return false;
+    return true;
+}
+
+void printUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options] PATH...\n"
+              << "       " << program << " [options] --jobs FILE   (FILE '-' reads stdin)\n"
+              << "       " << program << "                        (interactive)\n"
+              << "Encrypts or decrypts every file under each PATH (a directory or a file) in place,\n"
+              << "or into a copy under --output, with one worker pool for the whole run.\n\n"
+              << "  -a, --action encrypt|decrypt  action for PATHs and job lines without one\n"
+              << "  -f, --jobs FILE               job list, one 'PATH' or 'ACTION PATH' per line\n"
+              << "  -j, --workers N               worker count (default: online CPUs; with --autotune the\n"
+              << "                                most it may use, default 4 per CPU)\n"
+              << "  -e, --engine processes|threads\n"
+              << "  -q, --queue-depth N           shared task queue depth\n"
+              << "  -c, --chunk-size BYTES        split larger files into chunks, K/M/G suffixes (0: never)\n"
+              << "      --io sync|uring           worker file I/O backend\n"
+              << "      --pin none|core|node      pin each worker to a CPU or to a NUMA node, with its memory\n"
+              << "                                and (processes) a task queue per node\n"
+              << "      --numa-nodes N            spread pinned workers over the first N nodes (default: all)\n"
+              << "      --autotune                pick the chunk size and I/O backend from a sample of the\n"
+              << "                                input, and the active worker count from live throughput\n"
+              << "      --cipher xor|chacha20|aes-256-ctr\n"
+              << "                                key stream cipher (default xor, the original pad);\n"
+              << "                                chacha20 and aes-256-ctr need --container\n"
+              << "      --self-test               run the cipher known-answer tests and exit\n"
+              << "      --msync                   msync mapped windows before unmapping\n"
+              << "  -o, --output DIR              leave the sources alone, write PATH as DIR/basename(PATH)\n"
+              << "      --direct                  O_DIRECT reads and writes for --output\n"
+              << "      --container               with --output: encrypt into chunked, authenticated containers\n"
+              << "                                (chacha20 unless --cipher aes-256-ctr), decrypt them back\n"
+              << "      --compress                lz4-compress each container chunk that shrinks, then encrypt\n"
+              << "      --huge-pages              back worker I/O buffers with huge pages (reserved ones when\n"
+              << "                                there are any, transparent ones otherwise)\n"
+              << "  -m, --manifest FILE           skip files FILE records as unchanged and already done,\n"
+              << "                                and record this run's files there\n"
+              << "      --journal FILE            record progress in FILE so an interrupted run can resume\n"
+              << "      --resume                  finish what the run that left --journal FILE did not\n"
+              << "  -d, --max-depth N             directory levels to descend below PATH\n"
+              << "  -I, --include GLOB            only files matching GLOB (repeatable)\n"
+              << "  -X, --exclude GLOB            skip files and directories matching GLOB (repeatable)\n"
+              << "      --walk-threads N          directory walker threads (default: online CPUs)\n"
+              << "      --schedule size|walk      largest first with small files batched, or walk order\n"
+              << "      --schedule-report         print the simulated makespan of both schedules\n"
+              << "      --progress SECONDS        interval between progress lines (default 1, 0: none)\n"
+              << "      --summary-json FILE       write per-worker counters as JSON at the end ('-': stdout)\n"
+              << "      --trace FILE              record walk, queue, I/O and transform events per worker and\n"
+              << "                                write them as Chrome trace JSON (chrome://tracing, perfetto)\n"
+              << "      --log-tasks               print a line for every task a worker executes\n"
+              << "  -h, --help\n";
+}
+
+enum LongOnlyOption {
+    OPT_IO = 256,
+    OPT_MSYNC,
+    OPT_WALK_THREADS,
+    OPT_SCHEDULE,
+    OPT_SCHEDULE_REPORT,
+    OPT_PROGRESS,
+    OPT_SUMMARY_JSON,
+    OPT_TRACE,
+    OPT_LOG_TASKS,
+    OPT_DIRECT,
+    OPT_CONTAINER,
+    OPT_COMPRESS,
+    OPT_HUGE_PAGES,
+    OPT_JOURNAL,
+    OPT_RESUME,
+    OPT_PIN,
+    OPT_NUMA_NODES,
+    OPT_AUTOTUNE,
+    OPT_CIPHER,
+    OPT_SELF_TEST,
+};
+
+static bool parseCount(const char *text, size_t &value) {
+    char *end;
+    unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || *text == '-') return false;
+    value = parsed;
+    return true;
+}
+
+// Byte counts take an optional K, M or G suffix (powers of 1024)
+static bool parseBytes(const char *text, size_t &value) {
+    std::string digits(text);
+    size_t shift = 0;
+    if (!digits.empty()) {
+        switch (std::toupper(static_cast<unsigned char>(digits.back()))) {
+            case 'K': shift = 10; break;
+            case 'M': shift = 20; break;
+            case 'G': shift = 30; break;
+        }
+        if (shift != 0) digits.pop_back();
+    }
+    if (!parseCount(digits.c_str(), value)) return false;
+    value <<= shift;
+    return true;
+}
+
+int parseCommandLine(int argc, char **argv, RunOptions &options) {
+    static const struct option longOptions[] = {
+        {"action", required_argument, nullptr, 'a'},
+        {"jobs", required_argument, nullptr, 'f'},
+        {"workers", required_argument, nullptr, 'j'},
+        {"engine", required_argument, nullptr, 'e'},
+        {"queue-depth", required_argument, nullptr, 'q'},
+        {"chunk-size", required_argument, nullptr, 'c'},
+        {"io", required_argument, nullptr, OPT_IO},
+        {"msync", no_argument, nullptr, OPT_MSYNC},
+        {"pin", required_argument, nullptr, OPT_PIN},
+        {"numa-nodes", required_argument, nullptr, OPT_NUMA_NODES},
+        {"autotune", no_argument, nullptr, OPT_AUTOTUNE},
+        {"cipher", required_argument, nullptr, OPT_CIPHER},
+        {"self-test", no_argument, nullptr, OPT_SELF_TEST},
+        {"output", required_argument, nullptr, 'o'},
+        {"direct", no_argument, nullptr, OPT_DIRECT},
+        {"container", no_argument, nullptr, OPT_CONTAINER},
+        {"compress", no_argument, nullptr, OPT_COMPRESS},
+        {"huge-pages", no_argument, nullptr, OPT_HUGE_PAGES},
+        {"manifest", required_argument, nullptr, 'm'},
+        {"journal", required_argument, nullptr, OPT_JOURNAL},
+        {"resume", no_argument, nullptr, OPT_RESUME},
+        {"max-depth", required_argument, nullptr, 'd'},
+        {"include", required_argument, nullptr, 'I'},
+        {"exclude", required_argument, nullptr, 'X'},
+        {"walk-threads", required_argument, nullptr, OPT_WALK_THREADS},
+        {"schedule", required_argument, nullptr, OPT_SCHEDULE},
+        {"schedule-report", no_argument, nullptr, OPT_SCHEDULE_REPORT},
+        {"progress", required_argument, nullptr, OPT_PROGRESS},
+        {"summary-json", required_argument, nullptr, OPT_SUMMARY_JSON},
+        {"trace", required_argument, nullptr, OPT_TRACE},
+        {"log-tasks", no_argument, nullptr, OPT_LOG_TASKS},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    size_t count;
+    while ((opt = getopt_long(argc, argv, "a:f:j:e:q:c:o:m:d:I:X:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'a':
+                if (!parseAction(optarg, options.action)) {
+                    std::cerr << "Invalid action: " << optarg << std::endl;
+                    return 2;
+                }
+                options.haveAction = true;
+                break;
+            case 'f':
+                options.jobFile = optarg;
+                break;
+            case 'j':
+                if (!parseCount(optarg, count) || count == 0) {
+                    std::cerr << "Invalid worker count: " << optarg << std::endl;
+                    return 2;
+                }
+                options.workers = static_cast<int>(count);
+                options.workersSet = true;
+                break;
+            case 'e':
+                options.engine = optarg;
+                break;
+            case 'q':
+                if (!parseCount(optarg, options.queueDepth) || options.queueDepth == 0) {
+                    std::cerr << "Invalid queue depth: " << optarg << std::endl;
+                    return 2;
+                }
+                break;
+            case 'c':
+                if (!parseBytes(optarg, options.chunkSize)) {
+                    std::cerr << "Invalid chunk size: " << optarg << std::endl;
+                    return 2;
+                }
+                options.chunkSet = true;
+                break;
+            case OPT_IO:
+                if (std::string(optarg) != "sync" && std::string(optarg) != "uring") {
+                    std::cerr << "Invalid I/O backend: " << optarg << std::endl;
+                    return 2;
+                }
+                options.uring = std::string(optarg) == "uring";
+                options.ioSet = true;
+                break;
+            case OPT_MSYNC:
+                options.msync = true;
+                break;
+            case OPT_PIN:
+                if (!parsePlacement(optarg, options.placement)) {
+                    std::cerr << "Invalid placement: " << optarg << std::endl;
+                    return 2;
+                }
+                break;
+            case OPT_NUMA_NODES:
+                if (!parseCount(optarg, options.numaNodes) || options.numaNodes == 0) {
+                    std::cerr << "Invalid NUMA node count: " << optarg << std::endl;
+                    return 2;
+                }
+                break;
+            case OPT_AUTOTUNE:
+                options.autotune = true;
+                break;
+            case OPT_CIPHER:
+                if (!isCipherName(optarg)) {
+                    std::cerr << "Invalid cipher: " << optarg << std::endl;
+                    return 2;
+                }
+                options.cipher = optarg;
+                break;
+            case OPT_SELF_TEST:
+                return runCipherSelfTest(std::cout) ? 0 : 1;
+            case 'o':
+                options.output = optarg;
+                break;
+            case OPT_DIRECT:
+                options.direct = true;
+                break;
+            case OPT_CONTAINER:
+                options.container = true;
+                break;
+            case OPT_COMPRESS:
+                options.compress = true;
+                break;
+            case OPT_HUGE_PAGES:
+                options.hugePages = true;
+                break;
+            case 'm':
+                options.manifest = optarg;
+                break;
+            case OPT_JOURNAL:
+                options.journal = optarg;
+                break;
+            case OPT_RESUME:
+                options.resume = true;
+                break;
+            case 'd':
+                if (!parseCount(optarg, count)) {
+                    std::cerr << "Invalid depth: " << optarg << std::endl;
+                    return 2;
+                }
+                options.walk.maxDepth = static_cast<int>(count);
+                break;
+            case 'I':
+                options.walk.include.push_back(optarg);
+                break;
+            case 'X':
+                options.walk.exclude.push_back(optarg);
+                break;
+            case OPT_WALK_THREADS:
+                if (!parseCount(optarg, count)) {
+                    std::cerr << "Invalid walker thread count: " << optarg << std::endl;
+                    return 2;
+                }
+                options.walk.threads = static_cast<unsigned>(count);
+                break;
+            case OPT_SCHEDULE:
+                if (std::string(optarg) != "size" && std::string(optarg) != "walk") {
+                    std::cerr << "Invalid schedule: " << optarg << std::endl;
+                    return 2;
+                }
+                options.bySize = std::string(optarg) == "size";
+                break;
+            case OPT_SCHEDULE_REPORT:
+                options.scheduleReport = true;
+                break;
+            case OPT_PROGRESS: {
+                char *end;
+                options.progressInterval = std::strtod(optarg, &end);
+                if (*optarg == '\0' || *end != '\0' || options.progressInterval < 0) {
+                    std::cerr << "Invalid progress interval: " << optarg << std::endl;
+                    return 2;
+                }
+                break;
+            }
+            case OPT_SUMMARY_JSON:
+                options.summaryJson = optarg;
+                break;
+            case OPT_TRACE:
+                options.trace = optarg;
+                break;
+            case OPT_LOG_TASKS:
+                options.logTasks = true;
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                return 2;
+        }
+    }
+
+    for (int i = optind; i < argc; i++) {
+        options.paths.push_back(argv[i]);
+    }
+    if (options.paths.empty() && options.jobFile.empty()) {
+        std::cerr << "Nothing to do: give PATHs or --jobs" << std::endl;
+        return 2;
+    }
+    while (options.output.size() > 1 && options.output.back() == '/') {
+        options.output.pop_back();
+    }
+    if (options.container && options.output.empty()) {
+        std::cerr << "--container writes the containers under --output" << std::endl;
+        return 2;
+    }
+    if (options.compress && !options.container) {
+        std::cerr << "--compress needs --container: only containers record what each chunk shrank to" << std::endl;
+        return 2;
+    }
+    if (!resolveCipher(options)) {
+        return 2;
+    }
+    if (options.resume && options.journal.empty()) {
+        std::cerr << "--resume needs the --journal of the interrupted run" << std::endl;
+        return 2;
+    }
+    if (!options.paths.empty() && !options.haveAction) {
+        std::cerr << "--action is required for PATH arguments" << std::endl;
+        return 2;
+    }
+    return -1;
+}
+
+bool resolveCipher(RunOptions &options) {
+    // The xor pad has no per-file keys; a container records its cipher, so decrypting needs no --cipher
+    if (options.container && options.cipher == "xor") {
+        options.cipher = "chacha20";
+    }
+    // Outside a container there is nowhere to keep a per-file nonce: every file would get
+    // the same chacha20 or aes-256-ctr key stream, and two files under one key stream
+    // give away the xor of their plaintexts
+    if (!options.container && options.cipher != "xor") {
+        std::cerr << "The " << options.cipher << " cipher needs --container: only containers "
+                  << "store the per-file salt its key stream is derived from" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool parseJobLine(const std::string &line, const RunOptions &options, Job &job) {
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#') {
+        return false;
+    }
+    size_t end = line.find_last_not_of(" \t\r");
+    std::string text = line.substr(start, end - start + 1);
+
+    // "ACTION PATH" when the first word is an action, otherwise the whole line is a path
+    size_t space = text.find_first_of(" \t");
+    if (space != std::string::npos && parseAction(text.substr(0, space), job.action)) {
+        job.path = text.substr(text.find_first_not_of(" \t", space));
+        return true;
+    }
+    if (!options.haveAction) {
+        std::cerr << "No action for job (use ACTION PATH or --action): " << text << std::endl;
+        return false;
+    }
+    job.action = options.action;
+    job.path = text;
+    return true;
+}
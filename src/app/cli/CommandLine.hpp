@@ -0,0 +1,76 @@
+#ifndef COMMAND_LINE_HPP
+#define COMMAND_LINE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "../processes/Task.hpp"
+#include "../processes/Topology.hpp"
+#include "../fileHandling/DirectoryWalker.hpp"
+
+// Everything a run is configured with. Defaults come from the CRYPTION_* environment
+// variables the tool has always read, and command-line flags override them.
+struct RunOptions {
+    int workers;              // Default: one per online CPU
+    std::string engine;       // "processes" or "threads"
+    size_t queueDepth;
+    size_t chunkSize;         // 0 disables chunking
+    bool uring;               // Worker I/O through io_uring instead of read/write
+    Placement placement;      // Pin workers to CPUs or NUMA nodes
+    size_t numaNodes;         // Nodes pinned workers are spread over, 0: all
+    std::string cipher;       // Key stream cipher, see cipherNames()
+    bool msync;               // msync mapped windows before unmapping them
+    std::string output;       // Out of place: mirror every PATH under this directory
+    bool direct;              // O_DIRECT reads and writes for out-of-place copies
+    bool container;           // Out of place: write (and read back) chunked, authenticated containers
+    bool compress;            // lz4-compress container chunks before encrypting them
+    bool hugePages;           // Back worker I/O buffers with huge pages
+    std::string manifest;     // Skip files a persistent manifest shows already done
+    std::string journal;      // Progress journal for resuming an interrupted run
+    bool resume;              // Recover the journal left by an interrupted run first
+    bool bySize;              // Largest-first scheduling with small-file batches
+    bool scheduleReport;
+    bool logTasks;            // One line per executed task
+    double progressInterval;  // Seconds between progress lines, 0 disables them
+    std::string summaryJson;  // Where to write the JSON summary, "-" for stdout, empty for none
+    std::string trace;        // Where to write the Chrome trace of the run, empty for none
+    bool autotune;            // Probe the input and tune the worker count, chunk size and backend
+    // Set explicitly (flag or environment): autotune leaves these alone, and workers
+    // is then the most it may activate
+    bool workersSet = false;
+    bool chunkSet = false;
+    bool ioSet = false;
+    WalkOptions walk;
+
+    bool haveAction = false;
+    Action action = Action::ENCRYPT;
+    std::vector<std::string> paths; // Directories or files named on the command line
+    std::string jobFile;            // "-" reads the job list from stdin
+};
+
+// One unit of work: a directory tree or a single file, with its action
+struct Job {
+    Action action;
+    std::string path;
+};
+
+RunOptions defaultRunOptions();
+
+// "encrypt"/"decrypt" in any case; false for anything else
+bool parseAction(std::string text, Action &action);
+
+// Fill options from argv. Returns -1 to go on with the run, otherwise the exit
+// status to return right away (after --help, or 2 on a usage error).
+int parseCommandLine(int argc, char **argv, RunOptions &options);
+
+// Apply the container cipher default and refuse ciphers that need a container
+// outside one; false (after saying why) when the run must not start
+bool resolveCipher(RunOptions &options);
+
+// Job list line: "PATH" (using the --action default) or "ACTION PATH";
+// blank lines and lines starting with '#' yield false
+bool parseJobLine(const std::string &line, const RunOptions &options, Job &job);
+
+void printUsage(const char *program);
+
+#endif
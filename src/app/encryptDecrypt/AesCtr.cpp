@@ -0,0 +1,229 @@
+#include "AesCtr.hpp"
+#include <immintrin.h>
+#include <cstring>
+
+static const size_t AESNI_BLOCKS = 8;
+static const size_t VAES_BLOCKS = 16;
+
+static inline uint8_t rotl8(uint8_t x, int n) {
+    return static_cast<uint8_t>((x << n) | (x >> (8 - n)));
+}
+
+static inline uint8_t xtime(uint8_t x) {
+    return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+// The S-box from its definition: the inverse in GF(2^8) followed by the affine map.
+// p walks the multiplicative group by powers of 3 while q walks it by powers of 1/3.
+static const uint8_t *sbox() {
+    static const struct Table {
+        uint8_t values[256];
+        Table() {
+            uint8_t p = 1, q = 1;
+            do {
+                p = static_cast<uint8_t>(p ^ xtime(p));
+                q ^= static_cast<uint8_t>(q << 1);
+                q ^= static_cast<uint8_t>(q << 2);
+                q ^= static_cast<uint8_t>(q << 4);
+                if (q & 0x80) q ^= 0x09;
+                values[p] = static_cast<uint8_t>(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63);
+            } while (p != 1);
+            values[0] = 0x63;
+        }
+    } table;
+    return table.values;
+}
+
+static void expandKey(const uint8_t key[AES256_KEY_LENGTH], AesRoundKeys &keys) {
+    const uint8_t *s = sbox();
+    uint8_t *w = keys.bytes;
+    memcpy(w, key, AES256_KEY_LENGTH);
+    uint8_t rcon = 1;
+    for (size_t i = 8; i < 4 * (AES256_ROUNDS + 1); i++) {
+        uint8_t t[4];
+        memcpy(t, w + 4 * (i - 1), 4);
+        if (i % 8 == 0) {
+            uint8_t first = t[0];
+            t[0] = static_cast<uint8_t>(s[t[1]] ^ rcon);
+            t[1] = s[t[2]];
+            t[2] = s[t[3]];
+            t[3] = s[first];
+            rcon = xtime(rcon);
+        } else if (i % 8 == 4) {
+            for (uint8_t &b : t) b = s[b];
+        }
+        for (int j = 0; j < 4; j++) w[4 * i + j] = w[4 * (i - 8) + j] ^ t[j];
+    }
+}
+
+// Counter block i after the initial one, big endian
+static inline void counterBlock(uint64_t ivHigh, uint64_t ivLow, uint64_t i, uint8_t out[AES_BLOCK_LENGTH]) {
+    uint64_t low = ivLow + i;
+    uint64_t high = ivHigh + (low < ivLow ? 1 : 0);
+    uint64_t words[2] = {__builtin_bswap64(high), __builtin_bswap64(low)};
+    memcpy(out, words, AES_BLOCK_LENGTH);
+}
+
+// The state is column major, byte r + 4c in row r and column c, as in FIPS-197
+static void encryptBlock(const AesRoundKeys &keys, uint8_t state[AES_BLOCK_LENGTH]) {
+    const uint8_t *s = sbox();
+    for (size_t i = 0; i < AES_BLOCK_LENGTH; i++) state[i] ^= keys.bytes[i];
+    for (size_t round = 1; round <= AES256_ROUNDS; round++) {
+        // SubBytes and ShiftRows: row r moves r columns to the left
+        uint8_t shifted[AES_BLOCK_LENGTH];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) shifted[r + 4 * c] = s[state[r + 4 * ((c + r) % 4)]];
+        }
+        if (round < AES256_ROUNDS) {
+            for (int c = 0; c < 4; c++) {
+                uint8_t *col = shifted + 4 * c;
+                uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                uint8_t first = col[0];
+                col[0] ^= all ^ xtime(col[0] ^ col[1]);
+                col[1] ^= all ^ xtime(col[1] ^ col[2]);
+                col[2] ^= all ^ xtime(col[2] ^ col[3]);
+                col[3] ^= all ^ xtime(col[3] ^ first);
+            }
+        }
+        const uint8_t *roundKey = keys.bytes + round * AES_BLOCK_LENGTH;
+        for (size_t i = 0; i < AES_BLOCK_LENGTH; i++) state[i] = shifted[i] ^ roundKey[i];
+    }
+}
+
+static void aesCtrPortable(const AesRoundKeys &keys, uint64_t ivHigh, uint64_t ivLow, uint64_t counter,
+                           uint8_t *data, size_t blocks) {
+    for (size_t n = 0; n < blocks; n++, data += AES_BLOCK_LENGTH) {
+        uint8_t block[AES_BLOCK_LENGTH];
+        counterBlock(ivHigh, ivLow, counter + n, block);
+        encryptBlock(keys, block);
+        for (size_t i = 0; i < AES_BLOCK_LENGTH; i++) data[i] ^= block[i];
+    }
+}
+
+// The SIMD kernels keep the counter block as two native 64-bit lanes (low, high) and
+// byte-reverse it into the big-endian block; the low lane never carries within a call
+#define REVERSE_BYTES 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+
+// Eight independent blocks in flight hide the latency of each aesenc
+__attribute__((target("aes,sse4.1")))
+static void aesCtrAESNI(const AesRoundKeys &keys, uint64_t ivHigh, uint64_t ivLow, uint64_t counter,
+                        uint8_t *data, size_t blocks) {
+    __m128i rk[AES256_ROUNDS + 1];
+    for (size_t r = 0; r <= AES256_ROUNDS; r++) {
+        rk[r] = _mm_load_si128(reinterpret_cast<const __m128i *>(keys.bytes + r * AES_BLOCK_LENGTH));
+    }
+    const __m128i reverse = _mm_setr_epi8(REVERSE_BYTES);
+    uint64_t low = ivLow + counter;
+    uint64_t high = ivHigh + (low < ivLow ? 1 : 0);
+    auto counterAt = [&](size_t i) __attribute__((target("aes,sse4.1"))) {
+        return _mm_shuffle_epi8(_mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low + i)), reverse);
+    };
+    size_t n = 0;
+    for (; n + AESNI_BLOCKS <= blocks; n += AESNI_BLOCKS) {
+        __m128i b[AESNI_BLOCKS];
+        for (size_t j = 0; j < AESNI_BLOCKS; j++) {
+            b[j] = _mm_xor_si128(counterAt(n + j), rk[0]);
+        }
+        for (size_t r = 1; r < AES256_ROUNDS; r++) {
+            for (size_t j = 0; j < AESNI_BLOCKS; j++) b[j] = _mm_aesenc_si128(b[j], rk[r]);
+        }
+        for (size_t j = 0; j < AESNI_BLOCKS; j++) {
+            __m128i *p = reinterpret_cast<__m128i *>(data + (n + j) * AES_BLOCK_LENGTH);
+            __m128i stream = _mm_aesenclast_si128(b[j], rk[AES256_ROUNDS]);
+            _mm_storeu_si128(p, _mm_xor_si128(stream, _mm_loadu_si128(p)));
+        }
+    }
+    for (; n < blocks; n++) {
+        __m128i b = _mm_xor_si128(counterAt(n), rk[0]);
+        for (size_t r = 1; r < AES256_ROUNDS; r++) b = _mm_aesenc_si128(b, rk[r]);
+        __m128i *p = reinterpret_cast<__m128i *>(data + n * AES_BLOCK_LENGTH);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_aesenclast_si128(b, rk[AES256_ROUNDS]), _mm_loadu_si128(p)));
+    }
+}
+
+// GCC 12 warns about the _mm512_undefined_epi32() its own rotate and broadcast
+// wrappers start from; the value is never read
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// Four 512-bit registers of four blocks each: the same round keys broadcast to every lane
+__attribute__((target("avx512f,avx512bw,vaes,aes,sse4.1")))
+static void aesCtrVAES(const AesRoundKeys &keys, uint64_t ivHigh, uint64_t ivLow, uint64_t counter,
+                       uint8_t *data, size_t blocks) {
+    __m512i rk[AES256_ROUNDS + 1];
+    for (size_t r = 0; r <= AES256_ROUNDS; r++) {
+        rk[r] = _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i *>(keys.bytes + r * AES_BLOCK_LENGTH)));
+    }
+    const size_t registers = VAES_BLOCKS / 4;
+    const __m512i reverse = _mm512_broadcast_i32x4(_mm_setr_epi8(REVERSE_BYTES));
+    uint64_t low = ivLow + counter;
+    uint64_t high = ivHigh + (low < ivLow ? 1 : 0);
+    // Register j covers blocks 4j to 4j + 3 of a pass, one per 128-bit lane
+    __m512i steps[registers];
+    for (size_t j = 0; j < registers; j++) {
+        long long first = static_cast<long long>(4 * j);
+        steps[j] = _mm512_set_epi64(0, first + 3, 0, first + 2, 0, first + 1, 0, first);
+    }
+    size_t n = 0;
+    for (; n + VAES_BLOCKS <= blocks; n += VAES_BLOCKS) {
+        __m512i base = _mm512_broadcast_i32x4(_mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low + n)));
+        __m512i b[registers];
+        for (size_t j = 0; j < registers; j++) {
+            __m512i block = _mm512_shuffle_epi8(_mm512_add_epi64(base, steps[j]), reverse);
+            b[j] = _mm512_xor_si512(block, rk[0]);
+        }
+        for (size_t r = 1; r < AES256_ROUNDS; r++) {
+            for (size_t j = 0; j < registers; j++) b[j] = _mm512_aesenc_epi128(b[j], rk[r]);
+        }
+        for (size_t j = 0; j < registers; j++) {
+            uint8_t *p = data + n * AES_BLOCK_LENGTH + 64 * j;
+            __m512i stream = _mm512_aesenclast_epi128(b[j], rk[AES256_ROUNDS]);
+            _mm512_storeu_si512(p, _mm512_xor_si512(stream, _mm512_loadu_si512(p)));
+        }
+    }
+    aesCtrAESNI(keys, ivHigh, ivLow, counter + n, data + n * AES_BLOCK_LENGTH, blocks - n);
+}
+
+#pragma GCC diagnostic pop
+
+const std::vector<AesCtrKernel> &availableAesCtrKernels() {
+    static const std::vector<AesCtrKernel> kernels = [] {
+        std::vector<AesCtrKernel> list;
+        __builtin_cpu_init();
+        list.push_back({"portable", aesCtrPortable});
+        bool aesni = __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse4.1");
+        if (aesni) list.push_back({"aesni", aesCtrAESNI});
+        if (aesni && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+            __builtin_cpu_supports("vaes")) {
+            list.push_back({"vaes", aesCtrVAES});
+        }
+        return list;
+    }();
+    return kernels;
+}
+
+static uint64_t load64BigEndian(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return __builtin_bswap64(value);
+}
+
+AesCtr::AesCtr(const uint8_t key[AES256_KEY_LENGTH], const uint8_t iv[AES_BLOCK_LENGTH], const AesCtrKernel &kernel)
+    : CounterModeCipher(AES_BLOCK_LENGTH), ivHigh(load64BigEndian(iv)), ivLow(load64BigEndian(iv + 8)),
+      kernel(kernel) {
+    expandKey(key, keys);
+}
+
+void AesCtr::xorBlocks(uint64_t counter, uint8_t *data, size_t blocks) const {
+    // Split where the low 64 bits of the counter block wrap, so no kernel call carries
+    uint64_t low = ivLow + counter;
+    uint64_t beforeWrap = ~low + 1; // Blocks until low wraps to 0, 0 meaning 2^64
+    if (beforeWrap != 0 && blocks > beforeWrap) {
+        kernel.fn(keys, ivHigh, ivLow, counter, data, beforeWrap);
+        counter += beforeWrap;
+        data += beforeWrap * AES_BLOCK_LENGTH;
+        blocks -= beforeWrap;
+    }
+    kernel.fn(keys, ivHigh, ivLow, counter, data, blocks);
+}
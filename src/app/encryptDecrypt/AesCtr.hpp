@@ -0,0 +1,53 @@
+#ifndef AES_CTR_HPP
+#define AES_CTR_HPP
+
+#include "Cipher.hpp"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+const size_t AES256_KEY_LENGTH = 32;
+const size_t AES_BLOCK_LENGTH = 16;
+const size_t AES256_ROUNDS = 14;
+
+// The expanded AES-256 key, in the byte order of FIPS-197, which is also the order
+// the AES-NI and VAES round instructions take
+struct AesRoundKeys {
+    alignas(16) uint8_t bytes[(AES256_ROUNDS + 1) * AES_BLOCK_LENGTH];
+};
+
+// XOR blocks key stream blocks into data. The counter block of block i is the 128-bit
+// big-endian sum of the initial counter block (ivHigh, ivLow) and counter + i; the low
+// 64 bits of the counter block never wrap within one call.
+using AesCtrKernelFn = void (*)(const AesRoundKeys &keys, uint64_t ivHigh, uint64_t ivLow, uint64_t counter,
+                                uint8_t *data, size_t blocks);
+
+struct AesCtrKernel {
+    const char *name;
+    AesCtrKernelFn fn;
+};
+
+// Every kernel the current CPU can run: a portable byte-wise fallback, then AES-NI
+// (8 blocks interleaved) and VAES (16 blocks in four 512-bit registers)
+const std::vector<AesCtrKernel> &availableAesCtrKernels();
+
+// AES-256 in counter mode (NIST SP 800-38A) with a full 128-bit counter block
+class AesCtr : public CounterModeCipher {
+    public:
+        AesCtr(const uint8_t key[AES256_KEY_LENGTH], const uint8_t iv[AES_BLOCK_LENGTH],
+               const AesCtrKernel &kernel = availableAesCtrKernels().back());
+
+        const char *name() const override { return "aes-256-ctr"; }
+        const char *implementation() const override { return kernel.name; }
+
+    protected:
+        void xorBlocks(uint64_t counter, uint8_t *data, size_t blocks) const override;
+
+    private:
+        AesRoundKeys keys;
+        uint64_t ivHigh;
+        uint64_t ivLow;
+        AesCtrKernel kernel;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "ChaCha20.hpp"
+#include <immintrin.h>
+#include <cstring>
+
+static const size_t AVX2_BLOCKS = 8;
+static const size_t AVX512_BLOCKS = 16;
+
+static inline uint32_t rotl(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = rotl(d, 16); \
+    c += d; b ^= c; b = rotl(b, 12); \
+    a += b; d ^= a; d = rotl(d, 8);  \
+    c += d; b ^= c; b = rotl(b, 7);
+
+// One block at a time, words stored little endian
+static void chachaScalar(const uint32_t state[16], uint64_t counter, uint8_t *data, size_t blocks) {
+    for (size_t n = 0; n < blocks; n++, counter++, data += CHACHA20_BLOCK_LENGTH) {
+        uint32_t input[16];
+        memcpy(input, state, sizeof(input));
+        input[12] = static_cast<uint32_t>(counter);
+        input[13] = static_cast<uint32_t>(counter >> 32);
+        uint32_t x[16];
+        memcpy(x, input, sizeof(x));
+        for (int round = 0; round < 10; round++) {
+            QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+            QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+            QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+            QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+            QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+            QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+            QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+            QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; i++) {
+            uint32_t word = x[i] + input[i];
+            data[4 * i] ^= static_cast<uint8_t>(word);
+            data[4 * i + 1] ^= static_cast<uint8_t>(word >> 8);
+            data[4 * i + 2] ^= static_cast<uint8_t>(word >> 16);
+            data[4 * i + 3] ^= static_cast<uint8_t>(word >> 24);
+        }
+    }
+}
+
+// The counter words of count consecutive blocks, carrying into the high word
+static void splitCounters(uint64_t counter, size_t count, uint32_t *low, uint32_t *high) {
+    for (size_t i = 0; i < count; i++) {
+        low[i] = static_cast<uint32_t>(counter + i);
+        high[i] = static_cast<uint32_t>((counter + i) >> 32);
+    }
+}
+
+// Vertical layout: register j holds word j of eight blocks, one per 32-bit lane, so
+// every quarter round works on eight blocks at once. Rotations by 16 and 8 are byte
+// shuffles; the others are shift pairs.
+#define ROTL_AVX2(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n))
+#define QUARTER_ROUND_AVX2(a, b, c, d) \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTL_AVX2(b, 12); \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTL_AVX2(b, 7);
+
+__attribute__((target("avx2")))
+static void chachaAVX2(const uint32_t state[16], uint64_t counter, uint8_t *data, size_t blocks) {
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    for (; blocks >= AVX2_BLOCKS; blocks -= AVX2_BLOCKS, counter += AVX2_BLOCKS, data += AVX2_BLOCKS * CHACHA20_BLOCK_LENGTH) {
+        alignas(32) uint32_t low[AVX2_BLOCKS], high[AVX2_BLOCKS];
+        splitCounters(counter, AVX2_BLOCKS, low, high);
+        __m256i input[16];
+        for (int i = 0; i < 16; i++) input[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+        input[12] = _mm256_load_si256(reinterpret_cast<const __m256i *>(low));
+        input[13] = _mm256_load_si256(reinterpret_cast<const __m256i *>(high));
+        __m256i x[16];
+        for (int i = 0; i < 16; i++) x[i] = input[i];
+        for (int round = 0; round < 10; round++) {
+            QUARTER_ROUND_AVX2(x[0], x[4], x[8], x[12]);
+            QUARTER_ROUND_AVX2(x[1], x[5], x[9], x[13]);
+            QUARTER_ROUND_AVX2(x[2], x[6], x[10], x[14]);
+            QUARTER_ROUND_AVX2(x[3], x[7], x[11], x[15]);
+            QUARTER_ROUND_AVX2(x[0], x[5], x[10], x[15]);
+            QUARTER_ROUND_AVX2(x[1], x[6], x[11], x[12]);
+            QUARTER_ROUND_AVX2(x[2], x[7], x[8], x[13]);
+            QUARTER_ROUND_AVX2(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i], input[i]);
+
+        // Transpose each half (words 0-7, then 8-15) from word-major to block-major:
+        // 32- and 64-bit unpacks within the 128-bit lanes, then swap lane halves
+        for (int half = 0; half < 2; half++) {
+            __m256i *a = x + 8 * half;
+            __m256i t0 = _mm256_unpacklo_epi32(a[0], a[1]), t1 = _mm256_unpackhi_epi32(a[0], a[1]);
+            __m256i t2 = _mm256_unpacklo_epi32(a[2], a[3]), t3 = _mm256_unpackhi_epi32(a[2], a[3]);
+            __m256i t4 = _mm256_unpacklo_epi32(a[4], a[5]), t5 = _mm256_unpackhi_epi32(a[4], a[5]);
+            __m256i t6 = _mm256_unpacklo_epi32(a[6], a[7]), t7 = _mm256_unpackhi_epi32(a[6], a[7]);
+            __m256i u[8] = {
+                _mm256_unpacklo_epi64(t0, t2), _mm256_unpackhi_epi64(t0, t2),
+                _mm256_unpacklo_epi64(t1, t3), _mm256_unpackhi_epi64(t1, t3),
+                _mm256_unpacklo_epi64(t4, t6), _mm256_unpackhi_epi64(t4, t6),
+                _mm256_unpacklo_epi64(t5, t7), _mm256_unpackhi_epi64(t5, t7),
+            };
+            // u[k] holds half of block k (low lane) and of block k + 4 (high lane)
+            for (int k = 0; k < 4; k++) {
+                uint8_t *lowBlock = data + k * CHACHA20_BLOCK_LENGTH + 32 * half;
+                uint8_t *highBlock = lowBlock + 4 * CHACHA20_BLOCK_LENGTH;
+                __m256i first = _mm256_permute2x128_si256(u[k], u[k + 4], 0x20);
+                __m256i second = _mm256_permute2x128_si256(u[k], u[k + 4], 0x31);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lowBlock),
+                                    _mm256_xor_si256(first, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lowBlock))));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(highBlock),
+                                    _mm256_xor_si256(second, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(highBlock))));
+            }
+        }
+    }
+    chachaScalar(state, counter, data, blocks);
+}
+
+// GCC 12 warns about the _mm512_undefined_epi32() its own rotate and broadcast
+// wrappers start from; the value is never read
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// Sixteen blocks per pass, with native 32-bit rotates
+#define QUARTER_ROUND_AVX512(a, b, c, d) \
+    a = _mm512_add_epi32(a, b); d = _mm512_rol_epi32(_mm512_xor_si512(d, a), 16); \
+    c = _mm512_add_epi32(c, d); b = _mm512_rol_epi32(_mm512_xor_si512(b, c), 12); \
+    a = _mm512_add_epi32(a, b); d = _mm512_rol_epi32(_mm512_xor_si512(d, a), 8);  \
+    c = _mm512_add_epi32(c, d); b = _mm512_rol_epi32(_mm512_xor_si512(b, c), 7);
+
+__attribute__((target("avx512f,avx2")))
+static void chachaAVX512(const uint32_t state[16], uint64_t counter, uint8_t *data, size_t blocks) {
+    for (; blocks >= AVX512_BLOCKS; blocks -= AVX512_BLOCKS, counter += AVX512_BLOCKS,
+                                    data += AVX512_BLOCKS * CHACHA20_BLOCK_LENGTH) {
+        alignas(64) uint32_t low[AVX512_BLOCKS], high[AVX512_BLOCKS];
+        splitCounters(counter, AVX512_BLOCKS, low, high);
+        __m512i input[16];
+        for (int i = 0; i < 16; i++) input[i] = _mm512_set1_epi32(static_cast<int>(state[i]));
+        input[12] = _mm512_load_si512(low);
+        input[13] = _mm512_load_si512(high);
+        __m512i x[16];
+        for (int i = 0; i < 16; i++) x[i] = input[i];
+        for (int round = 0; round < 10; round++) {
+            QUARTER_ROUND_AVX512(x[0], x[4], x[8], x[12]);
+            QUARTER_ROUND_AVX512(x[1], x[5], x[9], x[13]);
+            QUARTER_ROUND_AVX512(x[2], x[6], x[10], x[14]);
+            QUARTER_ROUND_AVX512(x[3], x[7], x[11], x[15]);
+            QUARTER_ROUND_AVX512(x[0], x[5], x[10], x[15]);
+            QUARTER_ROUND_AVX512(x[1], x[6], x[11], x[12]);
+            QUARTER_ROUND_AVX512(x[2], x[7], x[8], x[13]);
+            QUARTER_ROUND_AVX512(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; i++) x[i] = _mm512_add_epi32(x[i], input[i]);
+
+        // A 4x4 transpose within every 128-bit lane for each group of four words, so
+        // v[k][g] lane L holds words 4g..4g+3 of block 4L + k, then a 4x4 transpose of
+        // the lanes puts the four groups of one block into one register
+        __m512i v[4][4];
+        for (int g = 0; g < 4; g++) {
+            __m512i *a = x + 4 * g;
+            __m512i t0 = _mm512_unpacklo_epi32(a[0], a[1]), t1 = _mm512_unpackhi_epi32(a[0], a[1]);
+            __m512i t2 = _mm512_unpacklo_epi32(a[2], a[3]), t3 = _mm512_unpackhi_epi32(a[2], a[3]);
+            v[0][g] = _mm512_unpacklo_epi64(t0, t2);
+            v[1][g] = _mm512_unpackhi_epi64(t0, t2);
+            v[2][g] = _mm512_unpacklo_epi64(t1, t3);
+            v[3][g] = _mm512_unpackhi_epi64(t1, t3);
+        }
+        for (int k = 0; k < 4; k++) {
+            __m512i p0 = _mm512_shuffle_i32x4(v[k][0], v[k][1], _MM_SHUFFLE(1, 0, 1, 0));
+            __m512i p1 = _mm512_shuffle_i32x4(v[k][0], v[k][1], _MM_SHUFFLE(3, 2, 3, 2));
+            __m512i p2 = _mm512_shuffle_i32x4(v[k][2], v[k][3], _MM_SHUFFLE(1, 0, 1, 0));
+            __m512i p3 = _mm512_shuffle_i32x4(v[k][2], v[k][3], _MM_SHUFFLE(3, 2, 3, 2));
+            __m512i out[4] = {
+                _mm512_shuffle_i32x4(p0, p2, _MM_SHUFFLE(2, 0, 2, 0)),
+                _mm512_shuffle_i32x4(p0, p2, _MM_SHUFFLE(3, 1, 3, 1)),
+                _mm512_shuffle_i32x4(p1, p3, _MM_SHUFFLE(2, 0, 2, 0)),
+                _mm512_shuffle_i32x4(p1, p3, _MM_SHUFFLE(3, 1, 3, 1)),
+            };
+            for (int lane = 0; lane < 4; lane++) {
+                uint8_t *block = data + (4 * lane + k) * CHACHA20_BLOCK_LENGTH;
+                _mm512_storeu_si512(block, _mm512_xor_si512(out[lane], _mm512_loadu_si512(block)));
+            }
+        }
+    }
+    chachaAVX2(state, counter, data, blocks);
+}
+
+#pragma GCC diagnostic pop
+
+const std::vector<ChaChaKernel> &availableChaChaKernels() {
+    static const std::vector<ChaChaKernel> kernels = [] {
+        std::vector<ChaChaKernel> list;
+        __builtin_cpu_init();
+        list.push_back({"scalar", chachaScalar});
+        if (__builtin_cpu_supports("avx2")) list.push_back({"avx2", chachaAVX2});
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512f")) {
+            list.push_back({"avx512", chachaAVX512});
+        }
+        return list;
+    }();
+    return kernels;
+}
+
+ChaCha20::ChaCha20(const uint8_t key[CHACHA20_KEY_LENGTH], const uint8_t nonce[CHACHA20_NONCE_LENGTH],
+                   const ChaChaKernel &kernel)
+    : CounterModeCipher(CHACHA20_BLOCK_LENGTH), kernel(kernel) {
+    // "expand 32-byte k"
+    state[0] = 0x61707865;
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) state[4 + i] = load32(key + 4 * i);
+    state[12] = 0;
+    state[13] = 0;
+    state[14] = load32(nonce);
+    state[15] = load32(nonce + 4);
+}
+
+void ChaCha20::xorBlocks(uint64_t counter, uint8_t *data, size_t blocks) const {
+    kernel.fn(state, counter, data, blocks);
+}
@@ -0,0 +1,44 @@
+#ifndef CHACHA20_HPP
+#define CHACHA20_HPP
+
+#include "Cipher.hpp"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+const size_t CHACHA20_KEY_LENGTH = 32;
+const size_t CHACHA20_NONCE_LENGTH = 8;
+const size_t CHACHA20_BLOCK_LENGTH = 64;
+
+// XOR blocks key stream blocks, starting at block counter, into data. state holds the
+// constants, key and nonce; the kernel fills in the counter words 12 and 13.
+using ChaChaKernelFn = void (*)(const uint32_t state[16], uint64_t counter, uint8_t *data, size_t blocks);
+
+struct ChaChaKernel {
+    const char *name;
+    ChaChaKernelFn fn;
+};
+
+// Every kernel the current CPU can run: scalar, then AVX2 (8 blocks per pass) and
+// AVX-512 (16 blocks per pass), each finishing its tail with the narrower ones
+const std::vector<ChaChaKernel> &availableChaChaKernels();
+
+// ChaCha20 with the original 64-bit block counter and 64-bit nonce, so a single key
+// and nonce cover 2^70 bytes and the counter of any offset is offset / 64
+class ChaCha20 : public CounterModeCipher {
+    public:
+        ChaCha20(const uint8_t key[CHACHA20_KEY_LENGTH], const uint8_t nonce[CHACHA20_NONCE_LENGTH],
+                 const ChaChaKernel &kernel = availableChaChaKernels().back());
+
+        const char *name() const override { return "chacha20"; }
+        const char *implementation() const override { return kernel.name; }
+
+    protected:
+        void xorBlocks(uint64_t counter, uint8_t *data, size_t blocks) const override;
+
+    private:
+        uint32_t state[16];
+        ChaChaKernel kernel;
+};
+
+#endif
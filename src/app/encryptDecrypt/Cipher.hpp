@@ -0,0 +1,71 @@
+#ifndef CIPHER_HPP
+#define CIPHER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+// A seekable stream cipher. The key stream at any byte depends only on its offset,
+// so encrypting and decrypting are the same XOR, and the ranges of a file can be
+// transformed in any order by any worker, which chunking and stealing rely on.
+class Cipher {
+    public:
+        virtual ~Cipher() = default;
+
+        virtual const char *name() const = 0;
+        // The kernel picked for this CPU, e.g. "avx512" or "aesni"
+        virtual const char *implementation() const = 0;
+
+        // XOR the key stream into len bytes that sit at offset in the file (or stream)
+        virtual void apply(uint8_t *data, size_t len, uint64_t offset) const = 0;
+};
+
+// Counter-mode ciphers: block i of the key stream is the block function of counter i.
+// apply() hands whole blocks to the kernel and runs a partial first or last block
+// through a zeroed scratch block.
+class CounterModeCipher : public Cipher {
+    public:
+        void apply(uint8_t *data, size_t len, uint64_t offset) const override;
+
+    protected:
+        explicit CounterModeCipher(size_t blockLength) : blockLength(blockLength) {}
+
+        // XOR blocks whole key stream blocks, starting at counter, into data
+        virtual void xorBlocks(uint64_t counter, uint8_t *data, size_t blocks) const = 0;
+
+    private:
+        size_t blockLength;
+};
+
+// Ciphers --cipher accepts: "xor" (the original repeating pad, the default, so older
+// outputs still decrypt), "chacha20" and "aes-256-ctr"
+const std::vector<std::string> &cipherNames();
+bool isCipherName(const std::string &name);
+
+// Implementations of a cipher the current CPU can run, portable first and widest last
+std::vector<std::string> cipherImplementations(const std::string &name);
+
+// The cipher keyed from secret (the key from .env): chacha20 and aes-256-ctr take their
+// key and nonce from HKDF-SHA256 over it. An empty implementation picks the widest.
+std::unique_ptr<Cipher> createCipher(const std::string &name, const std::string &secret,
+                                     const std::string &implementation = "");
+
+// chacha20 or aes-256-ctr under a raw 32-byte key and a nonce of CHACHA20_NONCE_LENGTH
+// or AES_BLOCK_LENGTH bytes, for keys derived elsewhere (per-file container keys)
+std::unique_ptr<Cipher> createKeyedCipher(const std::string &name, const uint8_t *key, const uint8_t *nonce,
+                                          const std::string &implementation = "");
+
+// The cipher of the run (--cipher). Set before the key material is loaded, so the
+// workers inherit it; encrypting and decrypting must use the same one.
+const std::string &runCipher();
+void setRunCipher(const std::string &name);
+
+// Known-answer tests for SHA-256, HKDF, Poly1305, LZ4 and every cipher and implementation,
+// and the key stream at odd offsets and lengths against one pass from the start.
+// Prints a line per check.
+bool runCipherSelfTest(std::ostream &out);
+
+#endif
@@ -0,0 +1,727 @@
+#include "Container.hpp"
+#include "Cryption.hpp"
+#include "KeyMaterial.hpp"
+#include "ChaCha20.hpp"
+#include "AesCtr.hpp"
+#include "Sha256.hpp"
+#include "Lz4.hpp"
+#include "../fileHandling/BufferPool.hpp"
+#include "../processes/Trace.hpp"
+#include "../processes/Journal.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/random.h>
+
+static const char CONTAINER_MAGIC[] = "CRYPTION";
+static const char INDEX_MAGIC[] = "CRYINDEX";
+static const size_t MAGIC_LENGTH = 8;
+static const size_t HEADER_TAG_OFFSET = CONTAINER_HEADER_SIZE - POLY1305_TAG_LENGTH;
+static const size_t INDEX_ENTRY_LENGTH = 16;
+static const size_t MIN_CHUNK_SIZE = 4096;
+
+// Blocks of the MAC stream: chunk j uses block j, the header and the index these two,
+// which no container of MIN_CHUNK_SIZE chunks reaches
+static const uint64_t HEADER_KEY_BLOCK = 1ULL << 52;
+static const uint64_t INDEX_KEY_BLOCK = HEADER_KEY_BLOCK + 1;
+
+// Cipher ids of the header; the xor pad has none, it is not seekable per file key
+struct ContainerCipher {
+    uint8_t id;
+    const char *name;
+};
+
+static const ContainerCipher CONTAINER_CIPHERS[] = {
+    {1, "chacha20"},
+    {2, "aes-256-ctr"},
+};
+
+static bool containerOutput = false;
+
+bool containerFormat() {
+    return containerOutput;
+}
+
+static void randomBytes(uint8_t *data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = getrandom(data + done, length - done, 0);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) {
+            perror("getrandom failed");
+            throw std::runtime_error("Failed to generate a container salt");
+        }
+        done += n;
+    }
+}
+
+// Tells the part files of this run from those an earlier run left (see claimPart)
+static uint8_t runId[16];
+
+void setContainerFormat(bool container) {
+    containerOutput = container;
+    randomBytes(runId, sizeof(runId));
+}
+
+static bool compressedOutput = false;
+
+bool compressContainers() {
+    return compressedOutput;
+}
+
+void setCompressContainers(bool compress) {
+    compressedOutput = compress;
+}
+
+// Integers are stored little-endian, the byte order of every host the kernels run on
+template <typename T>
+static void put(uint8_t *at, T value) {
+    memcpy(at, &value, sizeof(value));
+}
+
+template <typename T>
+static T get(const uint8_t *at) {
+    T value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+// Derived once per process, every container task compares against it
+static const uint8_t *keyId() {
+    static const std::vector<uint8_t> id =
+        hkdfSha256(KeyMaterial::get().masterKey(), {}, "cryption key id", CONTAINER_KEY_ID_LENGTH);
+    return id.data();
+}
+
+Container::Container(const std::string &cipher, const struct stat &source, uint8_t codec)
+    : cipherId(0), codec(codec), chunk(CONTAINER_CHUNK_SIZE), plaintext(source.st_size) {
+    for (const ContainerCipher &known : CONTAINER_CIPHERS) {
+        if (cipher == known.name) cipherId = known.id;
+    }
+    if (cipherId == 0) {
+        throw std::runtime_error("Containers need chacha20 or aes-256-ctr, not " + cipher);
+    }
+    // Random, never derived from the file: a file edited in place keeping its size, mtime
+    // and inode must not get the key stream it was encrypted with before
+    randomBytes(salt, sizeof(salt));
+    deriveKeys();
+}
+
+Container::Container(const uint8_t header[CONTAINER_HEADER_SIZE]) : cipherId(header[10]), codec(header[11]) {
+    if (memcmp(header, CONTAINER_MAGIC, MAGIC_LENGTH) != 0) {
+        throw std::runtime_error("not a cryption container");
+    }
+    uint16_t version = get<uint16_t>(header + 8);
+    if (version != CONTAINER_VERSION) {
+        throw std::runtime_error("unsupported container version " + std::to_string(version));
+    }
+    if (cipherName() == nullptr) {
+        throw std::runtime_error("unknown container cipher id " + std::to_string(cipherId));
+    }
+    if (codec != CONTAINER_CODEC_NONE && codec != CONTAINER_CODEC_LZ4) {
+        throw std::runtime_error("unknown container codec " + std::to_string(codec));
+    }
+    chunk = get<uint32_t>(header + 12);
+    plaintext = get<uint64_t>(header + 16);
+    if (chunk < MIN_CHUNK_SIZE || chunk > CONTAINER_MAX_CHUNK_SIZE || chunks() >= HEADER_KEY_BLOCK) {
+        throw std::runtime_error("invalid container chunk size " + std::to_string(chunk));
+    }
+    if (memcmp(header + 40, keyId(), CONTAINER_KEY_ID_LENGTH) != 0) {
+        throw std::runtime_error("encrypted with a different key");
+    }
+    memcpy(salt, header + 24, CONTAINER_SALT_LENGTH);
+    deriveKeys();
+
+    uint8_t expected[CONTAINER_HEADER_SIZE];
+    encodeHeader(expected);
+    if (!tagsEqual(expected + HEADER_TAG_OFFSET, header + HEADER_TAG_OFFSET)) {
+        throw std::runtime_error("container header failed authentication");
+    }
+}
+
+// The file's cipher key and nonce and the MAC stream's key, from the master key and salt
+void Container::deriveKeys() {
+    TRACE_SCOPE("derive keys");
+    const char *name = cipherName();
+    if (name == nullptr) {
+        throw std::runtime_error("unknown container cipher id " + std::to_string(cipherId));
+    }
+    char info[64];
+    snprintf(info, sizeof(info), "cryption container v1 %s", name);
+    const std::vector<uint8_t> &master = KeyMaterial::get().masterKey();
+    uint8_t okm[32 + AES_BLOCK_LENGTH + 32];
+    hkdfSha256(master.data(), master.size(), salt, sizeof(salt), info, okm, sizeof(okm));
+    stream = createKeyedCipher(name, okm, okm + 32);
+    const uint8_t zeroNonce[CHACHA20_NONCE_LENGTH] = {};
+    macStream = createKeyedCipher("chacha20", okm + 32 + AES_BLOCK_LENGTH, zeroNonce);
+}
+
+const char *Container::cipherName() const {
+    for (const ContainerCipher &known : CONTAINER_CIPHERS) {
+        if (cipherId == known.id) return known.name;
+    }
+    return nullptr;
+}
+
+size_t Container::chunkLength(uint64_t index) const {
+    return static_cast<size_t>(std::min<uint64_t>(chunk, plaintext - index * chunk));
+}
+
+size_t Container::indexLength() const {
+    return MAGIC_LENGTH + 2 * sizeof(uint64_t) + chunks() * INDEX_ENTRY_LENGTH + POLY1305_TAG_LENGTH;
+}
+
+uint64_t Container::firstChunkFrom(uint64_t offset) const {
+    return std::min(chunks(), (offset + chunk - 1) / chunk);
+}
+
+uint64_t Container::firstRecordFrom(uint64_t offset) const {
+    if (offset <= CONTAINER_HEADER_SIZE) return 0;
+    size_t record = chunk + POLY1305_TAG_LENGTH;
+    return std::min(chunks(), (offset - CONTAINER_HEADER_SIZE + record - 1) / record);
+}
+
+void Container::tagOf(uint64_t block, const uint8_t *data, size_t length, const uint8_t *trailer,
+                      size_t trailerLength, uint8_t tag[POLY1305_TAG_LENGTH]) const {
+    uint8_t key[POLY1305_KEY_LENGTH] = {};
+    macStream->apply(key, sizeof(key), block * CHACHA20_BLOCK_LENGTH);
+    Poly1305 mac(key);
+    mac.update(data, length);
+    if (trailerLength > 0) mac.update(trailer, trailerLength);
+    mac.finish(tag);
+}
+
+void Container::encodeHeader(uint8_t header[CONTAINER_HEADER_SIZE]) const {
+    memcpy(header, CONTAINER_MAGIC, MAGIC_LENGTH);
+    put<uint16_t>(header + 8, CONTAINER_VERSION);
+    header[10] = cipherId;
+    header[11] = codec;
+    put<uint32_t>(header + 12, static_cast<uint32_t>(chunk));
+    put<uint64_t>(header + 16, plaintext);
+    memcpy(header + 24, salt, CONTAINER_SALT_LENGTH);
+    memcpy(header + 40, keyId(), CONTAINER_KEY_ID_LENGTH);
+    tagOf(HEADER_KEY_BLOCK, header, HEADER_TAG_OFFSET, nullptr, 0, header + HEADER_TAG_OFFSET);
+}
+
+// The tag binds a chunk to its position and length, so chunks cannot be swapped or cut
+void Container::seal(uint64_t index, uint8_t *data, size_t length, uint8_t tag[POLY1305_TAG_LENGTH]) const {
+    TRACE_SCOPE("transform", "bytes", length);
+    stream->apply(data, length, index * chunk);
+    uint8_t trailer[2 * sizeof(uint64_t)];
+    put<uint64_t>(trailer, index);
+    put<uint64_t>(trailer + 8, length);
+    tagOf(index, data, length, trailer, sizeof(trailer), tag);
+}
+
+bool Container::open(uint64_t index, uint8_t *data, size_t length, const uint8_t tag[POLY1305_TAG_LENGTH]) const {
+    TRACE_SCOPE("transform", "bytes", length);
+    uint8_t trailer[2 * sizeof(uint64_t)];
+    put<uint64_t>(trailer, index);
+    put<uint64_t>(trailer + 8, length);
+    uint8_t expected[POLY1305_TAG_LENGTH];
+    tagOf(index, data, length, trailer, sizeof(trailer), expected);
+    if (!tagsEqual(expected, tag)) return false;
+    stream->apply(data, length, index * chunk);
+    return true;
+}
+
+size_t Container::sealRecord(uint64_t index, uint8_t *plain, uint8_t *record) const {
+    size_t length = chunkLength(index);
+    if (!compressed()) {
+        seal(index, record, length, record + length);
+        return length + POLY1305_TAG_LENGTH;
+    }
+    // Stored as is unless compressing saves something: a stored length equal to the
+    // chunk's means raw
+    uint8_t *stored = record + sizeof(uint32_t);
+    size_t storedLength = 0;
+    {
+        TRACE_SCOPE("compress", "bytes", length);
+        if (!looksIncompressible(plain, length)) {
+            storedLength = lz4Compress(plain, length, stored, length - 1);
+        }
+    }
+    if (storedLength == 0) {
+        memcpy(stored, plain, length);
+        storedLength = length;
+    }
+    put<uint32_t>(record, static_cast<uint32_t>(storedLength));
+    seal(index, stored, storedLength, stored + storedLength);
+    return sizeof(uint32_t) + storedLength + POLY1305_TAG_LENGTH;
+}
+
+std::vector<uint8_t> Container::encodeIndex() const {
+    std::vector<uint8_t> index(indexLength());
+    uint8_t *at = index.data();
+    memcpy(at, INDEX_MAGIC, MAGIC_LENGTH);
+    put<uint64_t>(at + 8, chunks());
+    put<uint64_t>(at + 16, plaintext);
+    at += MAGIC_LENGTH + 2 * sizeof(uint64_t);
+    for (uint64_t j = 0; j < chunks(); j++, at += INDEX_ENTRY_LENGTH) {
+        put<uint64_t>(at, recordOffset(j));
+        put<uint32_t>(at + 8, static_cast<uint32_t>(chunkLength(j) + recordOverhead()));
+        put<uint32_t>(at + 12, static_cast<uint32_t>(chunkLength(j)));
+    }
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    encodeHeader(header);
+    tagOf(INDEX_KEY_BLOCK, header, sizeof(header), index.data(), index.size() - POLY1305_TAG_LENGTH, at);
+    return index;
+}
+
+bool Container::checkIndex(const uint8_t *index, size_t length) const {
+    std::vector<uint8_t> expected = encodeIndex();
+    if (length != expected.size()) return false;
+    size_t body = length - POLY1305_TAG_LENGTH;
+    return memcmp(index, expected.data(), body) == 0 && tagsEqual(index + body, expected.data() + body);
+}
+
+static bool readFully(int fd, uint8_t *data, size_t length, uint64_t offset) {
+    TRACE_SCOPE("read", "bytes", length);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, data + done, length - done, offset + done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const uint8_t *data, size_t length, uint64_t offset, const std::string &path) {
+    TRACE_SCOPE("write", "bytes", length);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(fd, data + done, length - done, offset + done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) {
+            std::cerr << "Failed to write block of " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+// Read, check and decrypt (and decompress) chunk index; the plaintext is in record or
+// plain, nullptr after reporting a failure
+static const uint8_t *readRecord(int fd, const Container &container, uint64_t index, uint8_t *record,
+                                 uint8_t *plain, const std::string &path) {
+    size_t length = container.chunkLength(index);
+    uint64_t offset = container.recordOffset(index);
+    size_t storedLength = length;
+    if (container.compressed()) {
+        uint8_t prefix[sizeof(uint32_t)];
+        if (!readFully(fd, prefix, sizeof(prefix), offset)) {
+            std::cerr << "Failed to read chunk " << index << " of " << path << ": " << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        storedLength = get<uint32_t>(prefix);
+        offset += sizeof(prefix);
+        if (storedLength == 0 || storedLength > length) {
+            std::cerr << path + ": chunk " + std::to_string(index) + " failed authentication\n" << std::flush;
+            return nullptr;
+        }
+    }
+    if (!readFully(fd, record, storedLength + POLY1305_TAG_LENGTH, offset)) {
+        std::cerr << "Failed to read chunk " << index << " of " << path << ": " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    if (!container.open(index, record, storedLength, record + storedLength)) {
+        std::cerr << path + ": chunk " + std::to_string(index) + " failed authentication\n" << std::flush;
+        return nullptr;
+    }
+    if (storedLength == length) {
+        return record;
+    }
+    TRACE_SCOPE("decompress", "bytes", length);
+    if (!lz4Decompress(record, storedLength, plain, length)) {
+        std::cerr << path + ": chunk " + std::to_string(index) + " failed to decompress\n" << std::flush;
+        return nullptr;
+    }
+    return plain;
+}
+
+// Open the output of a container task (read-write: a part file's states are read back);
+// output left over from an earlier run is cut to the final size, which every task of the
+// file knows, so no task truncates another's writes
+static int openContainerOutput(const std::string &outputPath, unsigned mode, uint64_t finalSize) {
+    int out = openOutputFile(outputPath, O_RDWR | O_CREAT | O_CLOEXEC, mode);
+    struct stat outStat;
+    if (out == -1 || fstat(out, &outStat) == -1) {
+        std::cerr << "Unable to create the output file " << outputPath << ": " << strerror(errno) << std::endl;
+        if (out != -1) close(out);
+        return -1;
+    }
+    if (static_cast<uint64_t>(outStat.st_size) > finalSize && ftruncate(out, finalSize) == -1) {
+        perror("ftruncate output failed");
+    }
+    return out;
+}
+
+static int closeOutput(int out, int result) {
+    if (close(out) == -1) {
+        perror("close output failed");
+        return 1;
+    }
+    return result;
+}
+
+// A container task writes OUTPUT.cryption-part, renamed to OUTPUT only once every chunk
+// and the index went through (decrypting: passed authentication), so a failed file never
+// leaves a container or plaintext with holes behind. The tasks of one file share the part
+// file: past the final size it holds what the part file is made from (decrypting, the
+// container's header; encrypting, the source's identity), the id of the run writing it
+// and a state byte per chunk and one for the index, updated under flock(). The task that
+// settles the last state renames the part file, or removes it when any chunk failed.
+static const char *PART_SUFFIX = ".cryption-part";
+static const size_t PART_IDENTITY_LENGTH = 64;
+static_assert(PART_IDENTITY_LENGTH == CONTAINER_HEADER_SIZE, "a decrypting part file is identified by the header");
+static const uint8_t PART_PENDING = 0;
+static const uint8_t PART_DONE = 1;
+static const uint8_t PART_FAILED = 2;
+
+static uint64_t partStatesOffset(uint64_t finalSize) {
+    return finalSize + PART_IDENTITY_LENGTH + sizeof(runId);
+}
+
+static uint64_t partSize(uint64_t finalSize, size_t stateCount) {
+    return partStatesOffset(finalSize) + stateCount;
+}
+
+// The first task of a run to lock a part file takes it over. Made from something else it
+// starts from scratch (fresh); made from the same input by an earlier run, failed chunks
+// are retried and, in a journaled run (whose resume skips the chunks the journal has
+// done), chunks done then are kept. The caller holds the flock().
+static bool claimPart(int part, uint64_t finalSize, size_t stateCount, const uint8_t identity[PART_IDENTITY_LENGTH],
+                      const std::string &partPath, bool &fresh) {
+    uint8_t found[PART_IDENTITY_LENGTH + sizeof(runId)];
+    std::vector<uint8_t> states(stateCount, PART_PENDING);
+    bool same = readFully(part, found, sizeof(found), finalSize) && memcmp(found, identity, PART_IDENTITY_LENGTH) == 0;
+    fresh = false;
+    if (same && memcmp(found + PART_IDENTITY_LENGTH, runId, sizeof(runId)) == 0) {
+        return true;
+    }
+    bool ok = true;
+    if (same && Journal::current() != nullptr) {
+        ok = readFully(part, states.data(), states.size(), partStatesOffset(finalSize));
+        std::replace(states.begin(), states.end(), PART_FAILED, PART_PENDING);
+    } else {
+        fresh = true;
+    }
+    return ok && writeFully(part, identity, PART_IDENTITY_LENGTH, finalSize, partPath) &&
+           writeFully(part, runId, sizeof(runId), finalSize + PART_IDENTITY_LENGTH, partPath) &&
+           writeFully(part, states.data(), states.size(), partStatesOffset(finalSize), partPath);
+}
+
+// Settle this task's chunks [first, last) (and the index when it wrote or checked it) as
+// done or failed; the last task of the file to settle publishes or removes the output
+static int settlePart(int part, uint64_t finalSize, size_t stateCount, uint64_t first, uint64_t last, bool ownsIndex,
+                      int result, const std::string &partPath, const std::string &outputPath) {
+    uint8_t state = result == 0 ? PART_DONE : PART_FAILED;
+    std::vector<uint8_t> states(stateCount);
+    uint64_t statesOffset = partStatesOffset(finalSize);
+    flock(part, LOCK_EX);
+    // Published already: chunks kept from an earlier run completed it, and this task
+    // wrote the same bytes again
+    struct stat st;
+    if (fstat(part, &st) == 0 && static_cast<uint64_t>(st.st_size) < partSize(finalSize, stateCount)) {
+        flock(part, LOCK_UN);
+        return result;
+    }
+    std::fill(states.begin() + first, states.begin() + last, state);
+    bool ok = (first == last || writeFully(part, states.data() + first, last - first, statesOffset + first, partPath)) &&
+              (!ownsIndex || writeFully(part, &state, 1, statesOffset + stateCount - 1, partPath)) &&
+              readFully(part, states.data(), states.size(), statesOffset);
+    if (!ok) {
+        result = 1;
+    } else if (std::find(states.begin(), states.end(), PART_PENDING) == states.end()) {
+        if (std::find(states.begin(), states.end(), PART_FAILED) != states.end()) {
+            unlink(partPath.c_str());
+            std::cerr << "Removed the partial output " + partPath + "\n" << std::flush;
+        } else if (ftruncate(part, finalSize) == -1 || rename(partPath.c_str(), outputPath.c_str()) == -1) {
+            std::cerr << "Failed to publish " << outputPath << ": " << strerror(errno) << std::endl;
+            result = 1;
+        }
+    }
+    flock(part, LOCK_UN);
+    return result;
+}
+
+// What an encrypting part file is made from: the source file as it was stat()ed and the
+// salt-free fields of the header (cipher, codec, chunk size and plaintext size). A source
+// changed since the part file was started gets a new salt and starts over.
+static void sourceIdentity(const struct stat &source, const Container &container, uint8_t identity[PART_IDENTITY_LENGTH]) {
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    container.encodeHeader(header);
+    memset(identity, 0, PART_IDENTITY_LENGTH);
+    put<uint64_t>(identity, source.st_mtim.tv_sec);
+    put<uint64_t>(identity + 8, source.st_mtim.tv_nsec);
+    put<uint64_t>(identity + 16, source.st_ino);
+    put<uint64_t>(identity + 24, source.st_dev);
+    memcpy(identity + 32, header + MAGIC_LENGTH, 16);
+}
+
+int encryptToContainer(const char *sourcePath, const std::string &outputPath, size_t offset, size_t length,
+                       size_t *bytesDone) {
+    int in;
+    {
+        TRACE_SCOPE("open");
+        in = open(sourcePath, O_RDONLY | O_CLOEXEC);
+    }
+    struct stat st;
+    if (in == -1 || fstat(in, &st) == -1) {
+        std::cout << "Unable to open the file: " << sourcePath << std::endl;
+        if (in != -1) close(in);
+        return 1;
+    }
+    std::unique_ptr<Container> created(
+        new Container(runCipher(), st, compressContainers() ? CONTAINER_CODEC_LZ4 : CONTAINER_CODEC_NONE));
+    size_t fileSize = st.st_size;
+    size_t end = length == 0 ? fileSize : std::min(fileSize, offset + length);
+    uint64_t finalSize = created->containerSize();
+    size_t stateCount = created->chunks() + 1;
+    std::string partPath = outputPath + PART_SUFFIX;
+    int out = openContainerOutput(partPath, st.st_mode & 0777, partSize(finalSize, stateCount));
+    if (out == -1) {
+        close(in);
+        return 1;
+    }
+
+    // Every task of the file seals with the salt of the task that claimed the part file
+    // first, which wrote it in the header
+    uint8_t identity[PART_IDENTITY_LENGTH];
+    sourceIdentity(st, *created, identity);
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    bool fresh;
+    flock(out, LOCK_EX);
+    bool claimed = claimPart(out, finalSize, stateCount, identity, partPath, fresh);
+    if (claimed && fresh) {
+        created->encodeHeader(header);
+        claimed = writeFully(out, header, sizeof(header), 0, partPath);
+    } else if (claimed) {
+        try {
+            claimed = readFully(out, header, sizeof(header), 0);
+            if (claimed) created.reset(new Container(header));
+        } catch (const std::runtime_error &e) {
+            std::cerr << partPath + ": " + e.what() + "\n" << std::flush;
+            claimed = false;
+        }
+    }
+    flock(out, LOCK_UN);
+    if (!claimed) {
+        close(in);
+        close(out);
+        return 1;
+    }
+    const Container &container = *created;
+
+    // This task seals the chunks that start in its range
+    uint64_t first = container.firstChunkFrom(offset);
+    uint64_t last = offset < end ? container.firstChunkFrom(end) : first;
+    // Compressed slots are left sparse: only what is stored gets blocks
+    if (first < last && !container.compressed()) {
+        uint64_t from = container.recordOffset(first);
+        uint64_t to = container.recordOffset(last - 1) + container.chunkLength(last - 1) + POLY1305_TAG_LENGTH;
+        if (fallocate(out, 0, from, to - from) == -1 && errno != EOPNOTSUPP) {
+            std::cerr << "Failed to preallocate " << outputPath << ": " << strerror(errno) << std::endl;
+        }
+    }
+
+    int result = 0;
+    // From the worker's buffer pool, so only a worker's first container task maps them
+    PooledBuffer recordBuffer(container.chunkSize() + container.recordOverhead());
+    PooledBuffer plainBuffer(container.compressed() ? container.chunkSize() : 0);
+    uint8_t *record = recordBuffer.get();
+    uint8_t *plain = container.compressed() ? plainBuffer.get() : record;
+    for (uint64_t j = first; j < last && result == 0; j++) {
+        size_t chunkLength = container.chunkLength(j);
+        uint64_t position = j * container.chunkSize();
+        if (!readFully(in, plain, chunkLength, position)) {
+            std::cerr << "Failed to read chunk " << j << " of " << sourcePath << ": " << strerror(errno) << std::endl;
+            result = 1;
+            break;
+        }
+        if (j + 1 < last) {
+            posix_fadvise(in, position + chunkLength, container.chunkLength(j + 1), POSIX_FADV_WILLNEED);
+        }
+        size_t recordLength = container.sealRecord(j, plain, record);
+        if (!writeFully(out, record, recordLength, container.recordOffset(j), partPath)) {
+            result = 1;
+        }
+    }
+    // The index goes with the last chunk (or the header of an empty file)
+    bool ownsIndex = container.chunks() == 0 ? offset == 0 : last == container.chunks() && first < last;
+    if (result == 0 && ownsIndex) {
+        std::vector<uint8_t> index = container.encodeIndex();
+        if (!writeFully(out, index.data(), index.size(), container.indexOffset(), partPath)) result = 1;
+    }
+    if (bytesDone != nullptr && offset < end) {
+        *bytesDone += end - offset;
+    }
+    close(in);
+    result = settlePart(out, finalSize, stateCount, first, last, ownsIndex, result, partPath, outputPath);
+    return closeOutput(out, result);
+}
+
+int decryptContainer(const char *sourcePath, const std::string &outputPath, size_t offset, size_t length,
+                     size_t *bytesDone) {
+    int in;
+    {
+        TRACE_SCOPE("open");
+        in = open(sourcePath, O_RDONLY | O_CLOEXEC);
+    }
+    struct stat st;
+    if (in == -1 || fstat(in, &st) == -1) {
+        std::cout << "Unable to open the file: " << sourcePath << std::endl;
+        if (in != -1) close(in);
+        return 1;
+    }
+    // Every task checks the header and the size, so a forged or cut file fails as a whole
+    std::unique_ptr<Container> container;
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    try {
+        if (!readFully(in, header, sizeof(header), 0)) {
+            throw std::runtime_error("not a cryption container");
+        }
+        container.reset(new Container(header));
+        if (static_cast<uint64_t>(st.st_size) != container->containerSize()) {
+            throw std::runtime_error("truncated or extended: " + std::to_string(st.st_size) + " bytes, expected " +
+                                     std::to_string(container->containerSize()));
+        }
+    } catch (const std::runtime_error &e) {
+        // One write, so lines of workers failing on the same file do not interleave
+        std::cerr << std::string(sourcePath) + ": " + e.what() + "\n" << std::flush;
+        close(in);
+        return 1;
+    }
+    size_t fileSize = st.st_size;
+    size_t end = length == 0 ? fileSize : std::min(fileSize, offset + length);
+    uint64_t finalSize = container->plaintextSize();
+    size_t stateCount = container->chunks() + 1;
+    std::string partPath = outputPath + PART_SUFFIX;
+    int out = openContainerOutput(partPath, st.st_mode & 0777, partSize(finalSize, stateCount));
+    if (out == -1) {
+        close(in);
+        return 1;
+    }
+    bool fresh;
+    flock(out, LOCK_EX);
+    bool claimed = claimPart(out, finalSize, stateCount, header, partPath, fresh);
+    flock(out, LOCK_UN);
+    if (!claimed) {
+        close(in);
+        close(out);
+        return 1;
+    }
+
+    // This task opens the chunk records that start in its range
+    uint64_t first = container->firstRecordFrom(offset);
+    uint64_t last = offset < end ? container->firstRecordFrom(end) : first;
+    if (first < last) {
+        uint64_t from = first * container->chunkSize();
+        uint64_t to = (last - 1) * container->chunkSize() + container->chunkLength(last - 1);
+        if (fallocate(out, 0, from, to - from) == -1 && errno != EOPNOTSUPP) {
+            std::cerr << "Failed to preallocate " << outputPath << ": " << strerror(errno) << std::endl;
+        }
+    }
+
+    int result = 0;
+    PooledBuffer recordBuffer(container->chunkSize() + container->recordOverhead());
+    PooledBuffer plainBuffer(container->chunkSize());
+    uint8_t *record = recordBuffer.get();
+    uint8_t *plain = plainBuffer.get();
+    for (uint64_t j = first; j < last; j++) {
+        const uint8_t *data = readRecord(in, *container, j, record, plain, sourcePath);
+        if (data == nullptr ||
+            !writeFully(out, data, container->chunkLength(j), j * container->chunkSize(), partPath)) {
+            result = 1;
+            break;
+        }
+    }
+    uint64_t indexOffset = container->indexOffset();
+    bool ownsIndex = indexOffset >= offset && indexOffset < end;
+    if (result == 0 && ownsIndex) {
+        std::vector<uint8_t> index(container->indexLength());
+        if (!readFully(in, index.data(), index.size(), indexOffset) || !container->checkIndex(index.data(), index.size())) {
+            std::cerr << std::string(sourcePath) + ": index failed authentication\n" << std::flush;
+            result = 1;
+        }
+    }
+    if (bytesDone != nullptr && offset < end) {
+        *bytesDone += end - offset;
+    }
+    close(in);
+    result = settlePart(out, finalSize, stateCount, first, last, ownsIndex, result, partPath, outputPath);
+    return closeOutput(out, result);
+}
+
+ContainerReader::ContainerReader(const std::string &path)
+    : path(path), fd(-1), cachedData(nullptr), cached(NO_CHUNK), chunksDone(0) {
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1) close(fd);
+        throw std::runtime_error("Unable to open the file: " + path);
+    }
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    try {
+        if (!readFully(fd, header, sizeof(header), 0)) {
+            throw std::runtime_error("not a cryption container");
+        }
+        format.reset(new Container(header));
+        if (static_cast<uint64_t>(st.st_size) != format->containerSize()) {
+            throw std::runtime_error("truncated or extended: " + std::to_string(st.st_size) + " bytes, expected " +
+                                     std::to_string(format->containerSize()));
+        }
+    } catch (const std::runtime_error &e) {
+        close(fd);
+        throw std::runtime_error(path + ": " + e.what());
+    }
+    record.resize(format->chunkSize() + format->recordOverhead());
+    plain.resize(format->chunkSize());
+}
+
+ContainerReader::~ContainerReader() {
+    close(fd);
+}
+
+bool ContainerReader::read(uint64_t offset, size_t length, uint8_t *out, size_t *got) {
+    *got = 0;
+    if (offset >= size()) return true;
+    length = static_cast<size_t>(std::min<uint64_t>(length, size() - offset));
+    size_t chunkSize = format->chunkSize();
+    for (uint64_t j = offset / chunkSize; *got < length; j++) {
+        size_t chunkLength = format->chunkLength(j);
+        if (j != cached) {
+            cached = NO_CHUNK;
+            cachedData = readRecord(fd, *format, j, record.data(), plain.data(), path);
+            if (cachedData == nullptr) return false;
+            cached = j;
+            chunksDone++;
+        }
+        size_t from = offset + *got - j * chunkSize;
+        size_t n = std::min(chunkLength - from, length - *got);
+        memcpy(out + *got, cachedData + from, n);
+        *got += n;
+    }
+    return true;
+}
+
+uint64_t ContainerReader::storedSize() {
+    uint64_t stored = 0;
+    for (uint64_t j = 0; j < format->chunks(); j++) {
+        uint8_t prefix[sizeof(uint32_t)];
+        if (!format->compressed()) {
+            stored += format->chunkLength(j) + POLY1305_TAG_LENGTH;
+        } else if (readFully(fd, prefix, sizeof(prefix), format->recordOffset(j))) {
+            stored += sizeof(prefix) + get<uint32_t>(prefix) + POLY1305_TAG_LENGTH;
+        }
+    }
+    return stored;
+}
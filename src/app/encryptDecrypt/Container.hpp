@@ -0,0 +1,158 @@
+#ifndef CONTAINER_HPP
+#define CONTAINER_HPP
+
+#include "Cipher.hpp"
+#include "Poly1305.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <sys/stat.h>
+
+// The container format (--container): an authenticated, chunked output file that any
+// worker can write or read a range of.
+//
+//   header   64 bytes: "CRYPTION", u16 version, u8 cipher id, u8 codec, u32 chunk size,
+//            u64 plaintext size, salt[16], key id[8], Poly1305 tag of the 48 bytes before it
+//   chunks   chunk j in a record slot at CONTAINER_HEADER_SIZE + j * (chunk size + overhead):
+//            its ciphertext (chunk size bytes, fewer for the last) and the Poly1305 tag of
+//            the ciphertext, le64 j and le64 the ciphertext length
+//   index    "CRYINDEX", u64 chunk count, u64 plaintext size, per chunk {u64 slot offset,
+//            u32 slot length, u32 plaintext length}, and the tag of the header and index
+//
+// With the lz4 codec (--compress) a slot starts with the le32 length of what is stored:
+// the chunk compressed, or as is when that is not smaller. Slots keep their full size, so
+// every worker still knows where each chunk goes; the rest of a slot is never written and
+// stays a hole on file systems with sparse files.
+//
+// Integers are little-endian. Every file has its own keys, from HKDF over the master key
+// and its random salt: the cipher key and nonce, and a ChaCha20 stream whose block j is the
+// Poly1305 key of chunk j (the header and the index use blocks far above any chunk).
+// Chunk j is key stream bytes [j * chunk size, ...), so a chunk is decrypted on its own.
+const size_t CONTAINER_HEADER_SIZE = 64;
+const size_t CONTAINER_CHUNK_SIZE = 1 << 20;
+const size_t CONTAINER_MAX_CHUNK_SIZE = 64 << 20;
+const size_t CONTAINER_SALT_LENGTH = 16;
+const size_t CONTAINER_KEY_ID_LENGTH = 8;
+const uint16_t CONTAINER_VERSION = 1;
+const uint8_t CONTAINER_CODEC_NONE = 0;
+const uint8_t CONTAINER_CODEC_LZ4 = 1;
+
+// Whether out-of-place tasks write (encrypt) and read (decrypt) containers (--container).
+// Set before the workers are created so they inherit it.
+bool containerFormat();
+void setContainerFormat(bool container);
+
+// Whether containers are written with the lz4 codec (--compress); reading takes the codec
+// from the header. Set before the workers are created so they inherit it.
+bool compressContainers();
+void setCompressContainers(bool compress);
+
+// The keys, layout and tags of one container
+class Container {
+    public:
+        // A new container for a source file, with a random salt: every encryption of a file
+        // gets its own keys. The tasks of one file share the salt through the header of
+        // the output they write.
+        Container(const std::string &cipher, const struct stat &source, uint8_t codec = CONTAINER_CODEC_NONE);
+        // An existing container from its header; throws std::runtime_error when it is not
+        // one, was made with another key or fails authentication
+        explicit Container(const uint8_t header[CONTAINER_HEADER_SIZE]);
+
+        const char *cipherName() const;
+        const char *codecName() const { return codec == CONTAINER_CODEC_LZ4 ? "lz4" : "none"; }
+        bool compressed() const { return codec != CONTAINER_CODEC_NONE; }
+        const Cipher &cipher() const { return *stream; }
+        size_t chunkSize() const { return chunk; }
+        uint64_t plaintextSize() const { return plaintext; }
+
+        uint64_t chunks() const { return (plaintext + chunk - 1) / chunk; }
+        // Bytes a slot holds besides the chunk: the tag, and the stored length when compressed
+        size_t recordOverhead() const { return POLY1305_TAG_LENGTH + (compressed() ? sizeof(uint32_t) : 0); }
+        uint64_t recordOffset(uint64_t index) const { return CONTAINER_HEADER_SIZE + index * (chunk + recordOverhead()); }
+        size_t chunkLength(uint64_t index) const;
+        uint64_t indexOffset() const { return CONTAINER_HEADER_SIZE + plaintext + chunks() * recordOverhead(); }
+        size_t indexLength() const;
+        uint64_t containerSize() const { return indexOffset() + indexLength(); }
+
+        // First chunk whose plaintext (or record) starts at or after offset
+        uint64_t firstChunkFrom(uint64_t offset) const;
+        uint64_t firstRecordFrom(uint64_t offset) const;
+
+        void encodeHeader(uint8_t header[CONTAINER_HEADER_SIZE]) const;
+
+        // Encrypt chunk index in place and write its tag, or check its tag and decrypt it
+        // in place; nothing is decrypted when the tag does not match. length is what is
+        // stored, which a compressed chunk may have less of than its plaintext.
+        void seal(uint64_t index, uint8_t *data, size_t length, uint8_t tag[POLY1305_TAG_LENGTH]) const;
+        bool open(uint64_t index, uint8_t *data, size_t length, const uint8_t tag[POLY1305_TAG_LENGTH]) const;
+
+        // The record of chunk index from its plaintext, ready to write at recordOffset();
+        // returns its length. Without a codec plain must be record (sealed in place).
+        size_t sealRecord(uint64_t index, uint8_t *plain, uint8_t *record) const;
+
+        std::vector<uint8_t> encodeIndex() const;
+        bool checkIndex(const uint8_t *index, size_t length) const;
+
+    private:
+        void deriveKeys();
+        void tagOf(uint64_t block, const uint8_t *data, size_t length, const uint8_t *trailer, size_t trailerLength,
+                   uint8_t tag[POLY1305_TAG_LENGTH]) const;
+
+        uint8_t cipherId;
+        uint8_t codec;
+        size_t chunk;
+        uint64_t plaintext;
+        uint8_t salt[CONTAINER_SALT_LENGTH];
+        std::unique_ptr<Cipher> stream;
+        std::unique_ptr<Cipher> macStream;
+};
+
+// Random access to a container: read() decrypts only the chunks a range touches,
+// checking each one's tag, and keeps the last one for a read that continues in it. The constructor throws std::runtime_error when the file
+// cannot be opened, is not a container of this key, or has been truncated or extended.
+class ContainerReader {
+    public:
+        explicit ContainerReader(const std::string &path);
+        ~ContainerReader();
+        ContainerReader(const ContainerReader &) = delete;
+        ContainerReader &operator=(const ContainerReader &) = delete;
+
+        const Container &container() const { return *format; }
+        uint64_t size() const { return format->plaintextSize(); }
+        // Bytes the chunk records take, read from the slots of a compressed container
+        uint64_t storedSize();
+
+        // Plaintext [offset, offset + length) into out, clipped to the end; false when a chunk
+        // cannot be read or fails authentication
+        bool read(uint64_t offset, size_t length, uint8_t *out, size_t *got);
+
+        size_t chunksRead() const { return chunksDone; }
+
+    private:
+        static const uint64_t NO_CHUNK = ~0ULL;
+
+        std::string path;
+        int fd;
+        std::unique_ptr<Container> format;
+        std::vector<uint8_t> record;
+        std::vector<uint8_t> plain;
+        const uint8_t *cachedData;
+        uint64_t cached; // The chunk cachedData holds decrypted, if any
+        size_t chunksDone;
+};
+
+// The container side of an out-of-place task. Encrypting, [offset, offset + length) is a
+// range of the source (length 0: to the end) and the task seals the chunks that start in
+// it; decrypting, it is a range of the container and the task opens the chunk records that
+// start in it. The first task of a file writes the header, the task whose range holds the
+// index writes or checks it. Output appears at outputPath only once all of the file's
+// chunks and its index went through (decrypting, passed authentication); when any failed,
+// nothing is left there.
+int encryptToContainer(const char *sourcePath, const std::string &outputPath, size_t offset, size_t length,
+                       size_t *bytesDone);
+int decryptContainer(const char *sourcePath, const std::string &outputPath, size_t offset, size_t length,
+                     size_t *bytesDone);
+
+#endif
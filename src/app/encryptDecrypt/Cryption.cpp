@@ -1,9 +1,26 @@
 #include "Cryption.hpp"
 #include "../processes/Task.hpp"
-#include "../fileHandling/ReadEnv.cpp"
+#include "../processes/TaskRecord.hpp"
+#include "../processes/Journal.hpp"
+#include "../processes/FailureLog.hpp"
+#include "../processes/Trace.hpp"
+#include "../fileHandling/IO.hpp"
+#include "../fileHandling/BufferPool.hpp"
+#include "KeyMaterial.hpp"
+#include "Container.hpp"
+#include <iostream>
+#include <stdexcept>
 #include <vector>
 #include <random>
 #include <ctime>
+#include <cstdlib>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 // A key derivation function that expands a seed into a robust key
 std::vector<uint8_t> deriveKey(const std::string& seed, size_t length) {
@@ -21,56 +38,383 @@ std::vector<uint8_t> deriveKey(const std::string& seed, size_t length) {
     return key;
 }
 
+static_assert(CRYPTION_BLOCK_SIZE <= JOURNAL_BLOCK_SIZE, "a buffered block is journaled as one block");
+
+// Buffered backend: large blocks from the worker's buffer pool, one pread and one
+// pwrite per block instead of a get/seekp/put round trip per byte. A chunk (ranged)
+// that ends early fails: the file was cut while its other chunks were being done.
+static int cryptBuffered(const char *filePath, size_t offset, size_t end, bool ranged, const KeyMaterial &key,
+                         size_t *bytesDone) {
+    int fd;
+    {
+        TRACE_SCOPE("open");
+        fd = open(filePath, O_RDWR | O_CLOEXEC);
+    }
+    if (fd == -1) {
+        std::cout << "Unable to open the file: " << filePath << std::endl;
+        return 1;
+    }
+
+    PooledBuffer buffer(CRYPTION_BLOCK_SIZE);
+    size_t position = offset;  // Track position for key stream indexing
+    int result = 0;
+    while (position < end) {
+        size_t want = std::min(CRYPTION_BLOCK_SIZE, end - position);
+        ssize_t bytesRead;
+        {
+            TRACE_SCOPE("read", "bytes", want);
+            bytesRead = pread(fd, buffer.get(), want, position);
+        }
+        if (bytesRead == -1 && errno == EINTR) continue;
+        if (bytesRead <= 0) {
+            if (bytesRead == -1) {
+                std::cerr << "Failed to read block of " << filePath << ": " << strerror(errno) << std::endl;
+            } else if (ranged) {
+                std::cerr << "Unexpected end of " << filePath << " at byte " << position << std::endl;
+            }
+            result = bytesRead == 0 && !ranged ? 0 : 1;
+            break;
+        }
+
+        if (JournalSlot *journal = Journal::current()) {
+            journal->beginBlock(position, buffer.get(), bytesRead);
+        }
+        {
+            TRACE_SCOPE("transform", "bytes", bytesRead);
+            key.apply(buffer.get(), bytesRead, position);
+        }
+
+        TRACE_SCOPE("write", "bytes", bytesRead);
+        ssize_t written = 0;
+        while (written < bytesRead) {
+            ssize_t n = pwrite(fd, buffer.get() + written, bytesRead - written, position + written);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) break;
+            written += n;
+        }
+        if (written != bytesRead) {
+            std::cerr << "Failed to write back block of " << filePath << std::endl;
+            result = 1;
+            break;
+        }
+
+        position += bytesRead;
+    }
+    if (bytesDone != nullptr) {
+        *bytesDone += position - offset;
+    }
+
+    close(fd);
+    return result;
+}
+
+static bool mappedWriteSync = false;
+
+bool syncMappedWrites() {
+    return mappedWriteSync;
+}
+
+void setSyncMappedWrites(bool sync) {
+    mappedWriteSync = sync;
+}
+
+// Mapped backend: XOR the file's pages in place, no stream layer and no
+// extra copy through a user-space buffer. A journaled run steps through each
+// window one journal block at a time.
+static int cryptMapped(const char *filePath, size_t offset, size_t end, const KeyMaterial &key) {
+    MappedIO mapped(filePath);
+    if (!mapped.isOpen()) {
+        return 1;
+    }
+    JournalSlot *journal = Journal::current();
+    bool ok = mapped.forEachWindow(offset, end - offset, MMAP_WINDOW_SIZE, syncMappedWrites(),
+        [&key, journal](uint8_t *data, size_t length, size_t fileOffset) {
+            // Includes faulting the window's pages in, the mapped backend's read
+            TRACE_SCOPE("transform", "bytes", length);
+            if (journal == nullptr) {
+                key.apply(data, length, fileOffset);
+                return;
+            }
+            for (size_t done = 0; done < length; done += JOURNAL_BLOCK_SIZE) {
+                size_t block = std::min(JOURNAL_BLOCK_SIZE, length - done);
+                journal->beginBlock(fileOffset + done, data + done, block);
+                key.apply(data + done, block, fileOffset + done);
+            }
+        });
+    return ok ? 0 : 1;
+}
+
+// Transform the byte range [offset, offset + length) of a file in place (length 0: to the end).
+// Encryption and decryption are the same operation due to XOR properties.
+// The key stream is derived once per process (in the parent, before workers fork).
+static int cryptRange(const char *filePath, size_t offset, size_t length, size_t *bytesDone) {
+    const KeyMaterial &key = KeyMaterial::get();
+
+    // Large ranges go through the mapping, small ones are cheaper to read and write back
+    struct stat st;
+    if (stat(filePath, &st) == -1) {
+        std::cout << "Unable to open the file: " << filePath << std::endl;
+        return 1;
+    }
+    size_t fileSize = st.st_size;
+    size_t end = length == 0 ? fileSize : std::min(fileSize, offset + length);
+    if (offset >= end) {
+        return 0;
+    }
+    if (end - offset >= MMAP_THRESHOLD) {
+        int result = cryptMapped(filePath, offset, end, key);
+        if (bytesDone != nullptr && result == 0) {
+            *bytesDone += end - offset;
+        }
+        return result;
+    }
+    return cryptBuffered(filePath, offset, end, length != 0, key, bytesDone);
+}
+
+static bool directTransfers = false;
+
+bool directCopies() {
+    return directTransfers;
+}
+
+void setDirectCopies(bool direct) {
+    directTransfers = direct;
+}
+
+// The output path of a source file, built in a string each worker reuses
+static const std::string &outputPathFor(const char *outputRoot, const char *path, size_t sourcePrefix) {
+    thread_local std::string outputPath;
+    outputPath.assign(outputRoot);
+    outputPath += '/';
+    outputPath += path + std::min(sourcePrefix, strlen(path));
+    return outputPath;
+}
+
+// Start reading a file the worker is about to copy, so its pages arrive while the
+// current file is transformed and written
+static void prefetchFile(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+int openOutputFile(const std::string &outputPath, int flags, unsigned mode) {
+    TRACE_SCOPE("open output");
+    int out = open(outputPath.c_str(), flags, mode);
+    if (out == -1 && errno == ENOENT) {
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(outputPath).parent_path(), error);
+        out = open(outputPath.c_str(), flags, mode);
+    }
+    if (out == -1 && (flags & O_DIRECT) && errno == EINVAL) {
+        out = open(outputPath.c_str(), flags & ~O_DIRECT, mode);
+    }
+    return out;
+}
+
+static void dropDirect(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+}
+
+// Out-of-place backend: read [offset, offset + length) of the source and write the
+// transformed bytes at the same offsets of the output file, which is created (with its
+// directories) on first use and preallocated for the range. Ranges of one file can go
+// to different workers: none of them truncates below the source size.
+static int cryptCopy(const char *filePath, const std::string &outputPath, size_t offset, size_t length,
+                     size_t *bytesDone) {
+    bool direct = directCopies();
+    int in;
+    {
+        TRACE_SCOPE("open");
+        in = open(filePath, O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+        if (in == -1 && direct && errno == EINVAL) {
+            in = open(filePath, O_RDONLY | O_CLOEXEC); // No O_DIRECT on this file system
+        }
+    }
+    struct stat st;
+    if (in == -1 || fstat(in, &st) == -1) {
+        std::cout << "Unable to open the file: " << filePath << std::endl;
+        if (in != -1) close(in);
+        return 1;
+    }
+    size_t fileSize = st.st_size;
+    size_t end = length == 0 ? fileSize : std::min(fileSize, offset + length);
+
+    int out = openOutputFile(outputPath, O_WRONLY | O_CREAT | O_CLOEXEC | (direct ? O_DIRECT : 0), st.st_mode & 0777);
+    struct stat outStat;
+    if (out == -1 || fstat(out, &outStat) == -1) {
+        std::cerr << "Unable to create the output file " << outputPath << ": " << strerror(errno) << std::endl;
+        if (out != -1) close(out);
+        close(in);
+        return 1;
+    }
+    // Output left over from an earlier run may be longer than the source
+    if (static_cast<size_t>(outStat.st_size) > fileSize && ftruncate(out, fileSize) == -1) {
+        perror("ftruncate output failed");
+    }
+    if (offset < end) {
+        TRACE_SCOPE("preallocate", "bytes", end - offset);
+        if (fallocate(out, 0, offset, end - offset) == -1 && errno != EOPNOTSUPP) {
+            std::cerr << "Failed to preallocate " << outputPath << ": " << strerror(errno) << std::endl;
+        }
+    }
+    if (offset % DIRECT_IO_ALIGNMENT != 0) {
+        dropDirect(in); // A range of an unaligned chunk size
+        dropDirect(out);
+    }
+
+    // From the worker's pool: page-aligned, as O_DIRECT needs, and the same one every task
+    PooledBuffer pooled(COPY_BLOCK_SIZE);
+    uint8_t *buffer = pooled.get();
+    const KeyMaterial &key = KeyMaterial::get();
+    size_t position = offset;
+    int result = 0;
+    while (position < end) {
+        size_t want = std::min(COPY_BLOCK_SIZE, end - position);
+        if (want % DIRECT_IO_ALIGNMENT != 0) {
+            // The tail: O_DIRECT needs whole aligned blocks
+            dropDirect(in);
+            dropDirect(out);
+        }
+        ssize_t got;
+        {
+            TRACE_SCOPE("read", "bytes", want);
+            got = pread(in, buffer, want, position);
+        }
+        if (got == -1 && errno == EINTR) continue;
+        if (got <= 0) {
+            if (got == -1) std::cerr << "Failed to read block of " << filePath << ": " << strerror(errno) << std::endl;
+            result = got == 0 ? 0 : 1;
+            break;
+        }
+        // The next block is read ahead while this one is transformed and written
+        if (!direct && position + got < end) {
+            posix_fadvise(in, position + got, std::min(COPY_BLOCK_SIZE, end - position - got), POSIX_FADV_WILLNEED);
+        }
+
+        {
+            TRACE_SCOPE("transform", "bytes", got);
+            key.apply(buffer, got, position);
+        }
+
+        TRACE_SCOPE("write", "bytes", got);
+        size_t written = 0;
+        while (written < static_cast<size_t>(got)) {
+            ssize_t n = pwrite(out, buffer + written, got - written, position + written);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) break;
+            written += n;
+        }
+        if (written != static_cast<size_t>(got)) {
+            std::cerr << "Failed to write block of " << outputPath << ": " << strerror(errno) << std::endl;
+            result = 1;
+            break;
+        }
+        position += got;
+    }
+    if (bytesDone != nullptr) {
+        *bytesDone += position - offset;
+    }
+    close(in);
+    if (close(out) == -1) {
+        perror("close output failed");
+        result = 1;
+    }
+    return result;
+}
+
 int executeCryption(const std::string& taskData) {
     Task task = Task::fromString(taskData);
-    ReadEnv env;
-    std::string envKey = env.getenv();
-    
-    // Generate a key stream from the seed (envKey)
-    // We'll use a fixed length for the key stream, which will repeat for long files
-    const size_t KEY_LENGTH = 1024;  // Use a reasonably long key
-    std::vector<uint8_t> keyStream = deriveKey(envKey, KEY_LENGTH);
-    
-    // Process the file character by character (like in the first working version)
-    size_t position = 0;  // Track position for key stream indexing
-    
-    char ch;
-    if (task.action == Action::ENCRYPT) {
-        // Reset file pointer to beginning
-        task.f_stream.seekg(0, std::ios::beg);
-        
-        // Process byte by byte, just like the working version
-        while (task.f_stream.get(ch)) {
-            // XOR encryption using our derived key
-            ch = ch ^ keyStream[position % KEY_LENGTH];
-            
-            // Move write position back one character and write
-            task.f_stream.seekp(-1, std::ios::cur);
-            task.f_stream.put(ch);
-            
-            // Move to next position in the key stream
-            position++;
-        }
-    } else {  // Decryption
-        // Reset file pointer to beginning
-        task.f_stream.seekg(0, std::ios::beg);
-        
-        // Process byte by byte, just like the working version
-        while (task.f_stream.get(ch)) {
-            // XOR decryption (same operation as encryption due to XOR properties)
-            ch = ch ^ keyStream[position % KEY_LENGTH];
-            
-            // Move write position back one character and write
-            task.f_stream.seekp(-1, std::ios::cur);
-            task.f_stream.put(ch);
-            
-            // Move to next position in the key stream
-            position++;
+    return executeCryption(task);
+}
+
+// One file (range) of a task, in place or to its output path (a container of it, or the
+// file in one, with --container); next is the file the task handles after this one,
+// read ahead during an out-of-place copy.
+// In a journaled run the file is recorded done once it went through; a file that
+// did not is reported to the parent.
+static int cryptFile(JournalSlot *journal, uint32_t index, const char *path, Action action, const char *outputRoot,
+                     size_t sourcePrefix, size_t offset, size_t length, const char *next, size_t *bytesDone) {
+    TRACE_SCOPE("file");
+    if (journal != nullptr) {
+        journal->beginFile(index);
+    }
+    int result;
+    if (outputRoot == nullptr) {
+        result = cryptRange(path, offset, length, bytesDone);
+    } else {
+        if (next != nullptr && !directCopies()) {
+            prefetchFile(next);
+        }
+        const std::string &outputPath = outputPathFor(outputRoot, path, sourcePrefix);
+        if (!containerFormat()) {
+            result = cryptCopy(path, outputPath, offset, length, bytesDone);
+        } else if (action == Action::ENCRYPT) {
+            result = encryptToContainer(path, outputPath, offset, length, bytesDone);
+        } else {
+            result = decryptContainer(path, outputPath, offset, length, bytesDone);
         }
     }
-    
-    task.f_stream.close();
-    return 0;
+    if (journal != nullptr) {
+        journal->endFile(result == 0);
+    }
+    if (result != 0) {
+        FailureLog::record(path);
+    }
+    return result;
+}
+
+// A batch task runs its files one after the other; the result is the first failure, if any
+int executeCryption(const Task &task, size_t *bytesDone) {
+    const char *outputRoot = task.isOutOfPlace() ? task.outputRoot.c_str() : nullptr;
+    JournalSlot *journal = Journal::current();
+    if (journal != nullptr) {
+        // Reused, so a journaled task does not allocate its path list
+        thread_local std::vector<const char *> paths;
+        paths.assign(1, task.filePath.c_str());
+        for (const std::string &file : task.batchFiles) paths.push_back(file.c_str());
+        journal->beginTask(paths, task.offset, task.length, outputRoot != nullptr);
+    }
+    const char *next = task.batchFiles.empty() ? nullptr : task.batchFiles[0].c_str();
+    int result = cryptFile(journal, 0, task.filePath.c_str(), task.action, outputRoot, task.sourcePrefix, task.offset,
+                           task.length, next, bytesDone);
+    for (size_t i = 0; i < task.batchFiles.size(); i++) {
+        next = i + 1 < task.batchFiles.size() ? task.batchFiles[i + 1].c_str() : nullptr;
+        int fileResult = cryptFile(journal, i + 1, task.batchFiles[i].c_str(), task.action, outputRoot, task.sourcePrefix, 0, 0,
+                                   next, bytesDone);
+        if (result == 0) result = fileResult;
+    }
+    if (journal != nullptr) {
+        journal->endTask();
+    }
+    return result;
+}
+
+int executeCryption(const TaskRecord &record, size_t *bytesDone) {
+    JournalSlot *journal = Journal::current();
+    if (journal != nullptr) {
+        thread_local std::vector<const char *> paths;
+        paths.clear();
+        for (const char *path = record.path; paths.size() < record.fileCount; path = record.nextPath(path)) {
+            paths.push_back(path);
+        }
+        journal->beginTask(paths, record.offset, record.length, record.outputRoot() != nullptr);
+    }
+    const char *path = record.path;
+    int result = 0;
+    for (uint16_t i = 0; i < record.fileCount; i++) {
+        const char *next = i + 1 < record.fileCount ? record.nextPath(path) : nullptr;
+        // Only single-file records carry a range
+        int fileResult = cryptFile(journal, i, path, record.action, record.outputRoot(), record.sourcePrefix,
+                                   i == 0 ? record.offset : 0, i == 0 ? record.length : 0, next, bytesDone);
+        if (result == 0) result = fileResult;
+        path = next;
+    }
+    if (journal != nullptr) {
+        journal->endTask();
+    }
+    return result;
 }
 
 // #include "Cryption.hpp"
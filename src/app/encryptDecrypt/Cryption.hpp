@@ -2,7 +2,51 @@
 #define CRYPTION_HPP
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
 
+// Length of the xor cipher's repeating pad; byte i of a file is XORed with key[i % KEY_LENGTH]
+const size_t KEY_LENGTH = 1024;
+
+// Files are transformed in blocks of this size, read and written back in one call each
+const size_t CRYPTION_BLOCK_SIZE = 1 << 20;
+
+// Files at least this large are transformed through a memory mapping instead of
+// the buffered stream, a window of MMAP_WINDOW_SIZE bytes at a time
+const size_t MMAP_THRESHOLD = 16 << 20;
+const size_t MMAP_WINDOW_SIZE = 64 << 20;
+
+// Whether mapped windows are msync'ed before being unmapped (--msync).
+// Set before the workers are created so they inherit it.
+bool syncMappedWrites();
+void setSyncMappedWrites(bool sync);
+
+// Out-of-place tasks (--output) read the source and write the output in blocks of this
+// size; O_DIRECT transfers need offsets, lengths and buffers aligned to DIRECT_IO_ALIGNMENT
+const size_t COPY_BLOCK_SIZE = 4 << 20;
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+
+// Whether out-of-place tasks bypass the page cache with O_DIRECT (--direct).
+// Set before the workers are created so they inherit it.
+bool directCopies();
+void setDirectCopies(bool direct);
+
+// Open an output file of an out-of-place task, creating it (mode) and its directories;
+// -1 with errno set on failure. O_DIRECT is dropped where the file system refuses it.
+int openOutputFile(const std::string &outputPath, int flags, unsigned mode);
+
+std::vector<uint8_t> deriveKey(const std::string& seed, size_t length);
+
+struct Task;
+struct TaskRecord;
+
+// Transform the file (range) a task names. The string form is "path,ACTION[,offset,length]";
+// the record form is used in place from the shared-memory queue.
+// bytesDone, when given, is increased by the bytes the task covered.
+// Out-of-place tasks leave the source untouched and write to the output tree.
 int executeCryption(const std::string &data);
+int executeCryption(const Task &task, size_t *bytesDone = nullptr);
+int executeCryption(const TaskRecord &record, size_t *bytesDone = nullptr);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,11 +1,126 @@
 #include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
 #include "Cryption.hpp"
+#include "StreamCryption.hpp"
+#include "Cipher.hpp"
+#include "Container.hpp"
+
+static void printUsage() {
+    std::cerr << "Usage: ./cryption <task_data>" << std::endl;
+    std::cerr << "       ./cryption --stream [encrypt|decrypt] < input > output" << std::endl;
+    std::cerr << "       ./cryption --info CONTAINER" << std::endl;
+    std::cerr << "       ./cryption --range OFFSET LENGTH CONTAINER > output" << std::endl;
+    std::cerr << "Streams and task data use the xor pad; chacha20 and aes-256-ctr need a container." << std::endl;
+}
+
+static bool parseOffset(const char *text, uint64_t &value) {
+    char *end;
+    value = std::strtoull(text, &end, 10);
+    return *text != '\0' && *end == '\0';
+}
+
+// Plaintext [offset, offset + length) of a container to stdout, decrypting only the
+// chunks it touches
+static int readRange(uint64_t offset, uint64_t length, const char *path) {
+    try {
+        ContainerReader reader(path);
+        std::vector<uint8_t> buffer(reader.container().chunkSize());
+        uint64_t done = 0;
+        while (done < length) {
+            size_t got;
+            if (!reader.read(offset + done, std::min<uint64_t>(buffer.size(), length - done), buffer.data(), &got)) {
+                return 1;
+            }
+            if (got == 0) break;
+            for (size_t written = 0; written < got;) {
+                ssize_t n = write(STDOUT_FILENO, buffer.data() + written, got - written);
+                if (n <= 0) {
+                    perror("write failed");
+                    return 1;
+                }
+                written += n;
+            }
+            done += got;
+        }
+        std::cerr << "Read " << done << " bytes from " << reader.chunksRead() << " of "
+                  << reader.container().chunks() << " chunks" << std::endl;
+    } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int printInfo(const char *path) {
+    try {
+        ContainerReader reader(path);
+        const Container &container = reader.container();
+        std::cout << "Cipher: " << container.cipherName() << " (" << container.cipher().implementation() << ")\n"
+                  << "Size: " << container.plaintextSize() << " bytes in " << container.chunks() << " chunks of "
+                  << container.chunkSize() << "\n"
+                  << "Codec: " << container.codecName() << "\n"
+                  << "Container: " << container.containerSize() << " bytes, " << reader.storedSize()
+                  << " of them chunk records" << std::endl;
+    } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Streams and task data have no header to keep a per-file nonce in, so only the
+// xor pad may run here: chacha20 or aes-256-ctr would reuse one key stream for
+// every input (encrypt_decrypt --container uses them with per-file salts)
+static bool padCipher() {
+    const char *cipher = std::getenv("CRYPTION_CIPHER");
+    if (cipher == nullptr || std::string(cipher) == "xor") {
+        return true;
+    }
+    if (!isCipherName(cipher)) {
+        std::cerr << "Invalid CRYPTION_CIPHER: " << cipher << std::endl;
+    } else {
+        std::cerr << "CRYPTION_CIPHER=" << cipher << " needs a container: use encrypt_decrypt --container" << std::endl;
+    }
+    return false;
+}
 
 int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "--stream") {
+        // The key stream is symmetric, so the action only documents the pipeline
+        if (argc > 3 || (argc == 3 && std::string(argv[2]) != "encrypt" && std::string(argv[2]) != "decrypt")) {
+            printUsage();
+            return 1;
+        }
+        if (!padCipher()) {
+            return 1;
+        }
+        // stdout carries the data: anything else goes to stderr
+        StreamCryption stream(KeyMaterial::get());
+        return stream.run(STDIN_FILENO, STDOUT_FILENO) ? 0 : 1;
+    }
+    // A container records its cipher: these need no CRYPTION_CIPHER
+    if (argc == 3 && std::string(argv[1]) == "--info") {
+        return printInfo(argv[2]);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--range") {
+        uint64_t offset, length;
+        if (argc != 5 || !parseOffset(argv[2], offset) || !parseOffset(argv[3], length)) {
+            printUsage();
+            return 1;
+        }
+        return readRange(offset, length, argv[4]);
+    }
     if (argc != 2) {
-        std::cerr << "Usage: ./cryption <task_data>" << std::endl;
+        printUsage();
+        return 1;
+    }
+    if (!padCipher()) {
         return 1;
     }
     executeCryption(argv[1]);
     return 0;
-}
\ No newline at end of file
+}
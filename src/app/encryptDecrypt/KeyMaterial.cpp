@@ -0,0 +1,19 @@
+#include "KeyMaterial.hpp"
+#include "Sha256.hpp"
+#include "../fileHandling/ReadEnv.cpp"
+
+KeyMaterial::KeyMaterial() {
+    ReadEnv env;
+    std::string secret = env.getenv();
+    cipherInstance = createCipher(runCipher(), secret);
+    master = hkdfSha256(std::vector<uint8_t>(secret.begin(), secret.end()), {}, "cryption master key", 32);
+}
+
+void KeyMaterial::load() {
+    get();
+}
+
+const KeyMaterial &KeyMaterial::get() {
+    static const KeyMaterial material;
+    return material;
+}
@@ -0,0 +1,43 @@
+#ifndef KEY_MATERIAL_HPP
+#define KEY_MATERIAL_HPP
+
+#include "Cipher.hpp"
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// The cipher of a run (runCipher()), keyed from .env once per process.
+// The parent loads it before creating workers, so forked workers inherit the
+// ready key schedule or key stream and never re-read .env or re-derive it per task.
+class KeyMaterial {
+public:
+    // Bytes the xor cipher covers per kernel call: whole key periods and whole kernel strides
+    static const size_t KEY_STREAM_SPAN = 8 << 10;
+
+    // Load and derive now (idempotent); call in the parent before forking workers
+    static void load();
+
+    // The process-wide key material, loaded on first use if load() was not called
+    static const KeyMaterial &get();
+
+    // XOR the key stream into len bytes that sit at fileOffset in the file
+    void apply(uint8_t *data, size_t len, size_t fileOffset) const {
+        cipherInstance->apply(data, len, fileOffset);
+    }
+
+    const Cipher &cipher() const { return *cipherInstance; }
+
+    // A 32-byte key from the secret that per-file keys (containers) are derived from
+    const std::vector<uint8_t> &masterKey() const { return master; }
+
+private:
+    KeyMaterial();
+    KeyMaterial(const KeyMaterial &) = delete;
+    KeyMaterial &operator=(const KeyMaterial &) = delete;
+
+    std::unique_ptr<Cipher> cipherInstance;
+    std::vector<uint8_t> master;
+};
+
+#endif
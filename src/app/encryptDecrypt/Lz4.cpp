@@ -0,0 +1,205 @@
+#include "Lz4.hpp"
+#include <cstring>
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5; // A block ends in at least this many literals
+static const size_t MATCH_FIND_LIMIT = 12; // and its last match starts at least this far from the end
+static const size_t MAX_DISTANCE = 65535;
+static const unsigned HASH_LOG = 14;
+
+static const size_t SAMPLE_COUNT = 4;
+static const size_t SAMPLE_LENGTH = 4096;
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// Bytes a and b have in common, reading a no further than limit
+static inline size_t commonLength(const uint8_t *a, const uint8_t *b, const uint8_t *limit) {
+    const uint8_t *start = a;
+    while (a + 8 <= limit) {
+        uint64_t difference = load64(a) ^ load64(b);
+        if (difference != 0) {
+            return a - start + (__builtin_ctzll(difference) >> 3); // Little-endian: the first byte is lowest
+        }
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return a - start;
+}
+
+// The 255-byte continuation of a literal or match length that did not fit its token nibble
+static inline uint8_t *putLength(uint8_t *out, size_t length) {
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+// One sequence: literals, then (unless it is the last) a match at distance
+static inline uint8_t *putSequence(uint8_t *out, const uint8_t *literals, size_t literalLength, size_t distance,
+                                   size_t matchLength, bool last) {
+    uint8_t *token = out++;
+    if (literalLength >= 15) {
+        *token = 15 << 4;
+        out = putLength(out, literalLength - 15);
+    } else {
+        *token = static_cast<uint8_t>(literalLength << 4);
+    }
+    if (literalLength > 0) memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (last) return out;
+
+    uint16_t offset = static_cast<uint16_t>(distance);
+    memcpy(out, &offset, sizeof(offset));
+    out += sizeof(offset);
+    size_t extra = matchLength - MIN_MATCH;
+    if (extra >= 15) {
+        *token |= 15;
+        out = putLength(out, extra - 15);
+    } else {
+        *token |= static_cast<uint8_t>(extra);
+    }
+    return out;
+}
+
+// Room a sequence needs at most
+static inline size_t sequenceBound(size_t literalLength, size_t matchLength) {
+    return 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+}
+
+size_t lz4Compress(const uint8_t *data, size_t len, uint8_t *out, size_t capacity) {
+    // Positions by hash; cleared per block so the output depends on the block alone
+    thread_local uint32_t table[1 << HASH_LOG];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *ip = data;
+    const uint8_t *anchor = data;
+    const uint8_t *end = data + len;
+    uint8_t *op = out;
+    uint8_t *outEnd = out + capacity;
+
+    if (len > MATCH_FIND_LIMIT) {
+        const uint8_t *searchLimit = end - MATCH_FIND_LIMIT;
+        const uint8_t *matchLimit = end - LAST_LITERALS;
+        for (ip++; ip < searchLimit;) {
+            uint32_t sequence = load32(ip);
+            uint32_t h = hash4(sequence);
+            const uint8_t *ref = data + table[h];
+            table[h] = static_cast<uint32_t>(ip - data);
+            if (static_cast<size_t>(ip - ref) > MAX_DISTANCE || load32(ref) != sequence) {
+                // Step further the longer nothing matched, so incompressible data goes fast
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            while (ip > anchor && ref > data && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            size_t matchLength = MIN_MATCH + commonLength(ip + MIN_MATCH, ref + MIN_MATCH, matchLimit);
+            size_t literalLength = ip - anchor;
+            if (sequenceBound(literalLength, matchLength) > static_cast<size_t>(outEnd - op)) {
+                return 0;
+            }
+            op = putSequence(op, anchor, literalLength, ip - ref, matchLength, false);
+            ip += matchLength;
+            anchor = ip;
+            if (ip < searchLimit) {
+                table[hash4(load32(ip - 2))] = static_cast<uint32_t>(ip - 2 - data);
+            }
+        }
+    }
+
+    size_t literalLength = end - anchor;
+    if (sequenceBound(literalLength, 0) > static_cast<size_t>(outEnd - op)) {
+        return 0;
+    }
+    op = putSequence(op, anchor, literalLength, 0, 0, true);
+    return op - out;
+}
+
+static inline bool readLength(const uint8_t *&ip, const uint8_t *end, size_t &length) {
+    uint8_t byte;
+    do {
+        if (ip == end) return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz4Decompress(const uint8_t *data, size_t len, uint8_t *out, size_t expected) {
+    const uint8_t *ip = data;
+    const uint8_t *end = data + len;
+    uint8_t *op = out;
+    uint8_t *outEnd = out + expected;
+    while (ip < end) {
+        unsigned token = *ip++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(ip, end, literalLength)) return false;
+        if (literalLength > static_cast<size_t>(end - ip) || literalLength > static_cast<size_t>(outEnd - op)) {
+            return false;
+        }
+        // Short runs copy a fixed 16 bytes where both buffers have room past them
+        if (literalLength <= 16 && end - ip >= 16 + 2 && outEnd - op >= 16) {
+            memcpy(op, ip, 16);
+        } else if (literalLength > 0) {
+            memcpy(op, ip, literalLength);
+        }
+        ip += literalLength;
+        op += literalLength;
+        if (ip == end) break; // The last sequence has no match
+
+        if (end - ip < 2) return false;
+        size_t distance = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (distance == 0 || distance > static_cast<size_t>(op - out)) return false;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, end, matchLength)) return false;
+        matchLength += MIN_MATCH;
+        if (matchLength > static_cast<size_t>(outEnd - op)) return false;
+
+        // The match may overlap what it writes: 8 bytes at a time only when they cannot
+        const uint8_t *match = op - distance;
+        uint8_t *matchEnd = op + matchLength;
+        if (distance >= 16 && matchLength <= 16 && outEnd - op >= 16) {
+            memcpy(op, match, 16);
+            op = matchEnd;
+            continue;
+        }
+        if (distance >= 8) {
+            for (; op + 8 <= matchEnd; op += 8, match += 8) memcpy(op, match, 8);
+        }
+        while (op < matchEnd) *op++ = *match++;
+    }
+    return op == outEnd;
+}
+
+bool looksIncompressible(const uint8_t *data, size_t len) {
+    if (len < 4 * SAMPLE_COUNT * SAMPLE_LENGTH) {
+        return false; // Cheap enough to just try
+    }
+    thread_local uint8_t scratch[lz4Bound(SAMPLE_LENGTH)];
+    size_t compressed = 0;
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        size_t at = i * (len - SAMPLE_LENGTH) / (SAMPLE_COUNT - 1);
+        size_t n = lz4Compress(data + at, SAMPLE_LENGTH, scratch, sizeof(scratch));
+        compressed += n == 0 ? SAMPLE_LENGTH : n;
+    }
+    return compressed * 100 > SAMPLE_COUNT * SAMPLE_LENGTH * 97;
+}
@@ -0,0 +1,26 @@
+#ifndef LZ4_HPP
+#define LZ4_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// The LZ4 block format (lz4_Block_format.md): a greedy single-pass compressor with a
+// 4-byte hash table, and a bounds-checked decompressor. Blocks are independent, so
+// container chunks compress and decompress on any worker.
+
+// Worst-case compressed size of len bytes
+constexpr size_t lz4Bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+// Compress len bytes into out; 0 when the result would not fit in capacity bytes
+size_t lz4Compress(const uint8_t *data, size_t len, uint8_t *out, size_t capacity);
+
+// Decompress a block that must expand to exactly expected bytes; false for a malformed one
+bool lz4Decompress(const uint8_t *data, size_t len, uint8_t *out, size_t expected);
+
+// Whether compressing len bytes is not worth it: a few samples spread over them are
+// compressed, and when they shrink by less than a few percent the whole is stored as is
+bool looksIncompressible(const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,127 @@
+#include "Poly1305.hpp"
+#include <algorithm>
+#include <cstring>
+
+using uint128 = unsigned __int128;
+
+static const uint64_t MASK44 = 0xfffffffffffULL;
+static const uint64_t MASK42 = 0x3ffffffffffULL;
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value)); // Little-endian host
+    return value;
+}
+
+Poly1305::Poly1305(const uint8_t key[POLY1305_KEY_LENGTH]) : buffered(0) {
+    // r is clamped: the top four bits of every 32-bit word and the low two of the upper three cleared
+    uint64_t t0 = load64(key);
+    uint64_t t1 = load64(key + 8);
+    r[0] = t0 & 0xffc0fffffffULL;
+    r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+    h[0] = h[1] = h[2] = 0;
+    pad[0] = load64(key + 16);
+    pad[1] = load64(key + 24);
+}
+
+// h = (h + m) * r mod 2^130 - 5 for every 16-byte block; highBit is the 2^128 bit
+// that full blocks carry (a padded final block carries its 1 byte instead)
+void Poly1305::blocks(const uint8_t *data, size_t len, uint64_t highBit) {
+    uint64_t r0 = r[0], r1 = r[1], r2 = r[2];
+    // 2^130 = 5 mod p, and the limbs above it are 2^2 further up
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+    for (; len >= 16; data += 16, len -= 16) {
+        uint64_t t0 = load64(data);
+        uint64_t t1 = load64(data + 8);
+        h0 += t0 & MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+        h2 += ((t1 >> 24) & MASK42) | highBit;
+
+        uint128 d0 = uint128(h0) * r0 + uint128(h1) * s2 + uint128(h2) * s1;
+        uint128 d1 = uint128(h0) * r1 + uint128(h1) * r0 + uint128(h2) * s2;
+        uint128 d2 = uint128(h0) * r2 + uint128(h1) * r1 + uint128(h2) * r0;
+
+        uint64_t c = static_cast<uint64_t>(d0 >> 44);
+        h0 = static_cast<uint64_t>(d0) & MASK44;
+        d1 += c;
+        c = static_cast<uint64_t>(d1 >> 44);
+        h1 = static_cast<uint64_t>(d1) & MASK44;
+        d2 += c;
+        c = static_cast<uint64_t>(d2 >> 42);
+        h2 = static_cast<uint64_t>(d2) & MASK42;
+        h0 += c * 5;
+        c = h0 >> 44;
+        h0 &= MASK44;
+        h1 += c;
+    }
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+}
+
+void Poly1305::update(const uint8_t *data, size_t len) {
+    if (buffered > 0) {
+        size_t n = std::min(len, sizeof(buffer) - buffered);
+        memcpy(buffer + buffered, data, n);
+        buffered += n;
+        data += n;
+        len -= n;
+        if (buffered < sizeof(buffer)) return;
+        blocks(buffer, sizeof(buffer), 1ULL << 40);
+        buffered = 0;
+    }
+    size_t whole = len & ~static_cast<size_t>(15);
+    blocks(data, whole, 1ULL << 40);
+    data += whole;
+    len -= whole;
+    if (len > 0) {
+        memcpy(buffer, data, len);
+        buffered = len;
+    }
+}
+
+void Poly1305::finish(uint8_t tag[POLY1305_TAG_LENGTH]) {
+    if (buffered > 0) {
+        buffer[buffered] = 1;
+        memset(buffer + buffered + 1, 0, sizeof(buffer) - buffered - 1);
+        blocks(buffer, sizeof(buffer), 0);
+    }
+
+    // Carry fully, then subtract p when h >= p, without branching on h
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+    uint64_t c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c; c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c;
+
+    uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+    uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+    uint64_t g2 = h2 + c - (1ULL << 42);
+    uint64_t keep = (g2 >> 63) - 1; // All ones when h - p did not go negative
+    g0 &= keep; g1 &= keep; g2 &= keep;
+    keep = ~keep;
+    h0 = (h0 & keep) | g0;
+    h1 = (h1 & keep) | g1;
+    h2 = (h2 & keep) | g2;
+
+    // tag = (h + pad) mod 2^128
+    uint64_t t0 = pad[0], t1 = pad[1];
+    h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+    h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+    uint64_t out0 = h0 | (h1 << 44);
+    uint64_t out1 = (h1 >> 20) | (h2 << 24);
+    memcpy(tag, &out0, 8);
+    memcpy(tag + 8, &out1, 8);
+}
+
+bool tagsEqual(const uint8_t a[POLY1305_TAG_LENGTH], const uint8_t b[POLY1305_TAG_LENGTH]) {
+    uint8_t difference = 0;
+    for (size_t i = 0; i < POLY1305_TAG_LENGTH; i++) difference |= a[i] ^ b[i];
+    return difference == 0;
+}
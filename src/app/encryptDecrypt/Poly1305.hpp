@@ -0,0 +1,32 @@
+#ifndef POLY1305_HPP
+#define POLY1305_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t POLY1305_KEY_LENGTH = 32;
+const size_t POLY1305_TAG_LENGTH = 16;
+
+// The Poly1305 one-time authenticator (RFC 8439), with 44/44/42-bit limbs and 128-bit
+// products. A key must authenticate a single message.
+class Poly1305 {
+    public:
+        explicit Poly1305(const uint8_t key[POLY1305_KEY_LENGTH]);
+
+        void update(const uint8_t *data, size_t len);
+        void finish(uint8_t tag[POLY1305_TAG_LENGTH]);
+
+    private:
+        void blocks(const uint8_t *data, size_t len, uint64_t highBit);
+
+        uint64_t r[3];
+        uint64_t h[3];
+        uint64_t pad[2];
+        uint8_t buffer[16];
+        size_t buffered;
+};
+
+// Tags compared in constant time
+bool tagsEqual(const uint8_t a[POLY1305_TAG_LENGTH], const uint8_t b[POLY1305_TAG_LENGTH]);
+
+#endif
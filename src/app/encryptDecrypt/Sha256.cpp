@@ -0,0 +1,184 @@
+#include "Sha256.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static const uint32_t ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const size_t BLOCK_LENGTH = 64;
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void compress(uint32_t h[8], const uint8_t block[BLOCK_LENGTH]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+               (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + ROUND_CONSTANTS[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+// Incremental hashing, so HMAC and HKDF hash their pieces where they are
+namespace {
+struct Sha256State {
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t buffer[BLOCK_LENGTH];
+    size_t buffered = 0;
+    uint64_t total = 0;
+
+    void update(const uint8_t *data, size_t len) {
+        total += len;
+        if (buffered > 0) {
+            size_t n = std::min(len, BLOCK_LENGTH - buffered);
+            memcpy(buffer + buffered, data, n);
+            buffered += n;
+            data += n;
+            len -= n;
+            if (buffered < BLOCK_LENGTH) return;
+            compress(h, buffer);
+            buffered = 0;
+        }
+        for (; len >= BLOCK_LENGTH; data += BLOCK_LENGTH, len -= BLOCK_LENGTH) {
+            compress(h, data);
+        }
+        if (len > 0) memcpy(buffer, data, len);
+        buffered = len;
+    }
+
+    // The tail, a 1 bit, zeros and the message length in bits fill one or two blocks
+    void finish(uint8_t digest[SHA256_DIGEST_LENGTH]) {
+        uint64_t bits = total * 8;
+        uint8_t tail[2 * BLOCK_LENGTH] = {};
+        if (buffered > 0) memcpy(tail, buffer, buffered);
+        tail[buffered] = 0x80;
+        size_t tailLength = buffered + 9 <= BLOCK_LENGTH ? BLOCK_LENGTH : 2 * BLOCK_LENGTH;
+        for (int j = 0; j < 8; j++) {
+            tail[tailLength - 1 - j] = static_cast<uint8_t>(bits >> (8 * j));
+        }
+        for (size_t j = 0; j < tailLength; j += BLOCK_LENGTH) {
+            compress(h, tail + j);
+        }
+        for (int j = 0; j < 8; j++) {
+            digest[4 * j] = static_cast<uint8_t>(h[j] >> 24);
+            digest[4 * j + 1] = static_cast<uint8_t>(h[j] >> 16);
+            digest[4 * j + 2] = static_cast<uint8_t>(h[j] >> 8);
+            digest[4 * j + 3] = static_cast<uint8_t>(h[j]);
+        }
+    }
+};
+}
+
+void sha256(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_LENGTH]) {
+    Sha256State state;
+    state.update(data, len);
+    state.finish(digest);
+}
+
+void hmacSha256(const uint8_t *key, size_t keyLength, const uint8_t *data, size_t len,
+                uint8_t mac[SHA256_DIGEST_LENGTH]) {
+    uint8_t block[BLOCK_LENGTH] = {};
+    if (keyLength > BLOCK_LENGTH) {
+        sha256(key, keyLength, block);
+    } else if (keyLength > 0) {
+        memcpy(block, key, keyLength);
+    }
+
+    uint8_t pad[BLOCK_LENGTH];
+    for (size_t i = 0; i < BLOCK_LENGTH; i++) pad[i] = block[i] ^ 0x36;
+    Sha256State inner;
+    inner.update(pad, BLOCK_LENGTH);
+    inner.update(data, len);
+    uint8_t innerDigest[SHA256_DIGEST_LENGTH];
+    inner.finish(innerDigest);
+
+    for (size_t i = 0; i < BLOCK_LENGTH; i++) pad[i] = block[i] ^ 0x5c;
+    Sha256State outer;
+    outer.update(pad, BLOCK_LENGTH);
+    outer.update(innerDigest, SHA256_DIGEST_LENGTH);
+    outer.finish(mac);
+}
+
+void hkdfSha256(const uint8_t *ikm, size_t ikmLength, const uint8_t *salt, size_t saltLength, const char *info,
+                uint8_t *out, size_t length) {
+    if (length > 255 * SHA256_DIGEST_LENGTH) {
+        throw std::runtime_error("HKDF output too long");
+    }
+    // Extract: an absent salt is a block of zeros
+    static const uint8_t zeros[SHA256_DIGEST_LENGTH] = {};
+    uint8_t prk[SHA256_DIGEST_LENGTH];
+    if (saltLength == 0) {
+        hmacSha256(zeros, sizeof(zeros), ikm, ikmLength, prk);
+    } else {
+        hmacSha256(salt, saltLength, ikm, ikmLength, prk);
+    }
+
+    // Expand: T(i) = HMAC(PRK, T(i - 1) | info | i), each at most one digest and a short
+    // info, so the input is put together on the stack
+    size_t infoLength = strlen(info);
+    uint8_t input[SHA256_DIGEST_LENGTH + 255 + 1];
+    if (infoLength > 255) {
+        throw std::runtime_error("HKDF info too long");
+    }
+    uint8_t previous[SHA256_DIGEST_LENGTH];
+    size_t previousLength = 0;
+    for (uint8_t counter = 1; length > 0; counter++) {
+        memcpy(input, previous, previousLength);
+        memcpy(input + previousLength, info, infoLength);
+        input[previousLength + infoLength] = counter;
+        hmacSha256(prk, sizeof(prk), input, previousLength + infoLength + 1, previous);
+        previousLength = SHA256_DIGEST_LENGTH;
+        size_t n = std::min(length, SHA256_DIGEST_LENGTH);
+        memcpy(out, previous, n);
+        out += n;
+        length -= n;
+    }
+}
+
+std::vector<uint8_t> sha256(const uint8_t *data, size_t len) {
+    std::vector<uint8_t> digest(SHA256_DIGEST_LENGTH);
+    sha256(data, len, digest.data());
+    return digest;
+}
+
+std::vector<uint8_t> hmacSha256(const std::vector<uint8_t> &key, const uint8_t *data, size_t len) {
+    std::vector<uint8_t> mac(SHA256_DIGEST_LENGTH);
+    hmacSha256(key.data(), key.size(), data, len, mac.data());
+    return mac;
+}
+
+std::vector<uint8_t> hkdfSha256(const std::vector<uint8_t> &ikm, const std::vector<uint8_t> &salt,
+                                const std::string &info, size_t length) {
+    std::vector<uint8_t> okm(length);
+    hkdfSha256(ikm.data(), ikm.size(), salt.data(), salt.size(), info.c_str(), okm.data(), length);
+    return okm;
+}
@@ -0,0 +1,28 @@
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+const size_t SHA256_DIGEST_LENGTH = 32;
+
+// FIPS 180-4 SHA-256, HMAC (RFC 2104) and HKDF (RFC 5869) over it, in plain portable
+// code: it keys the cipher once per run, and each container file once.
+std::vector<uint8_t> sha256(const uint8_t *data, size_t len);
+std::vector<uint8_t> hmacSha256(const std::vector<uint8_t> &key, const uint8_t *data, size_t len);
+
+// length bytes of output keying material (at most 255 * 32) for info, from the
+// input keying material ikm and an optional salt
+std::vector<uint8_t> hkdfSha256(const std::vector<uint8_t> &ikm, const std::vector<uint8_t> &salt,
+                                const std::string &info, size_t length);
+
+// The same into caller buffers, without allocating: for the per-file keys on the task path
+void sha256(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_LENGTH]);
+void hmacSha256(const uint8_t *key, size_t keyLength, const uint8_t *data, size_t len,
+                uint8_t mac[SHA256_DIGEST_LENGTH]);
+void hkdfSha256(const uint8_t *ikm, size_t ikmLength, const uint8_t *salt, size_t saltLength, const char *info,
+                uint8_t *out, size_t length);
+
+#endif
@@ -0,0 +1,152 @@
+#include "StreamCryption.hpp"
+#include <iostream>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Non-blocking descriptors (a pipe set up by the shell) are waited on instead of spun on
+static void waitFor(int fd, short events) {
+    struct pollfd p = {fd, events, 0};
+    poll(&p, 1, -1);
+}
+
+StreamCryption::StreamCryption(const KeyMaterial &key, size_t blockSize)
+    : key(key), blockSize(blockSize), buffers(nullptr), mappedSize(0),
+      readDone(false), readFailed(false), writeFailed(false) {}
+
+StreamCryption::~StreamCryption() {
+    if (buffers != nullptr) {
+        munmap(buffers, mappedSize);
+    }
+}
+
+// Size the output pipe to one block. The kernel rounds the capacity up to a power of
+// two pages, so the block grows to the capacity when that is larger.
+void StreamCryption::preparePipe(int outFd) {
+    struct stat st;
+    if (fstat(outFd, &st) == -1 || !S_ISFIFO(st.st_mode)) {
+        return;
+    }
+    int capacity = fcntl(outFd, F_SETPIPE_SZ, static_cast<int>(blockSize));
+    if (capacity == -1) {
+        // Above /proc/sys/fs/pipe-max-size, or the pipe holds more than that already
+        capacity = fcntl(outFd, F_GETPIPE_SZ);
+    }
+    if (capacity <= 0) {
+        return;
+    }
+    if (static_cast<size_t>(capacity) > blockSize) {
+        blockSize = capacity;
+    }
+}
+
+void StreamCryption::readLoop(int inFd) {
+    uint64_t position = 0;
+    for (size_t seq = 0;; seq++) {
+        Block &block = blocks[seq % BUFFER_COUNT];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return !block.filled || writeFailed; });
+            if (writeFailed) break;
+        }
+
+        // Fill the whole block, so it goes out in as few writes as the pipe allows
+        size_t length = 0;
+        bool end = false;
+        while (length < blockSize) {
+            ssize_t n = read(inFd, block.data + length, blockSize - length);
+            if (n > 0) {
+                length += n;
+                totals.reads++;
+            } else if (n == 0) {
+                end = true;
+                break;
+            } else if (errno == EAGAIN) {
+                waitFor(inFd, POLLIN);
+            } else if (errno != EINTR) {
+                perror("read from input stream failed");
+                readFailed = true;
+                end = true;
+                break;
+            }
+        }
+        key.apply(block.data, length, position);
+        position += length;
+
+        std::lock_guard<std::mutex> guard(lock);
+        block.length = length;
+        block.filled = length > 0;
+        if (end) {
+            readDone = true;
+        }
+        changed.notify_all();
+        if (end) break;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    readDone = true;
+    changed.notify_all();
+}
+
+bool StreamCryption::writeBlock(int outFd, const Block &block) {
+    size_t done = 0;
+    while (done < block.length) {
+        ssize_t n = write(outFd, block.data + done, block.length - done);
+        if (n > 0) {
+            done += n;
+            totals.writes++;
+        } else if (n == -1 && errno == EAGAIN) {
+            waitFor(outFd, POLLOUT);
+        } else if (n == -1 && errno != EINTR) {
+            perror("write to output stream failed");
+            return false;
+        }
+    }
+    totals.bytes += done;
+    return true;
+}
+
+void StreamCryption::releaseBlock(Block &block) {
+    std::lock_guard<std::mutex> guard(lock);
+    block.filled = false;
+    changed.notify_all();
+}
+
+bool StreamCryption::run(int inFd, int outFd) {
+    preparePipe(outFd);
+
+    mappedSize = BUFFER_COUNT * blockSize;
+    void *memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("mmap stream buffers failed");
+        return false;
+    }
+    buffers = static_cast<uint8_t *>(memory);
+    for (size_t i = 0; i < BUFFER_COUNT; i++) {
+        blocks[i].data = buffers + i * blockSize;
+    }
+
+    std::thread reader(&StreamCryption::readLoop, this, inFd);
+    for (size_t seq = 0;; seq++) {
+        Block &block = blocks[seq % BUFFER_COUNT];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return block.filled || readDone; });
+            if (!block.filled) break;
+        }
+        if (!writeBlock(outFd, block)) {
+            std::lock_guard<std::mutex> guard(lock);
+            writeFailed = true;
+            changed.notify_all();
+            break;
+        }
+        // Written out, so the pipe holds a copy: the block can be refilled at once
+        releaseBlock(block);
+    }
+    reader.join();
+    return !readFailed && !writeFailed;
+}
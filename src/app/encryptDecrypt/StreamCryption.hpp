@@ -0,0 +1,72 @@
+#ifndef STREAM_CRYPTION_HPP
+#define STREAM_CRYPTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include "KeyMaterial.hpp"
+
+// Default block size of the stream pipeline; an output pipe is grown to match
+const size_t STREAM_BLOCK_SIZE = 1 << 20;
+
+// What a finished stream moved and how
+struct StreamStats {
+    uint64_t bytes = 0;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+};
+
+// Transforms a byte stream (stdin to stdout in the cryption filter), so it can sit in
+// a pipeline such as tar | cryption | zstd. Byte i of the stream is XORed with the key
+// stream at offset i, exactly like byte i of a file, so a stream and a file produced
+// from the same input match.
+//
+// A reader thread fills and transforms one block while the caller's thread writes the
+// previous one. When the output is a pipe it is resized to one block, so a block
+// usually goes out in a single write.
+//
+// Blocks are copied into the pipe with write, never vmspliced: a spliced page stays
+// referenced by whatever splices it further down the pipeline (pv does), long after
+// this end could tell, and refilling the buffer would change data already sent.
+class StreamCryption {
+    public:
+        StreamCryption(const KeyMaterial &key, size_t blockSize = STREAM_BLOCK_SIZE);
+        ~StreamCryption();
+        StreamCryption(const StreamCryption &) = delete;
+        StreamCryption &operator=(const StreamCryption &) = delete;
+
+        // Returns false on a read or write error (already reported on stderr)
+        bool run(int inFd, int outFd);
+
+        const StreamStats &stats() const { return totals; }
+
+    private:
+        // One block being filled, one being written
+        static const size_t BUFFER_COUNT = 2;
+
+        struct Block {
+            uint8_t *data = nullptr;
+            size_t length = 0;
+            bool filled = false;
+        };
+
+        void readLoop(int inFd);
+        bool writeBlock(int outFd, const Block &block);
+        void releaseBlock(Block &block);
+        void preparePipe(int outFd);
+
+        const KeyMaterial &key;
+        size_t blockSize;
+        uint8_t *buffers;
+        size_t mappedSize;
+        Block blocks[BUFFER_COUNT];
+        std::mutex lock;
+        std::condition_variable changed;
+        bool readDone;    // Set by the reader after its last block (or on error)
+        bool readFailed;
+        bool writeFailed; // Tells the reader to stop
+        StreamStats totals;
+};
+
+#endif
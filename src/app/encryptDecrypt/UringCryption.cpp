@@ -0,0 +1,275 @@
+#include "UringCryption.hpp"
+#include "Cryption.hpp"
+#include "../fileHandling/BufferPool.hpp"
+#include "../processes/Trace.hpp"
+#include "../processes/FailureLog.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+
+UringCryption::UringCryption(const KeyMaterial &key, unsigned depth, size_t bufferSize)
+    : key(key), bufferSize(bufferSize), ring(depth * 2), slots(depth), buffers(nullptr),
+      inFlight(0), files_done(0), counters(nullptr), available(false) {
+    if (!ring.isAvailable()) {
+        return;
+    }
+
+    // One registered buffer per slot, carved out of a single buffer of the worker's pool
+    // (huge pages with --huge-pages)
+    try {
+        buffers = BufferPool::local().acquire(depth * bufferSize);
+    } catch (const std::runtime_error &) {
+        return;
+    }
+
+    std::vector<struct iovec> iovecs(depth);
+    for (unsigned i = 0; i < depth; i++) {
+        slots[i].buffer = buffers + i * bufferSize;
+        iovecs[i].iov_base = slots[i].buffer;
+        iovecs[i].iov_len = bufferSize;
+    }
+    available = ring.registerBuffers(iovecs.data(), depth);
+}
+
+UringCryption::~UringCryption() {
+    if (buffers != nullptr) {
+        BufferPool::local().release(buffers);
+    }
+}
+
+// The ring holds two entries per slot and each slot has at most one operation
+// outstanding, so this only fails if that invariant is broken
+struct io_uring_sqe *UringCryption::nextSqe() {
+    struct io_uring_sqe *sqe = ring.getSqe();
+    if (sqe == nullptr) {
+        ring.submitAndWait(0);
+        sqe = ring.getSqe();
+    }
+    return sqe;
+}
+
+void UringCryption::queueOpen(unsigned slot) {
+    Slot &s = slots[slot];
+    s.stage = Stage::OPENING;
+    struct io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(s.path);
+    sqe->open_flags = O_RDWR | O_CLOEXEC;
+    sqe->user_data = slot;
+}
+
+void UringCryption::queueRead(unsigned slot) {
+    Slot &s = slots[slot];
+    s.stage = Stage::READING;
+    size_t length = bufferSize;
+    if (s.end != 0) {
+        length = std::min(length, s.end - s.position);
+    }
+    struct io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = s.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(s.buffer);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->off = s.position;
+    sqe->buf_index = static_cast<uint16_t>(slot);
+    sqe->user_data = slot;
+}
+
+void UringCryption::queueWrite(unsigned slot) {
+    Slot &s = slots[slot];
+    s.stage = Stage::WRITING;
+    struct io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = s.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(s.buffer);
+    sqe->len = static_cast<uint32_t>(s.blockLength);
+    sqe->off = s.position;
+    sqe->buf_index = static_cast<uint16_t>(slot);
+    sqe->user_data = slot;
+}
+
+void UringCryption::queueClose(unsigned slot) {
+    Slot &s = slots[slot];
+    s.stage = Stage::CLOSING;
+    struct io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = s.fd;
+    sqe->user_data = slot;
+}
+
+bool UringCryption::start(const TaskRecord *record) {
+    for (unsigned i = 0; i < slots.size(); i++) {
+        Slot &s = slots[i];
+        if (s.stage != Stage::FREE) continue;
+        s.record = record;
+        s.path = record->path;
+        s.filesLeft = record->fileCount - 1;
+        s.fd = -1;
+        s.position = record->offset;
+        s.end = record->length == 0 ? 0 : record->offset + record->length;
+        queueOpen(i);
+        inFlight++;
+        return true;
+    }
+    return false;
+}
+
+// Out-of-place records go through the synchronous copy path (it needs a source
+// and an output descriptor per file); everything else gets a slot
+void UringCryption::accept(const TaskRecord *record, const TaskRelease &release) {
+    if (record->outputRoot() == nullptr) {
+        start(record);
+        return;
+    }
+    size_t bytes = 0;
+    AllocationMark mark;
+    uint64_t start = monotonicNs();
+    executeCryption(*record, &bytes);
+    TRACE_SPAN("task", start, monotonicNs(), "bytes", bytes);
+    files_done += record->fileCount;
+    if (counters != nullptr) {
+        mark.addSince(*counters);
+        WorkerCounters::add(counters->bytes, bytes);
+        WorkerCounters::add(counters->files, record->offset == 0 ? record->fileCount : 0);
+        WorkerCounters::add(counters->tasks, 1);
+    }
+    release(record);
+}
+
+// Move a batch slot on to its next file, always a whole file; false once the record is done
+bool UringCryption::startNextFile(unsigned slot) {
+    Slot &s = slots[slot];
+    if (s.filesLeft == 0) {
+        return false;
+    }
+    s.filesLeft--;
+    s.path = s.record->nextPath(s.path);
+    s.fd = -1;
+    s.position = 0;
+    s.end = 0;
+    queueOpen(slot);
+    return true;
+}
+
+void UringCryption::complete(unsigned slot, int result, const TaskRelease &release) {
+    Slot &s = slots[slot];
+    switch (s.stage) {
+        case Stage::OPENING:
+            if (result < 0) {
+                std::cout << "Unable to open the file: " << s.path << std::endl;
+                FailureLog::record(s.path);
+                if (startNextFile(slot)) return;
+                break;
+            }
+            s.fd = result;
+            queueRead(slot);
+            return;
+
+        case Stage::READING:
+            if (result < 0) {
+                std::cerr << "Failed to read block of " << s.path << ": " << strerror(-result) << std::endl;
+                FailureLog::record(s.path);
+                queueClose(slot);
+                return;
+            }
+            if (result == 0) {
+                queueClose(slot); // End of file
+                return;
+            }
+            s.blockLength = result;
+            {
+                TRACE_SCOPE("transform", "bytes", s.blockLength);
+                key.apply(s.buffer, s.blockLength, s.position);
+            }
+            queueWrite(slot);
+            return;
+
+        case Stage::WRITING:
+            if (result < 0 || static_cast<size_t>(result) != s.blockLength) {
+                std::cerr << "Failed to write back block of " << s.path << std::endl;
+                FailureLog::record(s.path);
+                queueClose(slot);
+                return;
+            }
+            s.position += s.blockLength;
+            if (counters != nullptr) WorkerCounters::add(counters->bytes, s.blockLength);
+            // A short read is not the end of the file (FUSE, NFS and signals give them
+            // mid-file): only a read returning 0 or the end of the chunk is
+            if (s.end != 0 && s.position >= s.end) {
+                queueClose(slot);
+            } else {
+                queueRead(slot);
+            }
+            return;
+
+        case Stage::CLOSING:
+            if (result < 0) {
+                // Write-back errors can surface only at close (NFS)
+                std::cerr << "Failed to close " << s.path << ": " << strerror(-result) << std::endl;
+                FailureLog::record(s.path);
+            }
+            files_done++;
+            if (counters != nullptr && s.record->offset == 0) WorkerCounters::add(counters->files, 1);
+            if (startNextFile(slot)) return;
+            break;
+
+        case Stage::FREE:
+            return;
+    }
+    s.stage = Stage::FREE;
+    if (counters != nullptr) WorkerCounters::add(counters->tasks, 1);
+    release(s.record);
+    s.record = nullptr;
+    inFlight--;
+}
+
+// With counters set, time spent taking ready tasks counts as queue wait, time
+// blocked on an empty queue as idle, and everything else (submitting, waiting
+// on completions, XOR) as busy.
+void UringCryption::run(const TaskSource &nextTask, const TaskRelease &release) {
+    const TaskRecord *record;
+    uint64_t mark = monotonicNs();
+    auto account = [&](std::atomic<uint64_t> WorkerCounters::*field, const char *traceName = nullptr) {
+        uint64_t now = monotonicNs();
+        if (counters != nullptr) WorkerCounters::add(counters->*field, now - mark);
+        if (traceName != nullptr) TRACE_SPAN(traceName, mark, now);
+        mark = now;
+    };
+    while (true) {
+        account(&WorkerCounters::busyNs);
+        // Top up the free slots without waiting
+        while (inFlight < slots.size() && (record = nextTask(false)) != nullptr) {
+            account(&WorkerCounters::queueWaitNs, "dequeue");
+            accept(record, release);
+            account(&WorkerCounters::busyNs);
+        }
+        account(&WorkerCounters::queueWaitNs);
+        // Idle: wait for the next task, or stop when none will come
+        if (inFlight == 0) {
+            record = nextTask(true);
+            account(&WorkerCounters::idleNs, "idle");
+            if (record == nullptr) break;
+            accept(record, release);
+            continue; // Top up behind it; an out-of-place record leaves nothing in flight
+        }
+
+        // One syscall submits every queued step and waits for the next completion
+        {
+            // Opens, reads, writes and closes of every slot overlap here
+            TRACE_SCOPE("io_uring wait", "files", inFlight);
+            if (ring.submitAndWait(1) < 0) {
+                break;
+            }
+        }
+        struct io_uring_cqe *cqe;
+        while ((cqe = ring.peekCqe()) != nullptr) {
+            unsigned slot = static_cast<unsigned>(cqe->user_data);
+            int result = cqe->res;
+            ring.seenCqe();
+            complete(slot, result, release);
+        }
+    }
+}
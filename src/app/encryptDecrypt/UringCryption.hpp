@@ -0,0 +1,80 @@
+#ifndef URING_CRYPTION_HPP
+#define URING_CRYPTION_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "../fileHandling/Uring.hpp"
+#include "../processes/TaskRecord.hpp"
+#include "../processes/WorkerMetrics.hpp"
+#include "KeyMaterial.hpp"
+
+// Supplies the next task record. With blocking == false it must return at once;
+// with blocking == true it may wait, and returns nullptr when no task will ever come.
+using TaskSource = std::function<const TaskRecord *(bool blocking)>;
+
+// Called once the pipeline is done with a record (its path is used in place until then)
+using TaskRelease = std::function<void(const TaskRecord *record)>;
+
+// Asynchronous per-worker pipeline on io_uring: keeps up to `depth` files in flight,
+// each stepping through openat -> read -> (XOR) -> write -> ... -> close.
+// Every step is queued as a submission entry and the whole batch goes to the kernel
+// in one io_uring_enter, so the XOR of one file overlaps the I/O of the others.
+// Reads and writes use registered (fixed) buffers, one per in-flight file.
+// A small-file batch record stays in its slot until its last file is closed.
+// Out-of-place records are copied synchronously between the ring steps.
+class UringCryption {
+    public:
+        UringCryption(const KeyMaterial &key, unsigned depth = 32, size_t bufferSize = 256 << 10);
+        ~UringCryption();
+
+        // False when io_uring cannot be used here; run the synchronous path instead
+        bool isAvailable() const { return available; }
+
+        // Drain the task source, returns once it is exhausted and nothing is in flight
+        void run(const TaskSource &nextTask, const TaskRelease &release);
+
+        // Optional live counters of the worker running this pipeline
+        void setCounters(WorkerCounters *workerCounters) { counters = workerCounters; }
+
+        size_t filesDone() const { return files_done; }
+        size_t syscalls() const { return ring.enterCalls(); }
+
+    private:
+        enum class Stage { FREE, OPENING, READING, WRITING, CLOSING };
+
+        struct Slot {
+            Stage stage = Stage::FREE;
+            const TaskRecord *record = nullptr;
+            const char *path = nullptr; // File of the record being processed
+            unsigned filesLeft = 0;     // Files of a batch record after this one
+            int fd = -1;
+            size_t position = 0; // File offset of the current block
+            size_t end = 0;      // 0 means read until the end of the file
+            size_t blockLength = 0;
+            uint8_t *buffer = nullptr;
+        };
+
+        void accept(const TaskRecord *record, const TaskRelease &release);
+        bool start(const TaskRecord *record);
+        bool startNextFile(unsigned slot);
+        void queueOpen(unsigned slot);
+        void queueRead(unsigned slot);
+        void queueWrite(unsigned slot);
+        void queueClose(unsigned slot);
+        void complete(unsigned slot, int result, const TaskRelease &release);
+        struct io_uring_sqe *nextSqe();
+
+        const KeyMaterial &key;
+        size_t bufferSize;
+        Uring ring;
+        std::vector<Slot> slots;
+        uint8_t *buffers;
+        unsigned inFlight;
+        size_t files_done;
+        WorkerCounters *counters;
+        bool available;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "XorKernel.hpp"
+#include <immintrin.h>
+#include <algorithm>
+
+// Plain byte loop, used when no vector extension is available
+static void xorScalar(uint8_t *data, const uint8_t *key, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        data[i] ^= key[i];
+    }
+}
+
+__attribute__((target("sse2")))
+static void xorSSE2(uint8_t *data, const uint8_t *key, size_t len) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i d0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i d1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 16));
+        __m128i d2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 32));
+        __m128i d3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 48));
+        d0 = _mm_xor_si128(d0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key + i)));
+        d1 = _mm_xor_si128(d1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key + i + 16)));
+        d2 = _mm_xor_si128(d2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key + i + 32)));
+        d3 = _mm_xor_si128(d3, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key + i + 48)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), d0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i + 16), d1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i + 32), d2);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i + 48), d3);
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        d = _mm_xor_si128(d, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), d);
+    }
+    xorScalar(data + i, key + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void xorAVX2(uint8_t *data, const uint8_t *key, size_t len) {
+    size_t i = 0;
+    for (; i + 128 <= len; i += 128) {
+        __m256i d0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 32));
+        __m256i d2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 64));
+        __m256i d3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 96));
+        d0 = _mm256_xor_si256(d0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i)));
+        d1 = _mm256_xor_si256(d1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i + 32)));
+        d2 = _mm256_xor_si256(d2, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i + 64)));
+        d3 = _mm256_xor_si256(d3, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i + 96)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), d0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i + 32), d1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i + 64), d2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i + 96), d3);
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        d = _mm256_xor_si256(d, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), d);
+    }
+    xorSSE2(data + i, key + i, len - i);
+}
+
+__attribute__((target("avx512f")))
+static void xorAVX512(uint8_t *data, const uint8_t *key, size_t len) {
+    size_t i = 0;
+    for (; i + 256 <= len; i += 256) {
+        __m512i d0 = _mm512_loadu_si512(data + i);
+        __m512i d1 = _mm512_loadu_si512(data + i + 64);
+        __m512i d2 = _mm512_loadu_si512(data + i + 128);
+        __m512i d3 = _mm512_loadu_si512(data + i + 192);
+        d0 = _mm512_xor_si512(d0, _mm512_loadu_si512(key + i));
+        d1 = _mm512_xor_si512(d1, _mm512_loadu_si512(key + i + 64));
+        d2 = _mm512_xor_si512(d2, _mm512_loadu_si512(key + i + 128));
+        d3 = _mm512_xor_si512(d3, _mm512_loadu_si512(key + i + 192));
+        _mm512_storeu_si512(data + i, d0);
+        _mm512_storeu_si512(data + i + 64, d1);
+        _mm512_storeu_si512(data + i + 128, d2);
+        _mm512_storeu_si512(data + i + 192, d3);
+    }
+    for (; i + 64 <= len; i += 64) {
+        __m512i d = _mm512_loadu_si512(data + i);
+        _mm512_storeu_si512(data + i, _mm512_xor_si512(d, _mm512_loadu_si512(key + i)));
+    }
+    xorAVX2(data + i, key + i, len - i);
+}
+
+const std::vector<XorKernel> &availableXorKernels() {
+    static const std::vector<XorKernel> kernels = [] {
+        std::vector<XorKernel> list;
+        __builtin_cpu_init();
+        list.push_back({"scalar", xorScalar});
+        if (__builtin_cpu_supports("sse2")) list.push_back({"sse2", xorSSE2});
+        if (__builtin_cpu_supports("avx2")) list.push_back({"avx2", xorAVX2});
+        if (__builtin_cpu_supports("avx512f")) list.push_back({"avx512", xorAVX512});
+        return list;
+    }();
+    return kernels;
+}
+
+const XorKernel &selectXorKernel() {
+    static const XorKernel &kernel = availableXorKernels().back();
+    return kernel;
+}
+
+void xorKeyStream(uint8_t *data, size_t len, const uint8_t *keyStream, size_t keyLength, size_t keyOffset,
+                  size_t streamSpan) {
+    XorKernelFn fn = selectXorKernel().fn;
+    keyOffset %= keyLength;
+
+    // Each pass covers at most streamSpan bytes (whole key periods), so the key
+    // window [keyOffset, keyOffset + n) never runs past the stream, and after
+    // a full pass the offset is back where it started.
+    while (len > 0) {
+        size_t n = std::min(len, streamSpan);
+        fn(data, keyStream + keyOffset, n);
+        data += n;
+        len -= n;
+    }
+}
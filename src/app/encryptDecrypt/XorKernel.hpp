@@ -0,0 +1,29 @@
+#ifndef XOR_KERNEL_HPP
+#define XOR_KERNEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A block kernel XORs len bytes of key into data: data[i] ^= key[i]
+using XorKernelFn = void (*)(uint8_t *data, const uint8_t *key, size_t len);
+
+struct XorKernel {
+    const char *name;
+    XorKernelFn fn;
+};
+
+// Every kernel the current CPU can run, scalar first and widest last
+const std::vector<XorKernel> &availableXorKernels();
+
+// The widest kernel supported by the current CPU, picked once at runtime
+const XorKernel &selectXorKernel();
+
+// XOR a block that starts at byte keyOffset of a repeating key stream.
+// keyStream must hold the key repeated over streamSpan + keyLength bytes, with
+// streamSpan a multiple of keyLength, so that any streamSpan-sized window starting
+// below keyLength is contiguous and the kernel runs streamSpan bytes per call.
+void xorKeyStream(uint8_t *data, size_t len, const uint8_t *keyStream, size_t keyLength, size_t keyOffset,
+                  size_t streamSpan);
+
+#endif
@@ -0,0 +1,78 @@
+#include "BufferPool.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <sys/mman.h>
+
+static const size_t PAGE_SIZE = 4096;
+
+static bool hugePages = false;
+
+bool hugePageBuffers() {
+    return hugePages;
+}
+
+void setHugePageBuffers(bool huge) {
+    hugePages = huge;
+}
+
+BufferPool &BufferPool::local() {
+    thread_local BufferPool pool;
+    return pool;
+}
+
+BufferPool::~BufferPool() {
+    for (const Buffer &buffer : buffers) {
+        munmap(buffer.data, buffer.size);
+    }
+}
+
+uint8_t *BufferPool::acquire(size_t size) {
+    Buffer *best = nullptr;
+    for (Buffer &buffer : buffers) {
+        if (!buffer.inUse && buffer.size >= size && (best == nullptr || buffer.size < best->size)) {
+            best = &buffer;
+        }
+    }
+    if (best != nullptr) {
+        best->inUse = true;
+        return best->data;
+    }
+
+    bool huge = hugePageBuffers();
+    size_t granule = huge ? HUGE_PAGE_SIZE : PAGE_SIZE;
+    size_t length = (std::max(size, size_t(1)) + granule - 1) / granule * granule;
+    void *memory = MAP_FAILED;
+    if (huge) {
+        // The reserved pool is often empty: fall back to asking for transparent huge pages
+        memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            hugeMappings++;
+        }
+    }
+    if (memory == MAP_FAILED) {
+        memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            perror("mmap buffer failed");
+            throw std::runtime_error("Failed to allocate I/O buffer");
+        }
+        if (huge) {
+            madvise(memory, length, MADV_HUGEPAGE);
+        }
+    }
+    mappings++;
+    if (buffers.empty()) {
+        buffers.reserve(8);
+    }
+    buffers.push_back({static_cast<uint8_t *>(memory), length, true});
+    return buffers.back().data;
+}
+
+void BufferPool::release(uint8_t *data) {
+    for (Buffer &buffer : buffers) {
+        if (buffer.data == data) {
+            buffer.inUse = false;
+            return;
+        }
+    }
+}
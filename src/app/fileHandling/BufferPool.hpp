@@ -0,0 +1,68 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Granule of huge-page buffers; smaller requests are rounded up to it
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+// Whether pool buffers are backed by huge pages (--huge-pages): MAP_HUGETLB from the
+// reserved pool when it has pages, transparent huge pages otherwise. Set before the
+// workers are created so they inherit it.
+bool hugePageBuffers();
+void setHugePageBuffers(bool huge);
+
+// The I/O buffers of one worker (process or thread). A buffer is mapped the first time
+// no free one is large enough and then handed out again for every later task, so a
+// worker in steady state neither allocates nor faults in fresh pages. Buffers are
+// page-aligned, which O_DIRECT transfers need.
+class BufferPool {
+    public:
+        // The calling worker's pool
+        static BufferPool &local();
+
+        BufferPool() = default;
+        ~BufferPool();
+        BufferPool(const BufferPool &) = delete;
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        // The smallest free buffer of at least size bytes; throws std::runtime_error
+        // when a new one cannot be mapped
+        uint8_t *acquire(size_t size);
+        void release(uint8_t *buffer);
+
+        // Buffers mapped so far (pool misses), and how many of them are MAP_HUGETLB
+        uint64_t mapped() const { return mappings; }
+        uint64_t hugeMapped() const { return hugeMappings; }
+
+    private:
+        struct Buffer {
+            uint8_t *data;
+            size_t size;
+            bool inUse;
+        };
+
+        std::vector<Buffer> buffers;
+        uint64_t mappings = 0;
+        uint64_t hugeMappings = 0;
+};
+
+// A pool buffer held for one scope (none for size 0)
+class PooledBuffer {
+    public:
+        explicit PooledBuffer(size_t size) : buffer(size == 0 ? nullptr : BufferPool::local().acquire(size)) {}
+        ~PooledBuffer() {
+            if (buffer != nullptr) BufferPool::local().release(buffer);
+        }
+        PooledBuffer(const PooledBuffer &) = delete;
+        PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+        uint8_t *get() const { return buffer; }
+
+    private:
+        uint8_t *buffer;
+};
+
+#endif
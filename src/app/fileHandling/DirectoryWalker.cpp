@@ -0,0 +1,226 @@
+#include "DirectoryWalker.hpp"
+#include "../processes/Trace.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Subdirectories stay open for their walker while fewer than this many are queued;
+// past that they are queued by path and opened again when their turn comes
+static const size_t MAX_QUEUED_DESCRIPTORS = 512;
+static const size_t DIRENT_BUFFER_SIZE = 64 << 10;
+
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+DirectoryWalker::DirectoryWalker(const WalkOptions &options)
+    : options(options), outstanding(0), openDescriptors(0), files_found(0), directories_visited(0),
+      stat_calls(0) {
+    if (this->options.threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        this->options.threads = cpus > 0 ? cpus : 1;
+    }
+    if (this->options.batchSize == 0) {
+        this->options.batchSize = 1;
+    }
+}
+
+size_t DirectoryWalker::walk(const std::string &root, const BatchFn &onBatch) {
+    rootPrefix = root;
+    while (rootPrefix.size() > 1 && rootPrefix.back() == '/') rootPrefix.pop_back();
+    if (rootPrefix != "/") rootPrefix += "/";
+
+    int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("open root directory failed");
+        throw std::runtime_error("Failed to open directory: " + root);
+    }
+
+    files_found = 0;
+    outstanding = 0;
+    pushDirectory({fd, "", 0});
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < options.threads; i++) {
+        workers.emplace_back([this, &onBatch, i] {
+            char name[TRACE_NAME_LENGTH];
+            snprintf(name, sizeof(name), "walker %u", i);
+            Trace::attachThread(name);
+            workerLoop(onBatch);
+        });
+    }
+    workerLoop(onBatch);
+    for (std::thread &worker : workers) worker.join();
+    return files_found;
+}
+
+void DirectoryWalker::pushDirectory(PendingDir dir) {
+    {
+        std::lock_guard<std::mutex> lock(pendingLock);
+        if (dir.fd != -1) {
+            if (openDescriptors >= MAX_QUEUED_DESCRIPTORS) {
+                close(dir.fd);
+                dir.fd = -1;
+            } else {
+                openDescriptors++;
+            }
+        }
+        pending.push_back(std::move(dir));
+        outstanding++;
+    }
+    pendingCondition.notify_one();
+}
+
+void DirectoryWalker::workerLoop(const BatchFn &onBatch) {
+    std::vector<WalkEntry> batch;
+    while (true) {
+        PendingDir dir;
+        {
+            std::unique_lock<std::mutex> lock(pendingLock);
+            pendingCondition.wait(lock, [this] { return !pending.empty() || outstanding == 0; });
+            if (pending.empty()) {
+                break; // Every directory has been read
+            }
+            // Newest first keeps the stack (and the open descriptors) shallow
+            dir = std::move(pending.back());
+            pending.pop_back();
+            if (dir.fd != -1) openDescriptors--;
+        }
+
+        readDirectory(std::move(dir), batch, onBatch);
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(pendingLock);
+            done = --outstanding == 0;
+        }
+        if (done) {
+            pendingCondition.notify_all();
+        }
+    }
+    deliver(batch, onBatch);
+}
+
+void DirectoryWalker::readDirectory(PendingDir dir, std::vector<WalkEntry> &batch, const BatchFn &onBatch) {
+    TRACE_SCOPE("read directory");
+    std::string prefix = dir.path.empty() ? rootPrefix : rootPrefix + dir.path + "/";
+    if (dir.fd == -1) {
+        dir.fd = open(prefix.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir.fd == -1) {
+            std::cerr << "Unable to open directory " << prefix << ": " << strerror(errno) << std::endl;
+            return;
+        }
+    }
+    directories_visited++;
+
+    static thread_local std::vector<char> buffer(DIRENT_BUFFER_SIZE);
+    bool descend = options.maxDepth < 0 || dir.depth < options.maxDepth;
+    bool filtered = !options.include.empty() || !options.exclude.empty();
+
+    while (true) {
+        long n = syscall(SYS_getdents64, dir.fd, buffer.data(), buffer.size());
+        if (n == -1) {
+            std::cerr << "Unable to read directory " << prefix << ": " << strerror(errno) << std::endl;
+            break;
+        }
+        if (n == 0) break;
+
+        for (long pos = 0; pos < n;) {
+            const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64 *>(buffer.data() + pos);
+            pos += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            // Relative paths are only built when a filter or a subdirectory needs one
+            std::string relative;
+            if (filtered || entry->d_type == DT_DIR) {
+                relative = dir.path.empty() ? name : dir.path + "/" + name;
+                if (matches(options.exclude, relative, name)) continue;
+            }
+
+            unsigned char type = entry->d_type;
+            struct stat st;
+            bool haveStat = false;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                // No type from the filesystem, or a symlink: resolve what it points to
+                stat_calls++;
+                if (fstatat(dir.fd, name, &st, 0) == -1) continue;
+                haveStat = true;
+                if (S_ISREG(st.st_mode)) {
+                    type = DT_REG;
+                } else if (S_ISDIR(st.st_mode) && entry->d_type == DT_UNKNOWN) {
+                    type = DT_DIR;
+                } else {
+                    continue; // Symlinked directories and special files
+                }
+            }
+
+            if (type == DT_DIR) {
+                if (!descend) continue;
+                if (relative.empty()) relative = dir.path.empty() ? name : dir.path + "/" + name;
+                int fd = openat(dir.fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if (fd == -1) {
+                    std::cerr << "Unable to open directory " << prefix << name << ": " << strerror(errno) << std::endl;
+                    continue;
+                }
+                pushDirectory({fd, relative, dir.depth + 1});
+                continue;
+            }
+            if (type != DT_REG) continue;
+            if (!options.include.empty() && !matches(options.include, relative, name)) continue;
+
+            size_t size = 0;
+            int64_t mtimeNs = 0;
+            uint64_t inode = 0;
+            if (options.needSizes) {
+                if (!haveStat) {
+                    stat_calls++;
+                    if (fstatat(dir.fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) continue;
+                }
+                size = st.st_size;
+                mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+                inode = st.st_ino;
+            }
+            batch.push_back({prefix + name, size, mtimeNs, inode});
+            if (batch.size() >= options.batchSize) {
+                deliver(batch, onBatch);
+            }
+        }
+    }
+    close(dir.fd);
+}
+
+void DirectoryWalker::deliver(std::vector<WalkEntry> &batch, const BatchFn &onBatch) {
+    if (batch.empty()) return;
+    {
+        // Planning and submitting the batch, after any other walker thread's
+        TRACE_SCOPE("deliver", "files", batch.size());
+        std::lock_guard<std::mutex> lock(deliverLock);
+        onBatch(batch);
+    }
+    files_found += batch.size();
+    batch.clear();
+}
+
+bool DirectoryWalker::matches(const std::vector<std::string> &patterns, const std::string &relative,
+                              const char *name) const {
+    for (const std::string &pattern : patterns) {
+        bool onPath = pattern.find('/') != std::string::npos;
+        if (fnmatch(pattern.c_str(), onPath ? relative.c_str() : name, onPath ? FNM_PATHNAME : 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
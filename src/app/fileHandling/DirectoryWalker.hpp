@@ -0,0 +1,82 @@
+#ifndef DIRECTORY_WALKER_HPP
+#define DIRECTORY_WALKER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct WalkOptions {
+    unsigned threads = 0;   // 0: one per online CPU
+    int maxDepth = -1;      // Directory levels below the root to descend into, -1: unlimited
+    size_t batchSize = 256; // Files handed to the callback at a time
+    bool needSizes = true;  // fstatat every file for its size, mtime and inode; off, they are 0
+
+    // fnmatch globs. A pattern with a '/' matches the path relative to the root,
+    // any other pattern the entry name. Excluded directories are not descended into;
+    // with include patterns set, only files matching one of them are reported.
+    std::vector<std::string> include;
+    std::vector<std::string> exclude;
+};
+
+struct WalkEntry {
+    std::string path;
+    size_t size;
+    int64_t mtimeNs = 0;
+    uint64_t inode = 0;
+};
+
+// Parallel tree walker on getdents64/openat. Worker threads take directories from
+// a shared stack and read them in large getdents64 batches; the d_type of each entry
+// decides file or directory, so only symlinks and filesystems without d_type need an
+// fstatat. Subdirectories are opened relative to their parent's descriptor.
+// Found files are delivered in batches; the callback runs on the walker threads but
+// never concurrently with itself. Symlinked directories are not followed, like
+// recursive_directory_iterator.
+class DirectoryWalker {
+    public:
+        using BatchFn = std::function<void(const std::vector<WalkEntry> &batch)>;
+
+        DirectoryWalker(const WalkOptions &options);
+
+        // Walk the tree under root; throws if root cannot be opened. Returns the files found.
+        size_t walk(const std::string &root, const BatchFn &onBatch);
+
+        size_t directoriesVisited() const { return directories_visited; }
+        size_t statCalls() const { return stat_calls; }
+
+    private:
+        struct PendingDir {
+            int fd;           // Already opened by the parent's walker, or -1
+            std::string path; // Relative to the root, "" for the root itself
+            int depth;
+        };
+
+        void workerLoop(const BatchFn &onBatch);
+        void readDirectory(PendingDir dir, std::vector<WalkEntry> &batch, const BatchFn &onBatch);
+        void pushDirectory(PendingDir dir);
+        void deliver(std::vector<WalkEntry> &batch, const BatchFn &onBatch);
+        bool matches(const std::vector<std::string> &patterns, const std::string &relative, const char *name) const;
+
+        WalkOptions options;
+        std::string rootPrefix; // Root path with a trailing '/'
+
+        // Directories waiting to be read, and how many are pending or being read
+        std::mutex pendingLock;
+        std::condition_variable pendingCondition;
+        std::deque<PendingDir> pending;
+        size_t outstanding;
+        size_t openDescriptors;
+
+        std::mutex deliverLock;
+        std::atomic<size_t> files_found;
+        std::atomic<size_t> directories_visited;
+        std::atomic<size_t> stat_calls;
+};
+
+#endif
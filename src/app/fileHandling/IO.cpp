@@ -1,6 +1,13 @@
 #include <iostream>
 #include "IO.hpp"
+#include "../processes/Trace.hpp"
 #include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 IO::IO(const std::string &file_path) {
     file_stream.open(file_path, std::ios::in | std::ios::out | std::ios::binary);
@@ -17,4 +24,70 @@ IO::~IO() {
     if(file_stream.is_open()) {
         file_stream.close();
     }
-}
\ No newline at end of file
+}
+
+MappedIO::MappedIO(const char *file_path) : fd(-1), file_size(0) {
+    TRACE_SCOPE("open");
+    fd = open(file_path, O_RDWR);
+    if (fd == -1) {
+        std::cout << "Unable to open the file: " << file_path << std::endl;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat failed");
+        close(fd);
+        fd = -1;
+        return;
+    }
+    file_size = st.st_size;
+}
+
+bool MappedIO::forEachWindow(size_t offset, size_t length, size_t windowSize, bool syncWindows, const WindowFn &fn) {
+    if (fd == -1) return false;
+
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t end = std::min(offset + length, file_size);
+
+    while (offset < end) {
+        // mmap offsets must be page aligned, so map from the page holding offset
+        size_t mapStart = offset - (offset % pageSize);
+        size_t mapLength = std::min(windowSize, end - mapStart);
+
+        void *addr = mmap(nullptr, mapLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mapStart);
+        if (addr == MAP_FAILED) {
+            perror("mmap failed");
+            return false;
+        }
+        // Both are hints; huge pages are only honoured where the kernel supports them for files
+        madvise(addr, mapLength, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        madvise(addr, mapLength, MADV_HUGEPAGE);
+#endif
+
+        uint8_t *window = static_cast<uint8_t *>(addr);
+        size_t skip = offset - mapStart;
+        fn(window + skip, mapLength - skip, offset);
+
+        bool ok = true;
+        {
+            // The window's dirty pages go to the page cache here (and to disk with syncWindows)
+            TRACE_SCOPE("write", "bytes", mapLength - skip);
+            if (syncWindows && msync(addr, mapLength, MS_SYNC) == -1) {
+                perror("msync failed");
+                ok = false;
+            }
+            munmap(addr, mapLength);
+        }
+        if (!ok) return false;
+
+        offset = mapStart + mapLength;
+    }
+    return true;
+}
+
+MappedIO::~MappedIO() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
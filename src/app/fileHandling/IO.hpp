@@ -3,6 +3,9 @@
 
 #include <fstream>
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 
 class IO{
     public:
@@ -14,4 +17,27 @@ class IO{
         std::fstream file_stream;
 };
 
-#endif
\ No newline at end of file
+// Memory-mapped backend for in-place transforms of large files.
+// The file is mapped read/write one window at a time so the address-space
+// footprint stays bounded no matter how large the file is.
+class MappedIO {
+    public:
+        // Called for every mapped window with its address, length and file offset
+        using WindowFn = std::function<void(uint8_t *data, size_t length, size_t fileOffset)>;
+
+        MappedIO(const char *file_path);
+        ~MappedIO();
+
+        bool isOpen() const { return fd != -1; }
+        size_t size() const { return file_size; }
+
+        // Map [offset, offset + length) window by window and hand each one to fn.
+        // With syncWindows every window is msync'ed before it is unmapped.
+        bool forEachWindow(size_t offset, size_t length, size_t windowSize, bool syncWindows, const WindowFn &fn);
+
+    private:
+        int fd;
+        size_t file_size;
+};
+
+#endif
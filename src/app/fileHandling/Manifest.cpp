@@ -0,0 +1,195 @@
+#include "Manifest.hpp"
+#include <iostream>
+#include <algorithm>
+#include <unordered_set>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MANIFEST_MAGIC[8] = {'P', 'F', 'E', 'M', 'A', 'N', 'I', 'F'};
+static const uint32_t MANIFEST_VERSION = 1;
+
+// Entries are written out this many at a time while merging
+static const size_t WRITE_BATCH = 1 << 14;
+
+static_assert(sizeof(ManifestEntry) == 40, "the on-disk entry layout is fixed");
+
+Manifest::Manifest(const std::string &path)
+    : path(path), mapped(nullptr), mappedSize(0), table(nullptr), count(0) {
+    map();
+}
+
+Manifest::~Manifest() {
+    unmap();
+}
+
+void Manifest::map() {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            std::cerr << "Unable to open the manifest " << path << ": " << strerror(errno) << std::endl;
+        }
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        std::cerr << "Ignoring the truncated manifest " << path << std::endl;
+        close(fd);
+        return;
+    }
+    void *memory = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        perror("mmap manifest failed");
+        return;
+    }
+
+    const Header *header = static_cast<const Header *>(memory);
+    size_t entryBytes = st.st_size - sizeof(Header);
+    if (memcmp(header->magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0 || header->version != MANIFEST_VERSION ||
+        header->entrySize != sizeof(ManifestEntry) || header->count > entryBytes / sizeof(ManifestEntry)) {
+        std::cerr << "Ignoring the manifest " << path << ": not a version " << MANIFEST_VERSION << " manifest"
+                  << std::endl;
+        munmap(memory, st.st_size);
+        return;
+    }
+    mapped = memory;
+    mappedSize = st.st_size;
+    table = reinterpret_cast<const ManifestEntry *>(header + 1);
+    count = header->count;
+}
+
+void Manifest::unmap() {
+    if (mapped != nullptr) {
+        munmap(mapped, mappedSize);
+    }
+    mapped = nullptr;
+    mappedSize = 0;
+    table = nullptr;
+    count = 0;
+}
+
+const ManifestEntry *Manifest::find(uint64_t pathHash) const {
+    const ManifestEntry *end = table + count;
+    const ManifestEntry *entry = std::lower_bound(table, end, pathHash,
+        [](const ManifestEntry &e, uint64_t hash) { return e.pathHash < hash; });
+    return entry != end && entry->pathHash == pathHash ? entry : nullptr;
+}
+
+bool Manifest::isCurrent(const std::string &key, uint64_t size, int64_t mtimeNs, uint64_t inode,
+                         FileState state) const {
+    const ManifestEntry *entry = find(hashPath(key));
+    return entry != nullptr && entry->state == static_cast<uint32_t>(state) && entry->size == size &&
+           entry->mtimeNs == mtimeNs && entry->inode == inode;
+}
+
+void Manifest::expect(const std::string &key, const std::string &source, FileState state) {
+    pending.push_back({key, source, state});
+}
+
+static bool writeAll(int fd, const void *data, size_t length) {
+    const char *bytes = static_cast<const char *>(data);
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool Manifest::commit(const std::vector<std::string> &failedSources) {
+    recordedCount = 0;
+    if (pending.empty()) {
+        return true;
+    }
+
+    // The new entries, one per path hash (the last expectation wins)
+    std::unordered_set<std::string> failed(failedSources.begin(), failedSources.end());
+    std::vector<ManifestEntry> updates;
+    updates.reserve(pending.size());
+    for (const Pending &p : pending) {
+        if (failed.count(p.source) != 0) continue; // Not in the state it was expected in
+        struct stat st;
+        if (stat(p.source.c_str(), &st) == -1) continue; // Gone, or never processed
+        if (p.key != p.source && access(p.key.c_str(), F_OK) == -1) continue;
+        int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        updates.push_back({hashPath(p.key), static_cast<uint64_t>(st.st_size), mtimeNs,
+                           static_cast<uint64_t>(st.st_ino), static_cast<uint32_t>(p.state), 0});
+    }
+    std::stable_sort(updates.begin(), updates.end(),
+        [](const ManifestEntry &a, const ManifestEntry &b) { return a.pathHash < b.pathHash; });
+    std::vector<ManifestEntry> unique;
+    unique.reserve(updates.size());
+    for (const ManifestEntry &entry : updates) {
+        if (!unique.empty() && unique.back().pathHash == entry.pathHash) {
+            unique.back() = entry;
+        } else {
+            unique.push_back(entry);
+        }
+    }
+
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        std::cerr << "Unable to write the manifest " << temporary << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Merge the old table and the updates, both sorted by hash
+    Header header;
+    memcpy(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    header.version = MANIFEST_VERSION;
+    header.entrySize = sizeof(ManifestEntry);
+    header.count = 0;
+    header.reserved = 0;
+    bool ok = writeAll(fd, &header, sizeof(header));
+
+    std::vector<ManifestEntry> out;
+    out.reserve(WRITE_BATCH);
+    size_t i = 0;
+    size_t j = 0;
+    while (ok && (i < count || j < unique.size())) {
+        if (j == unique.size() || (i < count && table[i].pathHash < unique[j].pathHash)) {
+            out.push_back(table[i++]);
+        } else {
+            if (i < count && table[i].pathHash == unique[j].pathHash) i++; // Replaced
+            out.push_back(unique[j++]);
+        }
+        if (out.size() == WRITE_BATCH) {
+            ok = writeAll(fd, out.data(), out.size() * sizeof(ManifestEntry));
+            header.count += out.size();
+            out.clear();
+        }
+    }
+    if (ok && !out.empty()) {
+        ok = writeAll(fd, out.data(), out.size() * sizeof(ManifestEntry));
+        header.count += out.size();
+    }
+    ok = ok && pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ok = ok && fsync(fd) == 0;
+    if (close(fd) == -1) ok = false;
+    if (!ok || rename(temporary.c_str(), path.c_str()) == -1) {
+        std::cerr << "Failed to replace the manifest " << path << ": " << strerror(errno) << std::endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable
+    std::string directory = path.find('/') == std::string::npos ? "." : path.substr(0, path.rfind('/') + 1);
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+
+    pending.clear();
+    recordedCount = unique.size();
+    unmap();
+    map();
+    return true;
+}
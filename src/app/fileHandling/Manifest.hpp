@@ -0,0 +1,102 @@
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// What the bytes of a tracked file are
+enum class FileState : uint32_t {
+    PLAIN = 1,
+    ENCRYPTED = 2,
+};
+
+// One tracked file. The identity (size, mtime, inode) is the one of the file the
+// entry's contents came from: the file itself after an in-place run, the source
+// after an out-of-place run.
+struct ManifestEntry {
+    uint64_t pathHash;
+    uint64_t size;
+    int64_t mtimeNs;
+    uint64_t inode;
+    uint32_t state;
+    uint32_t reserved;
+};
+
+// Persistent index of the files earlier runs left in a known state, so a run can
+// skip what is unchanged and already in its target state (and never XOR a file twice).
+//
+// On disk: a header, then ManifestEntry records sorted by pathHash (FNV-1a of the
+// absolute path). The file is mapped read-only and searched in place. Updates are
+// collected during the run and merged into a new file that replaces the old one with
+// rename(), so a crash leaves either the old or the new manifest.
+// Two paths sharing a hash cannot make a file be skipped wrongly: the inode is part
+// of the identity that has to match.
+class Manifest {
+    public:
+        // Maps path if it exists; a missing or unreadable manifest starts empty
+        Manifest(const std::string &path);
+        ~Manifest();
+        Manifest(const Manifest &) = delete;
+        Manifest &operator=(const Manifest &) = delete;
+
+        // 64-bit FNV-1a: stable across builds and platforms, unlike std::hash
+        static uint64_t hashPath(const std::string &path) {
+            uint64_t hash = 14695981039346656037ull;
+            for (char c : path) {
+                hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        // The entry for a path hash, or nullptr
+        const ManifestEntry *find(uint64_t pathHash) const;
+
+        // True when the entry for key says it is already in state and the file it came
+        // from still has this size, mtime and inode
+        bool isCurrent(const std::string &key, uint64_t size, int64_t mtimeNs, uint64_t inode, FileState state) const;
+
+        // Record that key will be in state once the run is done; the identity is read
+        // from source at commit time, after the workers have written it.
+        // key and source differ for out-of-place runs, where key must exist by then.
+        void expect(const std::string &key, const std::string &source, FileState state);
+
+        // Merge the expected entries in and atomically replace the manifest file.
+        // Files the run failed on (by source) keep the entry they had, if any.
+        // Nothing is written when nothing was expected.
+        bool commit(const std::vector<std::string> &failedSources = {});
+
+        size_t entries() const { return count; }
+        size_t expected() const { return pending.size(); }
+        // Entries the last commit wrote or replaced
+        size_t recorded() const { return recordedCount; }
+
+    private:
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t entrySize;
+            uint64_t count;
+            uint64_t reserved;
+        };
+
+        struct Pending {
+            std::string key;
+            std::string source;
+            FileState state;
+        };
+
+        void map();
+        void unmap();
+
+        std::string path;
+        void *mapped;
+        size_t mappedSize;
+        const ManifestEntry *table;
+        size_t count;
+        std::vector<Pending> pending;
+        size_t recordedCount = 0;
+};
+
+#endif
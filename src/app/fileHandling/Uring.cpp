@@ -0,0 +1,137 @@
+#include <iostream>
+#include "Uring.hpp"
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int ioUringSetup(unsigned entries, struct io_uring_params *params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int ioUringRegister(int fd, unsigned opcode, const void *arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+Uring::Uring(unsigned entries) : ringFd(-1), entries(entries), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+    sqRingSize(0), cqRingSize(0), sqes(static_cast<io_uring_sqe *>(MAP_FAILED)), sqesSize(0),
+    sqLocalTail(0), toSubmit(0), enter_calls(0) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = ioUringSetup(entries, &params);
+    if (fd < 0) {
+        return; // Unavailable, callers fall back to the synchronous path
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        perror("mmap io_uring sq ring failed");
+        close(fd);
+        return;
+    }
+    cqRing = singleMmap ? sqRing
+                        : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqeMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqeMap == MAP_FAILED) {
+        perror("mmap io_uring rings failed");
+        if (sqeMap != MAP_FAILED) munmap(sqeMap, sqesSize);
+        if (!singleMmap && cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+        munmap(sqRing, sqRingSize);
+        sqRing = cqRing = MAP_FAILED;
+        close(fd);
+        return;
+    }
+    sqes = static_cast<struct io_uring_sqe *>(sqeMap);
+
+    char *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    char *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    this->entries = params.sq_entries;
+    sqLocalTail = *sqTail;
+    ringFd = fd;
+}
+
+bool Uring::registerBuffers(const struct iovec *buffers, unsigned count) {
+    if (ioUringRegister(ringFd, IORING_REGISTER_BUFFERS, buffers, count) < 0) {
+        perror("io_uring_register buffers failed");
+        return false;
+    }
+    return true;
+}
+
+struct io_uring_sqe *Uring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqLocalTail - head >= entries) {
+        return nullptr;
+    }
+    unsigned index = sqLocalTail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    sqLocalTail++;
+    toSubmit++;
+    return sqe;
+}
+
+int Uring::submitAndWait(unsigned waitFor) {
+    // Publish the new entries before the kernel looks at the tail
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+    while (true) {
+        enter_calls++;
+        int ret = ioUringEnter(ringFd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            perror("io_uring_enter failed");
+            return -1;
+        }
+        toSubmit -= std::min<unsigned>(toSubmit, ret);
+        return ret;
+    }
+}
+
+struct io_uring_cqe *Uring::peekCqe() {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &cqes[head & *cqMask];
+}
+
+void Uring::seenCqe() {
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+Uring::~Uring() {
+    if (ringFd == -1) {
+        return;
+    }
+    munmap(sqes, sqesSize);
+    if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+    munmap(sqRing, sqRingSize);
+    close(ringFd);
+}
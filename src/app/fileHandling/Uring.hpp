@@ -0,0 +1,59 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+
+// Minimal io_uring wrapper on the raw syscalls (no liburing dependency).
+// Owns one submission/completion ring pair; not thread safe.
+class Uring {
+    public:
+        Uring(unsigned entries);
+        ~Uring();
+
+        // False when the kernel (or a seccomp policy) refuses io_uring
+        bool isAvailable() const { return ringFd != -1; }
+
+        bool registerBuffers(const struct iovec *buffers, unsigned count);
+
+        // Next free submission entry, zeroed; nullptr when the submission ring is full
+        struct io_uring_sqe *getSqe();
+
+        // Submit everything queued with getSqe and wait for at least waitFor completions
+        int submitAndWait(unsigned waitFor);
+
+        // Completion access: peek the oldest completion, then mark it consumed
+        struct io_uring_cqe *peekCqe();
+        void seenCqe();
+
+        // io_uring_enter calls made so far, each one a syscall
+        size_t enterCalls() const { return enter_calls; }
+
+    private:
+        int ringFd;
+        unsigned entries;
+
+        void *sqRing;
+        void *cqRing;
+        size_t sqRingSize;
+        size_t cqRingSize;
+        struct io_uring_sqe *sqes;
+        size_t sqesSize;
+
+        unsigned *sqHead;
+        unsigned *sqTail;
+        unsigned *sqMask;
+        unsigned *sqArray;
+        unsigned *cqHead;
+        unsigned *cqTail;
+        unsigned *cqMask;
+        struct io_uring_cqe *cqes;
+
+        unsigned sqLocalTail;
+        unsigned toSubmit;
+        size_t enter_calls;
+};
+
+#endif
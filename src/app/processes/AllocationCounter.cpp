@@ -0,0 +1,32 @@
+#include "AllocationCounter.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Constant-initialized, so counting works from the first allocation of every thread
+static thread_local uint64_t allocations = 0;
+
+uint64_t allocationCount() {
+    return allocations;
+}
+
+// The array, nothrow and sized forms of the standard library all come through these two,
+// and its operator delete frees what they return
+void *operator new(std::size_t size) {
+    allocations++;
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    allocations++;
+    size_t align = static_cast<size_t>(alignment);
+    void *memory = std::aligned_alloc(align, (std::max(size, size_t(1)) + align - 1) / align * align);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
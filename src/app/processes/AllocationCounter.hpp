@@ -0,0 +1,11 @@
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <cstdint>
+
+// Heap allocations (operator new) the calling thread has made so far. Binaries that link
+// AllocationCounter.cpp replace the global operator new with one that counts, so a worker
+// can tell how many allocations each task made.
+uint64_t allocationCount();
+
+#endif
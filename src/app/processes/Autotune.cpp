@@ -0,0 +1,266 @@
+#include "Autotune.hpp"
+#include "WorkerEngine.hpp"
+#include "WorkerMetrics.hpp"
+#include "../encryptDecrypt/KeyMaterial.hpp"
+#include "../encryptDecrypt/Container.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <cstring>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Directories the probe opens at most, however few files they hold
+static const size_t PROBE_MAX_DIRECTORIES = 512;
+
+// Below this median size a run is dominated by open/stat/close, not by bytes
+static const uint64_t SMALL_FILE_SIZE = 64 << 10;
+
+static const size_t MIN_TUNED_CHUNK = 4 << 20;
+static const size_t MAX_TUNED_CHUNK = 256 << 20;
+
+static void sampleDirectory(const std::string &path, std::deque<std::string> &directories,
+                            std::vector<uint64_t> &sizes, std::vector<std::pair<uint64_t, std::string>> &largest) {
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    int dirFd = dirfd(dir);
+    while (struct dirent *entry = readdir(dir)) {
+        if (sizes.size() >= PROBE_SAMPLE_FILES) break;
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        std::string child = path + "/" + entry->d_name;
+        if (entry->d_type == DT_DIR) {
+            directories.push_back(child);
+            continue;
+        }
+        struct stat st;
+        if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) continue;
+        if (fstatat(dirFd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) continue;
+        if (S_ISDIR(st.st_mode)) {
+            directories.push_back(child);
+        } else if (S_ISREG(st.st_mode)) {
+            sizes.push_back(st.st_size);
+            largest.push_back({static_cast<uint64_t>(st.st_size), child});
+        }
+    }
+    closedir(dir);
+}
+
+// Read up to PROBE_READ_BYTES from the largest files, one MiB at a time
+static double measureReads(std::vector<std::pair<uint64_t, std::string>> &files) {
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    std::vector<char> buffer(1 << 20);
+    uint64_t total = 0;
+    uint64_t start = monotonicNs();
+    for (const auto &file : files) {
+        if (total >= PROBE_READ_BYTES || file.first == 0) break;
+        int fd = open(file.second.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) continue;
+        ssize_t n;
+        while (total < PROBE_READ_BYTES && (n = read(fd, buffer.data(), buffer.size())) > 0) {
+            total += n;
+        }
+        close(fd);
+    }
+    double seconds = (monotonicNs() - start) / 1e9;
+    return total > 0 && seconds > 0 ? total / seconds : 0;
+}
+
+// A source larger than the caches, taken a MiB at a time into a block the cipher is applied to.
+// With --container the block is sealed as a container chunk instead: the run's cipher and the
+// Poly1305 tag, not the xor pad the key material would apply.
+static double measureProcessing() {
+    std::vector<uint8_t> source(PROBE_READ_BYTES, 0x5a);
+    std::vector<uint8_t> block(1 << 20);
+    const KeyMaterial &material = KeyMaterial::get();
+    std::unique_ptr<Container> container;
+    if (containerFormat()) {
+        struct stat st = {};
+        st.st_size = static_cast<off_t>(source.size());
+        container.reset(new Container(runCipher(), st));
+    }
+    uint8_t tag[POLY1305_TAG_LENGTH];
+    auto process = [&](size_t offset) {
+        if (container) {
+            container->seal(offset / container->chunkSize(), block.data(), block.size(), tag);
+        } else {
+            material.apply(block.data(), block.size(), offset);
+        }
+    };
+
+    process(0); // Fault the pages in untimed
+    uint64_t start = monotonicNs();
+    for (size_t offset = 0; offset < source.size(); offset += block.size()) {
+        memcpy(block.data(), source.data() + offset, block.size());
+        process(offset);
+    }
+    double seconds = (monotonicNs() - start) / 1e9;
+    return seconds > 0 ? source.size() / seconds : 0;
+}
+
+WorkloadProbe probeWorkload(const std::vector<std::string> &paths) {
+    WorkloadProbe probe;
+    std::vector<uint64_t> sizes;
+    std::vector<std::pair<uint64_t, std::string>> largest;
+    std::deque<std::string> directories;
+    for (const std::string &path : paths) {
+        struct stat st;
+        if (stat(path.c_str(), &st) == -1) continue;
+        if (S_ISREG(st.st_mode)) {
+            sizes.push_back(st.st_size);
+            largest.push_back({static_cast<uint64_t>(st.st_size), path});
+        } else if (S_ISDIR(st.st_mode)) {
+            directories.push_back(path);
+        }
+    }
+    // Breadth first, so a deep tree is sampled across its top levels
+    size_t opened = 0;
+    while (!directories.empty() && sizes.size() < PROBE_SAMPLE_FILES && opened < PROBE_MAX_DIRECTORIES) {
+        std::string directory = directories.front();
+        directories.pop_front();
+        sampleDirectory(directory, directories, sizes, largest);
+        opened++;
+    }
+
+    probe.files = sizes.size();
+    if (!sizes.empty()) {
+        std::sort(sizes.begin(), sizes.end());
+        probe.medianSize = sizes[sizes.size() / 2];
+        probe.largestSize = sizes.back();
+        for (uint64_t size : sizes) probe.bytes += size;
+    }
+    probe.readBytesPerSecond = measureReads(largest);
+    probe.cpuBytesPerSecond = measureProcessing();
+    return probe;
+}
+
+TunedSettings chooseSettings(const WorkloadProbe &probe, size_t cpus, size_t maxWorkers) {
+    TunedSettings settings;
+    cpus = std::max<size_t>(1, cpus);
+    bool smallFiles = probe.files > 0 && probe.medianSize < SMALL_FILE_SIZE;
+    double cpuBytesPerSecond = probe.cpuBytesPerSecond * cpus;
+    bool ioBound = probe.readBytesPerSecond > 0 && probe.readBytesPerSecond < cpuBytesPerSecond / 2;
+
+    settings.sampled = probe.files > 0;
+    settings.uring = smallFiles || ioBound;
+    settings.workers = std::max<size_t>(1, std::min(ioBound ? 2 * cpus : cpus, maxWorkers));
+    settings.workload = !settings.sampled ? "unknown" : smallFiles ? "small files" : ioBound ? "I/O-bound" : "CPU-bound";
+
+    // Two chunks of the largest file per CPU, in powers of two
+    uint64_t target = probe.largestSize / (2 * cpus);
+    size_t chunk = MIN_TUNED_CHUNK;
+    while (chunk < MAX_TUNED_CHUNK && chunk * 2 <= target) chunk *= 2;
+    settings.chunkSize = chunk;
+    return settings;
+}
+
+WorkerTuner::WorkerTuner(WorkerEngine &engine, size_t startWorkers, size_t maxWorkers)
+    : engine(engine), maxWorkers(std::max<size_t>(1, maxWorkers)), active(0),
+      step(std::max<size_t>(1, startWorkers / 2)), direction(startWorkers < maxWorkers ? 1 : -1), turned(false),
+      bestCount(startWorkers), bestRate(0), stopping(false) {
+    setActive(std::max<size_t>(1, std::min(startWorkers, this->maxWorkers)));
+    bestCount = active;
+    thread = std::thread(&WorkerTuner::run, this);
+}
+
+WorkerTuner::~WorkerTuner() {
+    stop();
+}
+
+void WorkerTuner::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping) return;
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+void WorkerTuner::setActive(size_t count) {
+    if (count == active) return;
+    active = count;
+    engine.setActiveWorkers(count);
+}
+
+void WorkerTuner::settle() {
+    setActive(bestCount);
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "[autotune] settled on " << bestCount << " active workers ("
+         << bestRate / 1048576.0 << " MB/s)\n";
+    std::cout << line.str() << std::flush;
+}
+
+bool WorkerTuner::sample(double bytesPerSecond) {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "[autotune] " << active << " active workers: "
+         << bytesPerSecond / 1048576.0 << " MB/s\n";
+    std::cout << line.str() << std::flush;
+
+    size_t base = active;
+    if (bestRate == 0 || bytesPerSecond > bestRate * (1 + AUTOTUNE_MIN_GAIN)) {
+        bestRate = bytesPerSecond;
+        bestCount = active;
+    } else if (!turned) {
+        // No gain going this way: try the other side of the best count once
+        turned = true;
+        direction = -direction;
+        base = bestCount;
+    } else {
+        settle();
+        return false;
+    }
+
+    while (true) {
+        size_t next = direction > 0 ? std::min(base + step, maxWorkers) : (base > step ? base - step : 1);
+        if (next != base) {
+            setActive(next);
+            return true;
+        }
+        if (turned) {
+            settle();
+            return false;
+        }
+        turned = true;
+        direction = -direction;
+    }
+}
+
+void WorkerTuner::run() {
+    uint64_t startNs = monotonicNs();
+    uint64_t lastNs = startNs;
+    std::vector<WorkerStats> last = engine.workerStats();
+
+    std::unique_lock<std::mutex> guard(lock);
+    auto interval = std::chrono::duration<double>(AUTOTUNE_INTERVAL);
+    while (!wake.wait_for(guard, interval, [this] { return stopping; })) {
+        uint64_t now = monotonicNs();
+        std::vector<WorkerStats> stats = engine.workerStats();
+        double seconds = (now - lastNs) / 1e9;
+        uint64_t bytes = 0;
+        double waited = 0;
+        for (size_t i = 0; i < stats.size() && i < last.size(); i++) {
+            bytes += stats[i].bytes - last[i].bytes;
+            if (i < active) waited += stats[i].idleSeconds - last[i].idleSeconds;
+        }
+        last = stats;
+        lastNs = now;
+
+        if ((now - startNs) / 1e9 >= AUTOTUNE_WINDOW) {
+            settle();
+            return;
+        }
+        if (seconds <= 0 || bytes == 0 || waited > 0.5 * active * seconds) {
+            continue; // Starved of tasks (or drained), or no task ended: nothing to learn from
+        }
+        if (!sample(bytes / seconds)) {
+            return;
+        }
+    }
+}
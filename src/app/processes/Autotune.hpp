@@ -0,0 +1,91 @@
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+class WorkerEngine;
+
+// Files the probe stats and bytes it reads before a run, so it stays well under a second
+const size_t PROBE_SAMPLE_FILES = 4096;
+const size_t PROBE_READ_BYTES = 32 << 20;
+
+// What a quick look at the input of a run showed, before any worker starts
+struct WorkloadProbe {
+    size_t files = 0;           // Sampled, not the whole tree
+    uint64_t bytes = 0;
+    uint64_t medianSize = 0;
+    uint64_t largestSize = 0;
+    double readBytesPerSecond = 0; // Sequential reads of the largest sampled files, 0: nothing read
+    double cpuBytesPerSecond = 0;  // Copying out of memory and encrypting, on one CPU
+};
+
+// Stat up to PROBE_SAMPLE_FILES files under paths, breadth first, and time reading
+// up to PROBE_READ_BYTES of the largest of them, then the same amount copied from
+// memory and run through the cipher (sealed as container chunks with --container): what one
+// worker does to bytes that are already in the page cache
+WorkloadProbe probeWorkload(const std::vector<std::string> &paths);
+
+// The settings a probe suggests. Many small files are syscall-bound and storage
+// that cannot keep half the CPUs busy is I/O-bound: both go to io_uring, which keeps many
+// files in flight per worker, and I/O-bound runs start with twice as many workers as
+// CPUs. Large files on fast storage are CPU-bound: one worker per CPU, synchronous
+// I/O and chunks small enough that the largest files are shared by every CPU.
+// Without a sample (only a job list to read) just the worker count is tuned.
+struct TunedSettings {
+    size_t workers;    // Active workers to start with
+    bool sampled;      // false: keep the configured chunk size and backend
+    size_t chunkSize;
+    bool uring;
+    const char *workload; // "small files", "I/O-bound", "CPU-bound" or "unknown"
+};
+
+TunedSettings chooseSettings(const WorkloadProbe &probe, size_t cpus, size_t maxWorkers);
+
+// Seconds between throughput samples, and how long a run is tuned
+const double AUTOTUNE_INTERVAL = 0.5;
+const double AUTOTUNE_WINDOW = 6.0;
+
+// A change of the worker count is kept when throughput grows by this fraction
+const double AUTOTUNE_MIN_GAIN = 0.05;
+
+// Parent-side thread that hill-climbs the active worker count during the first
+// AUTOTUNE_WINDOW seconds of a run: it samples the bytes per second of the workers
+// every AUTOTUNE_INTERVAL, keeps stepping in a direction while throughput grows,
+// turns around once when it does not, and settles on the best count seen.
+// Intervals in which the active workers mostly waited for tasks say nothing about
+// the worker count (the producer is the bottleneck) and are skipped.
+class WorkerTuner {
+    public:
+        WorkerTuner(WorkerEngine &engine, size_t startWorkers, size_t maxWorkers);
+        ~WorkerTuner();
+        void stop();
+
+    private:
+        void run();
+        // One interval's throughput; false once settled
+        bool sample(double bytesPerSecond);
+        void setActive(size_t count);
+        void settle();
+
+        WorkerEngine &engine;
+        size_t maxWorkers;
+        size_t active;
+        size_t step;
+        int direction;
+        bool turned;
+        size_t bestCount;
+        double bestRate;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        bool stopping;
+        std::thread thread;
+};
+
+#endif
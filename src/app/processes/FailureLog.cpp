@@ -0,0 +1,96 @@
+#include "FailureLog.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static FailureLog *activeLog = nullptr;
+static int activeFd = -1;
+
+FailureLog::FailureLog() {
+    fd = memfd_create("cryption-failures", MFD_CLOEXEC);
+    if (fd == -1 || fcntl(fd, F_SETFL, O_APPEND) == -1) {
+        perror("memfd_create failure log failed");
+        if (fd != -1) close(fd);
+        throw std::runtime_error("Failed to create the failure log");
+    }
+}
+
+FailureLog::~FailureLog() {
+    if (activeLog == this) {
+        activeLog = nullptr;
+        activeFd = -1;
+    }
+    close(fd);
+}
+
+void FailureLog::activate(FailureLog *log) {
+    activeLog = log;
+    activeFd = log != nullptr ? log->fd : -1;
+}
+
+void FailureLog::record(const char *path, const char *note) {
+    if (activeFd == -1) {
+        return;
+    }
+    if (note == nullptr) {
+        note = "";
+    }
+    // One call per file: O_APPEND places each record whole after the others
+    struct iovec parts[2] = {{const_cast<char *>(path), strlen(path) + 1},
+                             {const_cast<char *>(note), strlen(note) + 1}};
+    ssize_t written;
+    do {
+        written = writev(activeFd, parts, 2);
+    } while (written == -1 && errno == EINTR);
+    if (written == -1) {
+        std::cerr << "Unable to report the failure of " << path << ": " << strerror(errno) << std::endl;
+    }
+}
+
+std::vector<FailedFile> FailureLog::files() const {
+    std::vector<FailedFile> failed;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        return failed;
+    }
+    std::string bytes(st.st_size, '\0');
+    ssize_t got = pread(fd, &bytes[0], bytes.size(), 0);
+    if (got < 0) {
+        perror("read failure log failed");
+        return failed;
+    }
+    bytes.resize(got);
+
+    std::unordered_map<std::string, size_t> seen; // Path to its index in failed
+    size_t at = 0;
+    auto field = [&]() {
+        size_t end = bytes.find('\0', at);
+        if (end == std::string::npos) end = bytes.size();
+        std::string value = bytes.substr(at, end - at);
+        at = end + 1;
+        return value;
+    };
+    while (at < bytes.size()) {
+        std::string path = field();
+        std::string note = at < bytes.size() ? field() : std::string();
+        if (path.empty()) {
+            continue;
+        }
+        auto known = seen.find(path);
+        if (known == seen.end()) {
+            seen.emplace(path, failed.size());
+            failed.push_back({std::move(path), std::move(note)});
+        } else if (failed[known->second].note.empty()) {
+            failed[known->second].note = std::move(note);
+        }
+    }
+    return failed;
+}
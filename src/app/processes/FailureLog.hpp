@@ -0,0 +1,42 @@
+#ifndef FAILURE_LOG_HPP
+#define FAILURE_LOG_HPP
+
+#include <string>
+#include <vector>
+
+// A file of the run that did not reach its target state
+struct FailedFile {
+    std::string path;
+    std::string note; // What state the file was left in, when that is not obvious
+};
+
+// The files of a run that did not reach their target state, reported by the workers
+// to the parent: it keeps them out of the manifest, lists them at the end and makes
+// the run exit non-zero.
+//
+// An anonymous file (memfd) opened with O_APPEND before the workers fork. A worker
+// appends a failed path and what became of the file, both NUL terminated, with one
+// writev(), so forked workers and threads share it without locks and it holds any
+// number of failures. The parent reads it back once the workers are done.
+class FailureLog {
+    public:
+        FailureLog();
+        ~FailureLog();
+        FailureLog(const FailureLog &) = delete;
+        FailureLog &operator=(const FailureLog &) = delete;
+
+        // Make log the one record() appends to (set before the workers are created)
+        static void activate(FailureLog *log);
+
+        // Report that path failed; a no-op without an active log
+        static void record(const char *path, const char *note = nullptr);
+
+        // The files reported so far, in the order they came, each once
+        // (with the first note given for it)
+        std::vector<FailedFile> files() const;
+
+    private:
+        int fd;
+};
+
+#endif
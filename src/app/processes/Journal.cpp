@@ -0,0 +1,583 @@
+#include "Journal.hpp"
+#include "../fileHandling/Manifest.hpp"
+#include "../encryptDecrypt/KeyMaterial.hpp"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nmmintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char JOURNAL_MAGIC[8] = {'P', 'F', 'E', 'J', 'O', 'U', 'R', 'N'};
+static const uint32_t JOURNAL_VERSION = 1;
+static const uint32_t RECORD_MAGIC = 0x454e4f44; // "DONE"
+static const size_t HEADER_BYTES = 4096;
+
+// A finished (path, range) in the log; length 0 runs to the end of the file.
+// The checksum covers the fields after it, so a torn append is recognised.
+struct DoneRecord {
+    uint32_t magic;
+    uint32_t checksum;
+    uint64_t pathHash;
+    uint64_t offset;
+    uint64_t length;
+};
+
+static_assert(sizeof(DoneRecord) == 32, "the on-disk record layout is fixed");
+
+// CRC-32C, with the SSE4.2 instruction where the CPU has it
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(const uint8_t *data, size_t length) {
+    uint64_t crc = 0xffffffff;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        crc = _mm_crc32_u64(crc, word);
+    }
+    for (; i < length; i++) {
+        crc = _mm_crc32_u8(static_cast<uint32_t>(crc), data[i]);
+    }
+    return static_cast<uint32_t>(crc) ^ 0xffffffff;
+}
+
+static uint32_t crc32cTable(const uint8_t *data, size_t length) {
+    static const auto table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+}
+
+static uint32_t crc32c(const uint8_t *data, size_t length) {
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    return hardware ? crc32cHardware(data, length) : crc32cTable(data, length);
+}
+
+static DoneRecord makeRecord(uint64_t pathHash, uint64_t offset, uint64_t length) {
+    DoneRecord record = {RECORD_MAGIC, 0, pathHash, offset, length};
+    record.checksum = crc32c(reinterpret_cast<const uint8_t *>(&record.pathHash), 24);
+    return record;
+}
+
+static size_t slotBytes() {
+    return (sizeof(JournalSlot) + 63) & ~size_t(63);
+}
+
+static size_t logOffsetFor(size_t slotCount, size_t slotSize) {
+    return (HEADER_BYTES + slotCount * slotSize + 4095) & ~size_t(4095);
+}
+
+static bool writeAll(int fd, const void *data, size_t length) {
+    const char *bytes = static_cast<const char *>(data);
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        length -= n;
+    }
+    return true;
+}
+
+// The journal of the run and the calling worker's slot in it
+static Journal *activeJournal = nullptr;
+static thread_local JournalSlot *workerSlot = nullptr;
+static thread_local std::vector<DoneRecord> finishedFiles;
+static thread_local uint64_t taskTicket = 0;
+
+void JournalSlot::beginTask(const std::vector<const char *> &taskPaths, uint64_t taskOffset, uint64_t taskLength,
+                            bool outOfPlace) {
+    size_t used = 0;
+    for (const char *p : taskPaths) {
+        size_t n = strlen(p) + 1;
+        if (used + n > sizeof(paths)) {
+            throw std::runtime_error("Task paths do not fit a journal slot");
+        }
+        memcpy(paths + used, p, n);
+        used += n;
+    }
+    offset = taskOffset;
+    length = taskLength;
+    fileCount = static_cast<uint32_t>(taskPaths.size());
+    pathBytes = static_cast<uint32_t>(used);
+    blocks[0].fileIndex = JournalBlock::NO_FILE;
+    blocks[0].length = 0;
+    current.store(0, std::memory_order_relaxed);
+    state.store(outOfPlace ? OUT_OF_PLACE : IN_PLACE, std::memory_order_release);
+    // Last: a slot that is idle with the ticket of a task has finished it
+    ticket.store(taskTicket, std::memory_order_release);
+}
+
+void JournalSlot::beginFile(uint32_t index) {
+    uint32_t next = 1 - current.load(std::memory_order_relaxed);
+    blocks[next].fileIndex = index;
+    blocks[next].offset = 0;
+    blocks[next].length = 0;
+    blocks[next].pages = 0;
+    current.store(next, std::memory_order_release);
+}
+
+void JournalSlot::beginBlock(uint64_t blockOffset, const uint8_t *data, size_t blockLength) {
+    uint32_t now = current.load(std::memory_order_relaxed);
+    JournalBlock &block = blocks[1 - now];
+    block.fileIndex = blocks[now].fileIndex;
+    block.offset = blockOffset;
+    block.length = blockLength;
+    block.pages = static_cast<uint32_t>((blockLength + JOURNAL_PAGE_SIZE - 1) / JOURNAL_PAGE_SIZE);
+    for (uint32_t i = 0; i < block.pages; i++) {
+        size_t start = i * JOURNAL_PAGE_SIZE;
+        block.checksums[i] = crc32c(data + start, std::min(JOURNAL_PAGE_SIZE, blockLength - start));
+    }
+    current.store(1 - now, std::memory_order_release);
+}
+
+void JournalSlot::endFile(bool done) {
+    uint32_t index = blocks[current.load(std::memory_order_relaxed)].fileIndex;
+    if (!done || index == JournalBlock::NO_FILE) {
+        return;
+    }
+    // Only the first file of a task carries a range
+    finishedFiles.push_back(makeRecord(Manifest::hashPath(path(index)), index == 0 ? offset : 0,
+                                       index == 0 ? length : 0));
+}
+
+void JournalSlot::endTask() {
+    if (!finishedFiles.empty() && activeJournal != nullptr) {
+        activeJournal->append(finishedFiles.data(), finishedFiles.size() * sizeof(DoneRecord));
+    }
+    finishedFiles.clear();
+    state.store(IDLE, std::memory_order_release);
+}
+
+const char *JournalSlot::path(uint32_t index) const {
+    const char *p = paths;
+    for (uint32_t i = 0; i < index && p < paths + pathBytes; i++) {
+        p += strlen(p) + 1;
+    }
+    return p;
+}
+
+Journal::Journal(const std::string &path, size_t workers, bool resume)
+    : path(path), workers(workers), fd(-1), header(nullptr), mappedSize(0), slots(nullptr), stopping(false) {
+    if (resume) {
+        recover();
+    }
+    create();
+}
+
+Journal::~Journal() {
+    stopGroupCommit();
+    if (activeJournal == this) {
+        activeJournal = nullptr;
+    }
+    if (header != nullptr) {
+        munmap(header, mappedSize);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+void Journal::activate(Journal *journal) {
+    activeJournal = journal;
+}
+
+Journal *Journal::active() {
+    return activeJournal;
+}
+
+void Journal::attachWorker(size_t worker) {
+    workerSlot = nullptr;
+    if (activeJournal == nullptr) {
+        return;
+    }
+    if (worker >= activeJournal->workers) {
+        std::cerr << "No journal slot for worker " << worker << ": its tasks are not journaled" << std::endl;
+        return;
+    }
+    workerSlot = &activeJournal->slot(worker);
+}
+
+JournalSlot *Journal::current() {
+    return workerSlot;
+}
+
+void Journal::setTicket(uint64_t ticket) {
+    taskTicket = ticket;
+}
+
+JournalSlot &Journal::slot(size_t worker) const {
+    return *reinterpret_cast<JournalSlot *>(reinterpret_cast<char *>(slots) + worker * slotBytes());
+}
+
+void Journal::addDone(const std::string &file, uint64_t offset, uint64_t length) {
+    done[Manifest::hashPath(file)].push_back({offset, length});
+}
+
+// Valid records of a log; a torn or foreign record is skipped
+void Journal::readLog(int logFd, uint64_t logOffset, uint64_t end, DoneMap &into) {
+    std::vector<DoneRecord> records(1 << 14);
+    uint64_t position = logOffset;
+    while (position + sizeof(DoneRecord) <= end) {
+        size_t want = std::min<uint64_t>(records.size(), (end - position) / sizeof(DoneRecord));
+        ssize_t got = pread(logFd, records.data(), want * sizeof(DoneRecord), position);
+        if (got <= 0) break;
+        size_t count = got / sizeof(DoneRecord);
+        for (size_t i = 0; i < count; i++) {
+            const DoneRecord &r = records[i];
+            if (r.magic == RECORD_MAGIC &&
+                r.checksum == crc32c(reinterpret_cast<const uint8_t *>(&r.pathHash), 24)) {
+                into[r.pathHash].push_back({r.offset, r.length});
+            }
+        }
+        if (count == 0) break;
+        position += count * sizeof(DoneRecord);
+    }
+}
+
+// Bring the block a worker died in to a consistent state: each page is either still
+// the original (XOR it), already transformed (leave it), or, where the worker was
+// stopped inside a page, transformed up to some byte; the checksum of the original
+// shows where, since the kernels store in ascending order.
+// Returns false when a page matches none of these.
+static bool repairBlock(const char *file, const JournalBlock &block) {
+    int fileFd = open(file, O_RDWR | O_CLOEXEC);
+    if (fileFd == -1) {
+        std::cerr << "Unable to open " << file << " to repair it: " << strerror(errno) << std::endl;
+        return false;
+    }
+    const KeyMaterial &key = KeyMaterial::get();
+    uint8_t page[JOURNAL_PAGE_SIZE];
+    uint8_t trial[JOURNAL_PAGE_SIZE];
+    bool ok = true;
+    size_t repaired = 0;
+    for (uint32_t i = 0; i < block.pages && ok; i++) {
+        uint64_t at = block.offset + i * JOURNAL_PAGE_SIZE;
+        size_t length = std::min<uint64_t>(JOURNAL_PAGE_SIZE, block.offset + block.length - at);
+        if (pread(fileFd, page, length, at) != static_cast<ssize_t>(length)) {
+            ok = false;
+            break;
+        }
+        uint32_t original = block.checksums[i];
+        if (crc32c(page, length) == original) {
+            key.apply(page, length, at); // Not reached by the worker
+        } else {
+            memcpy(trial, page, length);
+            key.apply(trial, length, at);
+            if (crc32c(trial, length) == original) {
+                continue; // Already transformed
+            }
+            // trial is the whole page undone: find the prefix that was transformed
+            memcpy(trial, page, length);
+            size_t split = 0;
+            while (split < length) {
+                key.apply(trial + split, 1, at + split);
+                split++;
+                if (crc32c(trial, length) == original) break;
+            }
+            if (split == length) {
+                ok = false;
+                break;
+            }
+            key.apply(page + split, length - split, at + split);
+        }
+        if (pwrite(fileFd, page, length, at) != static_cast<ssize_t>(length)) {
+            ok = false;
+            break;
+        }
+        repaired++;
+    }
+    // The old journal is replaced after this, so the repair has to be on disk first
+    if (fsync(fileFd) == -1) ok = false;
+    close(fileFd);
+    if (ok && repaired > 0) {
+        std::cout << "Journal: finished " << repaired << " interrupted pages of " << file << std::endl;
+    }
+    return ok;
+}
+
+// Settle the in-place task a worker died in: repair the block it was in and list what is
+// done. The rest of the task starts at file index, byte resumeAt (index == fileCount:
+// nothing is left). False when the block cannot be repaired; file index is then in an
+// unknown state and the rest starts after it.
+bool Journal::settle(const JournalSlot &slot, const DoneMap &logged, std::vector<DoneRange> &finished,
+                     uint32_t &index, uint64_t &resumeAt) {
+    const JournalBlock &block = slot.blocks[slot.current.load() & 1];
+    index = 0;
+    resumeAt = slot.offset;
+    if (block.fileIndex == JournalBlock::NO_FILE || block.fileIndex >= slot.fileCount) {
+        return true;
+    }
+
+    std::string file = slot.path(block.fileIndex);
+    uint64_t blockEnd = block.offset + block.length;
+    if (block.length > 0) {
+        // The worker may have died after logging the task: then all of it is done
+        std::vector<std::pair<uint64_t, uint64_t>> left = gaps(logged, file, blockEnd);
+        if (std::none_of(left.begin(), left.end(),
+                [&](const std::pair<uint64_t, uint64_t> &gap) { return gap.first + gap.second > block.offset; })) {
+            index = slot.fileCount;
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < block.fileIndex; i++) {
+        finished.push_back({slot.path(i), i == 0 ? slot.offset : 0, i == 0 ? slot.length : 0});
+    }
+    index = block.fileIndex;
+    resumeAt = index == 0 ? slot.offset : 0;
+    if (block.length == 0) {
+        return true;
+    }
+    if (!repairBlock(file.c_str(), block)) {
+        std::cerr << "Journal: cannot tell which bytes of " << file << " at [" << block.offset << ", +"
+                  << block.length << ") were transformed; the file is skipped and needs checking" << std::endl;
+        return false;
+    }
+    finished.push_back({file, resumeAt, blockEnd - resumeAt});
+    resumeAt = blockEnd;
+    return true;
+}
+
+void Journal::recover() {
+    int oldFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (oldFd == -1) {
+        // Starting over could XOR files a finished run already did a second time
+        throw std::runtime_error("No journal to resume at " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    void *memory = MAP_FAILED;
+    if (fstat(oldFd, &st) == 0 && static_cast<size_t>(st.st_size) >= HEADER_BYTES) {
+        memory = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, oldFd, 0);
+    }
+    const Header *old = static_cast<const Header *>(memory);
+    if (memory == MAP_FAILED || memcmp(old->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        old->version != JOURNAL_VERSION || old->slotSize != slotBytes() ||
+        old->logOffset != logOffsetFor(old->slotCount, old->slotSize) ||
+        old->logOffset > static_cast<uint64_t>(st.st_size)) {
+        if (memory != MAP_FAILED) munmap(memory, st.st_size);
+        close(oldFd);
+        throw std::runtime_error("Not a journal this version can resume: " + path);
+    }
+
+    readLog(oldFd, old->logOffset, st.st_size, done);
+    size_t interrupted = 0;
+    for (uint32_t i = 0; i < old->slotCount; i++) {
+        const JournalSlot &slot = *reinterpret_cast<const JournalSlot *>(
+            static_cast<const char *>(memory) + HEADER_BYTES + i * old->slotSize);
+        // An out-of-place copy rewrites its output from the source, so it is just redone
+        // The producer finds what is left of the task from the records
+        if (slot.state.load() == JournalSlot::IN_PLACE) {
+            std::vector<DoneRange> finished;
+            uint32_t index;
+            uint64_t resumeAt;
+            if (!settle(slot, done, finished, index, resumeAt)) {
+                unrecoverable.insert(Manifest::hashPath(slot.path(index)));
+            }
+            for (const DoneRange &range : finished) {
+                addDone(range.file, range.offset, range.length);
+            }
+            interrupted++;
+        }
+    }
+    munmap(memory, st.st_size);
+    close(oldFd);
+    std::cout << "Journal " << path << ": resuming with " << done.size() << " files done or started, "
+              << interrupted << " interrupted in-place tasks repaired." << std::endl;
+}
+
+// A fresh journal holding what is known to be done, swapped in with rename() so a
+// crash during recovery leaves the old journal to recover from again
+void Journal::create() {
+    size_t slotSize = slotBytes();
+    uint64_t logOffset = logOffsetFor(workers, slotSize);
+    std::string temporary = path + ".tmp";
+    int newFd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (newFd == -1) {
+        perror("open journal failed");
+        throw std::runtime_error("Failed to create the journal " + temporary);
+    }
+
+    std::vector<DoneRecord> records;
+    for (const auto &file : done) {
+        for (const auto &range : file.second) {
+            records.push_back(makeRecord(file.first, range.first, range.second));
+        }
+    }
+    Header fresh;
+    memset(static_cast<void *>(&fresh), 0, sizeof(fresh));
+    memcpy(fresh.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    fresh.version = JOURNAL_VERSION;
+    fresh.slotCount = static_cast<uint32_t>(workers);
+    fresh.slotSize = static_cast<uint32_t>(slotSize);
+    fresh.logOffset = logOffset;
+    bool ok = ftruncate(newFd, logOffset) == 0 &&
+              pwrite(newFd, &fresh, sizeof(fresh), 0) == static_cast<ssize_t>(sizeof(fresh)) &&
+              lseek(newFd, logOffset, SEEK_SET) != -1 &&
+              writeAll(newFd, records.data(), records.size() * sizeof(DoneRecord)) && fsync(newFd) == 0;
+    if (!ok || rename(temporary.c_str(), path.c_str()) == -1) {
+        perror("write journal failed");
+        close(newFd);
+        unlink(temporary.c_str());
+        throw std::runtime_error("Failed to create the journal " + path);
+    }
+    std::string directory = path.find('/') == std::string::npos ? "." : path.substr(0, path.rfind('/') + 1);
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+
+    // Appends from every worker go through this descriptor, inherited across fork
+    fcntl(newFd, F_SETFL, fcntl(newFd, F_GETFL) | O_APPEND);
+    mappedSize = logOffset;
+    void *memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, newFd, 0);
+    if (memory == MAP_FAILED) {
+        perror("mmap journal failed");
+        close(newFd);
+        throw std::runtime_error("Failed to map the journal");
+    }
+    fd = newFd;
+    header = static_cast<Header *>(memory);
+    slots = reinterpret_cast<JournalSlot *>(static_cast<char *>(memory) + HEADER_BYTES);
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> Journal::remaining(const std::string &file, uint64_t size) const {
+    if (unrecoverable.count(Manifest::hashPath(file))) {
+        return {};
+    }
+    return gaps(done, file, size);
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> Journal::gaps(const DoneMap &map, const std::string &file,
+                                                         uint64_t size) {
+    auto found = map.find(Manifest::hashPath(file));
+    if (found == map.end()) {
+        return {{0, size}};
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> covered;
+    for (const auto &range : found->second) {
+        uint64_t end = range.second == 0 ? size : std::min(size, range.first + range.second);
+        if (range.first < end) covered.push_back({range.first, end});
+    }
+    std::sort(covered.begin(), covered.end());
+
+    // The gaps between the covered intervals, as (offset, length)
+    std::vector<std::pair<uint64_t, uint64_t>> left;
+    uint64_t position = 0;
+    for (const auto &range : covered) {
+        if (range.first > position) left.push_back({position, range.first - position});
+        position = std::max(position, range.second);
+    }
+    if (position < size) left.push_back({position, size - position});
+    return left;
+}
+
+Journal::TakeOver Journal::takeOver(size_t worker, uint64_t ticket, uint32_t &index, uint64_t &resumeAt) {
+    JournalSlot &s = slot(worker);
+    auto release = [&s](TakeOver outcome) {
+        s.fileCount = 0;
+        s.state.store(JournalSlot::IDLE, std::memory_order_release);
+        return outcome;
+    };
+    if (s.ticket.load(std::memory_order_acquire) != ticket) {
+        return release(TakeOver::NOT_STARTED);
+    }
+    uint32_t state = s.state.load(std::memory_order_acquire);
+    if (state == JournalSlot::IDLE) {
+        return TakeOver::FINISHED;
+    }
+    if (state == JournalSlot::OUT_OF_PLACE) {
+        return release(TakeOver::NOT_STARTED);
+    }
+
+    DoneMap logged;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        readLog(fd, header->logOffset, st.st_size, logged);
+    }
+    std::vector<DoneRange> finished;
+    bool repaired = settle(s, logged, finished, index, resumeAt);
+    std::vector<DoneRecord> records;
+    for (const DoneRange &range : finished) {
+        records.push_back(makeRecord(Manifest::hashPath(range.file), range.offset, range.length));
+    }
+    if (!records.empty()) {
+        append(records.data(), records.size() * sizeof(DoneRecord));
+    }
+    return release(repaired ? TakeOver::PARTIAL : TakeOver::LOST);
+}
+
+void Journal::append(const void *records, size_t bytes) {
+    // O_APPEND makes each task's records one atomic append, whichever worker writes
+    if (!writeAll(fd, records, bytes)) {
+        perror("journal append failed");
+        return;
+    }
+    header->changes.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Journal::groupCommit() {
+    uint64_t committed = 0;
+    std::unique_lock<std::mutex> guard(commitLock);
+    while (!stopping) {
+        commitWake.wait_for(guard, std::chrono::duration<double>(JOURNAL_COMMIT_INTERVAL));
+        uint64_t changes = header->changes.load(std::memory_order_relaxed);
+        if (changes != committed) {
+            // One flush for every worker's appends and slot updates since the last one
+            fdatasync(fd);
+            committed = changes;
+        }
+    }
+}
+
+void Journal::startGroupCommit() {
+    if (!committer.joinable()) {
+        committer = std::thread(&Journal::groupCommit, this);
+    }
+}
+
+void Journal::stopGroupCommit() {
+    if (!committer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(commitLock);
+        stopping = true;
+    }
+    commitWake.notify_all();
+    committer.join();
+    fdatasync(fd);
+}
+
+void Journal::finish(bool complete) {
+    stopGroupCommit();
+    for (size_t i = 0; i < workers; i++) {
+        if (slot(i).state.load() != JournalSlot::IDLE) {
+            std::cout << "Journal " << path << " kept: worker " << i
+                      << " did not finish its last task, run again with --resume." << std::endl;
+            return;
+        }
+    }
+    if (!complete) {
+        std::cout << "Journal " << path << " kept: the run left files undone, run again with --resume." << std::endl;
+        return;
+    }
+    if (unlink(path.c_str()) == -1) {
+        perror("unlink journal failed");
+    }
+}
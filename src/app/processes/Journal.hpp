@@ -0,0 +1,180 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+
+// In-place blocks are journaled this many bytes at a time, with one checksum per page
+const size_t JOURNAL_BLOCK_SIZE = 1 << 20;
+const size_t JOURNAL_PAGE_SIZE = 4096;
+const size_t JOURNAL_BLOCK_PAGES = JOURNAL_BLOCK_SIZE / JOURNAL_PAGE_SIZE;
+
+// Seconds between the fdatasync calls that commit journal appends as a group
+const double JOURNAL_COMMIT_INTERVAL = 0.1;
+
+// The block an in-place task is about to transform: which file of the task, where,
+// and a checksum of every page of it as it was before
+struct JournalBlock {
+    uint32_t fileIndex;   // Position in the task's path list, NO_FILE before the first
+    uint32_t pages;
+    uint64_t offset;
+    uint64_t length;      // 0: the file was started, no block yet
+    uint32_t checksums[JOURNAL_BLOCK_PAGES];
+
+    static const uint32_t NO_FILE = UINT32_MAX;
+};
+
+// One worker's view of the journal, in the shared mapping of the journal file.
+// The task a worker runs is copied in before it starts. Before a block is XORed the
+// worker fills in the descriptor not in use and then switches `current` to it, so
+// whatever point the worker dies at, `current` names a complete descriptor of the
+// last block it may have touched.
+struct JournalSlot {
+    enum State : uint32_t {
+        IDLE = 0,
+        IN_PLACE = 1,
+        OUT_OF_PLACE = 2, // Idempotent: an interrupted copy is simply redone
+    };
+
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> current;
+    std::atomic<uint64_t> ticket; // The worker's number for the task, see Journal::setTicket
+    uint64_t offset;      // The task's range, of its first file
+    uint64_t length;
+    uint32_t fileCount;
+    uint32_t pathBytes;
+    char paths[PATH_MAX + 64]; // fileCount NUL-terminated paths back to back
+    JournalBlock blocks[2];
+
+    // Called by the worker owning the slot, around and during a task
+    void beginTask(const std::vector<const char *> &taskPaths, uint64_t taskOffset, uint64_t taskLength,
+                   bool outOfPlace);
+    void beginFile(uint32_t index);
+    void beginBlock(uint64_t blockOffset, const uint8_t *data, size_t blockLength);
+    void endFile(bool done);
+    void endTask();
+
+    // The path at index of the task in the slot
+    const char *path(uint32_t index) const;
+};
+
+// Durable record of a run's progress, so an interrupted run (parent or worker killed,
+// machine down) can be resumed with --resume instead of starting over, and without
+// XORing any byte twice.
+//
+// The journal file holds a header, one JournalSlot per worker, mapped shared by all
+// of them, and an append-only log of DONE records: a (path, range) a worker finished.
+// A worker appends the records of a task with one write() when the task is done; a
+// thread of the parent makes them durable with one fdatasync every
+// JOURNAL_COMMIT_INTERVAL for all workers together (group commit).
+//
+// Resuming reads the log, finishes the blocks the slots show in flight (a page whose
+// checksum matches the original still needs the XOR, one matching after it is done)
+// along with the rest of their files, and leaves the producer only what no record
+// covers. A killed process loses nothing: the mapping and the appends are in the page
+// cache. A power cut can lose the last interval of appends, whose files are then
+// redone from scratch, so it is only exact for files recorded before the last commit.
+// Records are keyed by the path as the run walked it: resume with the same command.
+class Journal {
+    public:
+        // Create the journal at path for workers worker slots. With resume, the journal
+        // left there is recovered first.
+        Journal(const std::string &path, size_t workers, bool resume);
+        ~Journal();
+        Journal(const Journal &) = delete;
+        Journal &operator=(const Journal &) = delete;
+
+        // Make journal the one workers created from now on report to
+        // (set before the workers are created, so forked workers inherit it)
+        static void activate(Journal *journal);
+        static Journal *active();
+        // Bind the calling worker to its slot; a no-op without an active journal
+        static void attachWorker(size_t worker);
+        // The calling worker's slot, nullptr when the run is not journaled
+        static JournalSlot *current();
+        // Number the calling worker's next task, so takeOver can tell it apart
+        static void setTicket(uint64_t ticket);
+
+        // How far the task with ticket got when the worker on slot worker died
+        enum class TakeOver {
+            NOT_STARTED, // Redo all of it
+            FINISHED,    // Nothing left
+            PARTIAL,     // Left: file index of the task from byte resumeAt, and the files after it
+            LOST,        // File index is in an unknown state; left: the files after it
+        };
+        // Called by the parent once the worker is gone. An in-place block it was in is
+        // repaired and what it finished is logged; the slot is free again afterwards.
+        TakeOver takeOver(size_t worker, uint64_t ticket, uint32_t &index, uint64_t &resumeAt);
+
+        // The ranges of a walked file of size bytes a resumed run still has to do:
+        // none when it is done, [0, size) when it was never started
+        std::vector<std::pair<uint64_t, uint64_t>> remaining(const std::string &path, uint64_t size) const;
+        bool resuming() const { return !done.empty() || !unrecoverable.empty(); }
+
+        // Start the group commit thread (after the workers are forked)
+        void startGroupCommit();
+        // Stop committing and, when every worker finished its last task and the run left
+        // nothing undone (complete), remove the journal: there is nothing to resume
+        void finish(bool complete = true);
+
+        // Called from JournalSlot::endTask in the workers
+        void append(const void *records, size_t bytes);
+
+    private:
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t slotCount;
+            uint32_t slotSize;
+            uint32_t reserved;
+            uint64_t logOffset;
+            std::atomic<uint64_t> changes; // Bumped by every append
+        };
+
+        // path hash -> finished [offset, length) ranges (length 0: to the end)
+        using DoneMap = std::unordered_map<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>>;
+        struct DoneRange {
+            std::string file;
+            uint64_t offset;
+            uint64_t length;
+        };
+
+        static void readLog(int fd, uint64_t logOffset, uint64_t end, DoneMap &into);
+        static std::vector<std::pair<uint64_t, uint64_t>> gaps(const DoneMap &map, const std::string &file,
+                                                               uint64_t size);
+        static bool settle(const JournalSlot &slot, const DoneMap &logged, std::vector<DoneRange> &finished,
+                           uint32_t &index, uint64_t &resumeAt);
+        JournalSlot &slot(size_t worker) const;
+        void recover();
+        void create();
+        void groupCommit();
+        void stopGroupCommit();
+        void addDone(const std::string &path, uint64_t offset, uint64_t length);
+
+        std::string path;
+        size_t workers;
+        int fd;
+        Header *header;
+        size_t mappedSize;
+        JournalSlot *slots;
+
+        DoneMap done;
+        std::unordered_set<uint64_t> unrecoverable;
+
+        std::thread committer;
+        std::mutex commitLock;
+        std::condition_variable commitWake;
+        bool stopping;
+};
+
+#endif
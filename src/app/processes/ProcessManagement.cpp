@@ -3,26 +3,60 @@
 #include <cstring>
 #include <sys/wait.h>
 #include "../encryptDecrypt/Cryption.hpp" // Assuming this exists and handles the actual crypto
+#include "../encryptDecrypt/UringCryption.hpp"
+#include "Journal.hpp"
+#include "Trace.hpp"
+#include "FailureLog.hpp"
+#include <cstdio>
+#include <cstdlib>
 #include <ctime>
+#include <algorithm>
+#include <climits>
 #include <iomanip>
 #include <sys/mman.h>
-#include <atomic>
 #include <sys/fcntl.h>
 #include <unistd.h> // For fork, exit
 
-ProcessManagement::ProcessManagement() {
-    // Clean up previous semaphores and shared memory in case of a crash
-    sem_unlink("/items_semaphore");
-    sem_unlink("/empty_slots_semaphore");
-    shm_unlink(SHM_NAME);
-
-    itemsSemaphore = sem_open("/items_semaphore", O_CREAT, 0666, 0); // Initially 0 items
-    emptySlotsSemaphore = sem_open("/empty_slots_semaphore", O_CREAT, 0666, 1000); // 1000 empty slots
+ProcessManagement::ProcessManagement(const EngineOptions &options)
+    : sharedMem(static_cast<SharedMemory *>(MAP_FAILED)), sharedSize(0), nextShard(0), shmFd(-1), options(options),
+      finishing(false), stopped(false), liveWorkers(0), respawns(0) {
+    sigemptyset(&savedMask);
+}
 
-    if (itemsSemaphore == SEM_FAILED || emptySlotsSemaphore == SEM_FAILED) {
-        perror("sem_open failed");
-        throw std::runtime_error("Failed to open semaphores");
+// Report every file of a task that is not going to be finished, so the run fails
+// and names them at the end
+static void recordDropped(const Task &task, const char *note) {
+    FailureLog::record(task.filePath.c_str(), note);
+    for (const std::string &file : task.batchFiles) {
+        FailureLog::record(file.c_str(), note);
     }
+}
+
+// Taken by the thread that forks, so a worker never starts with stdout or stderr
+// locked by a parent thread that does not exist in it
+static void lockStdio() {
+    flockfile(stdout);
+    flockfile(stderr);
+}
+
+static void unlockStdio() {
+    funlockfile(stderr);
+    funlockfile(stdout);
+}
+
+// The segment is sized for the worker count, so it is created along with the workers.
+// The queue depth is split between the shards.
+void ProcessManagement::createSharedMemory(size_t numWorkers, size_t shards) {
+    size_t queueDepth = (options.queueDepth + shards - 1) / shards;
+    size_t arenaBytes = SharedTaskQueue::defaultArenaBytes(queueDepth);
+    size_t page = sysconf(_SC_PAGESIZE);
+    auto pageAlign = [page](size_t bytes) { return (bytes + page - 1) / page * page; };
+    size_t shardOffset = pageAlign(sizeof(SharedMemory) + numWorkers * (sizeof(WorkerCounters) + sizeof(WorkerWatch)));
+    size_t shardBytes = pageAlign(SharedTaskQueue::regionSize(queueDepth, arenaBytes));
+    sharedSize = shardOffset + shards * shardBytes;
+
+    // Clean up previous shared memory in case of a crash
+    shm_unlink(SHM_NAME);
 
     shmFd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
     if (shmFd == -1) {
@@ -30,148 +64,550 @@ ProcessManagement::ProcessManagement() {
         throw std::runtime_error("Failed to open shared memory");
     }
 
-    if (ftruncate(shmFd, sizeof(SharedMemory)) == -1) {
+    if (ftruncate(shmFd, sharedSize) == -1) {
         perror("ftruncate failed");
         close(shmFd);
         throw std::runtime_error("Failed to truncate shared memory");
     }
 
-    sharedMem = static_cast<SharedMemory *>(mmap(nullptr, sizeof(SharedMemory), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0));
+    sharedMem = static_cast<SharedMemory *>(mmap(nullptr, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0));
     if (sharedMem == MAP_FAILED) {
         perror("mmap failed");
         close(shmFd);
         throw std::runtime_error("Failed to map shared memory");
     }
 
-    // Initialize shared memory
-    sharedMem->front = 0;
-    sharedMem->rear = 0;
-    sharedMem->size.store(0);
-    sharedMem->producerFinished.store(false); // Producer is not finished initially
+    // Initialize shared memory: the worker counters and watches follow the header, then the task queue.
+    // A fresh mapping is zeroed, so every in-flight entry starts free.
+    sharedMem->queueDepth = TaskRing::roundCapacity(queueDepth);
+    sharedMem->arenaBytes = arenaBytes;
+    sharedMem->workerCount = numWorkers;
+    sharedMem->shardCount = shards;
+    sharedMem->shardOffset = shardOffset;
+    sharedMem->shardBytes = shardBytes;
+    sharedMem->requeuing.store(0);
+    sharedMem->activeWorkers.store(numWorkers);
+    sharedMem->activeEvent.store(0);
+    sharedMem->finished.store(0);
+    for (size_t i = 0; i < numWorkers; i++) {
+        sharedMem->counters()[i].reset();
+    }
+    // Each shard's pages come from its node: placed before the queue first touches them
+    for (size_t i = 0; i < shards; i++) {
+        if (shards > 1) {
+            Topology::get().preferMemory(sharedMem->shard(i), shardBytes, i);
+        }
+        queues.push_back(std::make_unique<SharedTaskQueue>(sharedMem->shard(i), queueDepth, arenaBytes));
+    }
 }
 
-bool ProcessManagement::submitTaskToSharedQueue(const std::string& taskString) {
-    // Wait for an empty slot
-    if (sem_wait(emptySlotsSemaphore) == -1) {
-        perror("sem_wait emptySlotsSemaphore failed");
-        return false;
+void ProcessManagement::setActiveWorkers(size_t count) {
+    if (sharedMem == MAP_FAILED) {
+        return;
     }
+    sharedMem->activeWorkers.store(static_cast<uint32_t>(std::max<size_t>(1, count)));
+    sharedMem->activeEvent.fetch_add(1);
+    futexWake(sharedMem->activeEvent, INT_MAX);
+}
 
-    // Acquire lock to safely modify shared memory
-    std::unique_lock<std::mutex> lock(queueLock);
-    if (sharedMem->size.load() >= 1000) { // Should ideally not happen due to semaphore
-        lock.unlock();
-        sem_post(emptySlotsSemaphore); // Release the slot we just acquired
-        return false;
+std::vector<WorkerStats> ProcessManagement::workerStats() const {
+    std::vector<WorkerStats> stats;
+    if (sharedMem == MAP_FAILED) {
+        return stats;
     }
+    for (size_t i = 0; i < sharedMem->workerCount; i++) {
+        stats.push_back(WorkerStats::from(sharedMem->counters()[i]));
+    }
+    return stats;
+}
 
-    strcpy(sharedMem->tasks[sharedMem->rear], taskString.c_str());
-    sharedMem->rear = (sharedMem->rear + 1) % 1000;
-    sharedMem->size.fetch_add(1); // Increment task count
-    lock.unlock();
+bool ProcessManagement::submitTaskToSharedQueue(const Task &task) {
+    // Blocks (on a futex) while the ring or the record arena is full: a long "submit"
+    // in the trace is the producer stalled on the workers
+    TRACE_SCOPE("submit", "files", task.fileCount());
+    SharedTaskQueue &queue = shortestQueue();
+    if (queue.push(task)) {
+        return true;
+    }
+    recordDropped(task, queue.abandoned() ? "not run: no workers were left" : "path too long for the task queue");
+    return false;
+}
 
-    // Signal that an item is available
-    if (sem_post(itemsSemaphore) == -1) {
-        perror("sem_post itemsSemaphore failed");
-        return false;
+SharedTaskQueue &ProcessManagement::shortestQueue() {
+    if (queues.size() == 1) {
+        return *queues[0];
     }
-    return true;
+    // Ties go round-robin, so an even load spreads evenly
+    size_t start = nextShard.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    size_t best = start;
+    size_t bestQueued = queues[start]->queued();
+    for (size_t i = 1; i < queues.size() && bestQueued > 0; i++) {
+        size_t shard = (start + i) % queues.size();
+        size_t queued = queues[shard]->queued();
+        if (queued < bestQueued) {
+            best = shard;
+            bestQueued = queued;
+        }
+    }
+    return *queues[best];
 }
 
-void ProcessManagement::executeTaskFromSharedQueue() {
-    // Loop continuously, trying to get tasks until producer is finished AND queue is empty
+const TaskRecord *ProcessManagement::takeTask(size_t worker, bool blocking, uint64_t &position, uint32_t &shard) {
+    size_t ownShard = places[worker].node;
+    size_t count = queues.size();
     while (true) {
-        // Try to wait for an item, but don't block indefinitely if producer is finished
-        if (sem_trywait(itemsSemaphore) == -1) {
-            if (errno == EAGAIN) { // No items currently
-                if (sharedMem->producerFinished.load() && sharedMem->size.load() == 0) {
-                    // Producer finished and queue is empty, so this worker can exit
-                    break;
-                }
-                // Small sleep to avoid busy-waiting if no items
-                usleep(10000); // 10ms
+        if (worker >= sharedMem->activeWorkers.load()) {
+            // Parked: the event-count pattern of TaskRing, so a change cannot be missed
+            if (!blocking) {
+                return nullptr;
+            }
+            uint32_t event = sharedMem->activeEvent.load();
+            if (worker < sharedMem->activeWorkers.load()) {
                 continue;
-            } else {
-                perror("sem_trywait itemsSemaphore failed");
-                break; // Error, exit worker
             }
+            if (sharedMem->finished.load() != 0) {
+                return nullptr;
+            }
+            futexWait(sharedMem->activeEvent, event);
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            shard = static_cast<uint32_t>((ownShard + i) % count);
+            if (const TaskRecord *record = queues[shard]->tryPop(&position)) {
+                return record;
+            }
+        }
+        if (!blocking) {
+            return nullptr;
         }
+        shard = static_cast<uint32_t>(ownShard);
+        if (const TaskRecord *record = queues[ownShard]->pop(&position)) {
+            return record;
+        }
+        // The own shard is finished and drained. Work may still be left in another one,
+        // or be on its way back from a worker that died.
+        bool left = sharedMem->requeuing.load() != 0;
+        for (size_t i = 0; i < count && !left; i++) {
+            left = queues[i]->queued() > 0;
+        }
+        if (!left) {
+            return nullptr;
+        }
+        usleep(1000);
+    }
+}
+
+// Note a popped record in a free in-flight entry and number its task.
+// nullptr when every entry is taken; the record then goes unwatched.
+static InFlight *track(WorkerWatch &watch, uint32_t shard, uint64_t position) {
+    for (InFlight &entry : watch.entries) {
+        if (entry.position.load(std::memory_order_relaxed) == 0) {
+            uint64_t ticket = watch.tickets.fetch_add(1, std::memory_order_relaxed) + 1;
+            entry.ticket.store(ticket, std::memory_order_relaxed);
+            entry.executed.store(0, std::memory_order_relaxed);
+            entry.shard.store(shard, std::memory_order_relaxed);
+            entry.position.store(position + 1, std::memory_order_release);
+            Journal::setTicket(ticket);
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// The entry is marked executed before the record is released and freed after, so the
+// supervisor never takes an executed task for an interrupted one
+static void releaseTracked(SharedTaskQueue &queue, InFlight *entry, const TaskRecord *record) {
+    if (entry != nullptr) {
+        entry->executed.store(1, std::memory_order_release);
+    }
+    queue.release(record);
+    if (entry != nullptr) {
+        entry->position.store(0, std::memory_order_release);
+    }
+}
 
-        // Acquire lock to safely modify shared memory
-        std::unique_lock<std::mutex> lock(queueLock);
-        if (sharedMem->size.load() == 0) { // Should ideally not happen due to semaphore
-             lock.unlock();
-             sem_post(itemsSemaphore); // Release the item we just acquired (if any)
-             continue;
+void ProcessManagement::executeTaskFromSharedQueue(size_t worker) {
+    WorkerCounters &me = sharedMem->counters()[worker];
+    WorkerWatch &watch = sharedMem->watches()[worker];
+    Journal::attachWorker(worker);
+    Trace::attachWorker(worker);
+    if (options.uring) {
+        UringCryption pipeline(KeyMaterial::get());
+        if (pipeline.isAvailable()) {
+            pipeline.setCounters(&me);
+            pipeline.run(
+                [this, &watch, worker](bool blocking) {
+                    uint64_t position;
+                    uint32_t shard;
+                    const TaskRecord *record = takeTask(worker, blocking, position, shard);
+                    if (record != nullptr) track(watch, shard, position);
+                    return record;
+                },
+                [this, &watch](const TaskRecord *record) {
+                    size_t shard = 0;
+                    while (shard + 1 < queues.size() && !queues[shard]->holds(record)) shard++;
+                    InFlight *entry = nullptr;
+                    for (InFlight &e : watch.entries) {
+                        uint64_t stored = e.position.load(std::memory_order_relaxed);
+                        if (stored != 0 && e.shard.load(std::memory_order_relaxed) == shard &&
+                            queues[shard]->record(stored - 1) == record) {
+                            entry = &e;
+                        }
+                    }
+                    releaseTracked(*queues[shard], entry, record);
+                });
+            std::cout << "[PID " << getpid() << "] io_uring: " << pipeline.filesDone() << " files, "
+                      << pipeline.syscalls() << " io_uring_enter calls" << std::endl;
+            return;
         }
+        std::cout << "[PID " << getpid() << "] io_uring unavailable, using synchronous I/O" << std::endl;
+    }
 
-        char taskStr[256];
-        strcpy(taskStr, sharedMem->tasks[sharedMem->front]);
-        sharedMem->front = (sharedMem->front + 1) % 1000;
-        sharedMem->size.fetch_sub(1); // Decrement task count
-        lock.unlock();
+    // Records are used in place in the arena and released once the file is done.
+    // A ready task counts as queue wait; sleeping until the producer adds one counts as idle.
+    while (true) {
+        uint64_t waitStart = monotonicNs();
+        uint64_t position;
+        uint32_t shard;
+        const TaskRecord *record = takeTask(worker, false, position, shard);
+        uint64_t start = monotonicNs();
+        if (record != nullptr) {
+            WorkerCounters::add(me.queueWaitNs, start - waitStart);
+            TRACE_SPAN("dequeue", waitStart, start);
+        } else {
+            // Sleeps while the rings are empty, returns nullptr once the producer is finished and they are drained
+            record = takeTask(worker, true, position, shard);
+            start = monotonicNs();
+            WorkerCounters::add(me.idleNs, start - waitStart);
+            TRACE_SPAN("idle", waitStart, start);
+            if (record == nullptr) break;
+        }
 
-        // Signal that an empty slot is available
-        if (sem_post(emptySlotsSemaphore) == -1) {
-            perror("sem_post emptySlotsSemaphore failed");
-            // This is a critical error, but for a worker process, just log and continue/exit
+        if (options.logTasks) {
+            std::cout << "[PID " << getpid() << "] Executing task: " << record->path;
+            if (record->offset != 0 || record->length != 0) {
+                std::cout << " [" << record->offset << ", +" << record->length << ")";
+            }
+            if (record->fileCount > 1) {
+                std::cout << " (+" << record->fileCount - 1 << " more files)";
+            }
+            std::cout << std::endl;
         }
+        size_t bytes = 0;
+        size_t files = record->offset == 0 ? record->fileCount : 0; // A chunked file counts once
+        InFlight *entry = track(watch, shard, position);
+        AllocationMark mark;
+        executeCryption(*record, &bytes);
+        mark.addSince(me);
+        releaseTracked(*queues[shard], entry, record);
 
-        std::cout << "[PID " << getpid() << "] Executing task: " << taskStr << std::endl;
-        // Call your actual encryption/decryption function
-        // Make sure executeCryption handles its own errors and doesn't rely on std::cin/cout directly
-        executeCryption(taskStr);
+        uint64_t end = monotonicNs();
+        WorkerCounters::add(me.busyNs, end - start);
+        TRACE_SPAN("task", start, end, "bytes", bytes);
+        WorkerCounters::add(me.tasks, 1);
+        WorkerCounters::add(me.files, files);
+        WorkerCounters::add(me.bytes, bytes);
+    }
+}
+
+bool ProcessManagement::spawnWorker(size_t index) {
+    lockStdio();
+    pid_t pid = fork();
+    if (pid != 0) {
+        unlockStdio();
+    }
+    if (pid < 0) {
+        perror("fork failed");
+        return false;
+    } else if (pid == 0) { // Child process
+        // A replacement is forked by the supervisor while the walker threads, the progress
+        // reporter, the tuner and the journal's group commit run. They are gone in the
+        // child, and a lock one of them held at the fork stays held for good, so the
+        // child takes no lock of theirs: the banner goes out with write(2). What the
+        // worker uses afterwards is safe. The task queues, journal slots, trace rings and
+        // failure log are lock-free shared memory or plain syscalls. glibc's fork()
+        // resets malloc's locks. stdout and stderr were locked by this thread around
+        // fork() (lockStdio), so they are free here.
+        unlockStdio();
+        // Workers take signals the default way; only the parent waits for SIGCHLD
+        pthread_sigmask(SIG_SETMASK, &savedMask, nullptr);
+        // Placed before the worker touches its buffers, so they come from its node
+        Topology::get().bind(places[index], options.placement);
+        char banner[64];
+        int length = snprintf(banner, sizeof(banner), "[PID %d] Worker process started.\n", static_cast<int>(getpid()));
+        ssize_t written = write(STDOUT_FILENO, banner, length);
+        (void)written; // A lost banner is not worth failing the worker over
+        executeTaskFromSharedQueue(index);
+        std::cout << "[PID " << getpid() << "] Worker process finished and exiting." << std::endl;
+        exit(0); // Child process exits after completing its work
     }
+    workerPids[index] = pid;
+    liveWorkers++;
+    return true;
 }
 
 void ProcessManagement::createWorkerProcesses(int numWorkers) {
+    // Unpinned workers share one queue; pinned ones get a queue per node they are on
+    const Topology &topology = Topology::get();
+    size_t nodes = options.placement == Placement::NONE ? 1 : topology.nodesFor(options.numaNodes, numWorkers);
+    places.clear();
+    for (int i = 0; i < numWorkers; i++) {
+        places.push_back(options.placement == Placement::NONE ? WorkerPlace{0, -1} : topology.place(i, nodes));
+    }
+    createSharedMemory(numWorkers, nodes);
+    if (options.placement != Placement::NONE) {
+        std::cout << "Pinning workers to " << (options.placement == Placement::CORE ? "CPUs" : "nodes") << " of "
+                  << nodes << " NUMA node" << (nodes == 1 ? "" : "s") << ", one task queue per node" << std::endl;
+    }
+
+    // SIGCHLD is taken synchronously by the supervisor thread. Blocked here, before the
+    // producer starts any other thread, so every later thread inherits the mask.
+    sigset_t children;
+    sigemptyset(&children);
+    sigaddset(&children, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &children, &savedMask);
+
     std::cout << "Creating " << numWorkers << " worker processes..." << std::endl;
+    workerPids.assign(numWorkers, 0);
     for (int i = 0; i < numWorkers; ++i) {
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork failed");
-            // Handle error: clean up resources, maybe exit
-            return;
-        } else if (pid == 0) { // Child process
-            // Child processes will run the executeTaskFromSharedQueue loop
-            std::cout << "[PID " << getpid() << "] Worker process started." << std::endl;
-            executeTaskFromSharedQueue();
-            std::cout << "[PID " << getpid() << "] Worker process finished and exiting." << std::endl;
-            exit(0); // Child process exits after completing its work
-        } else { // Parent process
-            workerPids.push_back(pid); // Store child PID
+        if (!spawnWorker(i)) {
+            break;
         }
     }
+    supervisor = std::thread(&ProcessManagement::superviseWorkers, this);
 }
 
-void ProcessManagement::waitForWorkers() {
-    // Set the producerFinished flag to true, so workers know no more tasks are coming
-    sharedMem->producerFinished.store(true);
+// What is left of the task a dead worker held. A journaled in-place task is finished
+// from where the journal shows the worker stopped; an out-of-place task is redone, as
+// it only rewrites its output. An in-place task without a journal may be half
+// transformed, and doing it again would scramble the part that was done.
+std::vector<Task> ProcessManagement::orphanedWork(size_t index, uint64_t ticket, const TaskRecord &record) {
+    Task task = record.toTask();
+    std::vector<Task> rest;
+    if (task.attempts + 1 >= MAX_TASK_ATTEMPTS) {
+        std::cerr << "Dropping task " << task.toString() << ": " << MAX_TASK_ATTEMPTS
+                  << " workers died running it" << std::endl;
+        recordDropped(task, task.isOutOfPlace() ? "workers kept dying on it"
+                                                : "workers kept dying on it; may be partly transformed");
+        return rest;
+    }
+    task.attempts++;
 
-    // Unblock any workers that might be stuck on sem_wait(itemsSemaphore)
-    // by posting a number of items equal to the number of workers.
-    // This allows them to check the producerFinished flag.
-    for (size_t i = 0; i < workerPids.size(); ++i) {
-        sem_post(itemsSemaphore);
+    Journal *journal = Journal::active();
+    if (journal == nullptr || task.isOutOfPlace()) {
+        if (!task.isOutOfPlace()) {
+            std::cerr << "Not requeued: " << task.toString() << " was interrupted in place and may be partly "
+                      << "transformed (run with --journal to have such tasks finished)" << std::endl;
+            recordDropped(task, "interrupted in place by a worker crash; may be partly transformed");
+            return rest;
+        }
+        rest.push_back(std::move(task));
+        return rest;
     }
 
-    std::cout << "Waiting for worker processes to finish..." << std::endl;
-    for (pid_t pid : workerPids) {
+    uint32_t file;
+    uint64_t resumeAt;
+    Journal::TakeOver outcome = journal->takeOver(index, ticket, file, resumeAt);
+    if (outcome == Journal::TakeOver::NOT_STARTED) {
+        rest.push_back(std::move(task));
+        return rest;
+    }
+    if (outcome == Journal::TakeOver::FINISHED) {
+        return rest;
+    }
+
+    std::vector<std::string> files{task.filePath};
+    files.insert(files.end(), task.batchFiles.begin(), task.batchFiles.end());
+    if (outcome == Journal::TakeOver::LOST && file < files.size()) {
+        FailureLog::record(files[file].c_str(), "interrupted by a worker crash; the journal cannot tell its state");
+    }
+    if (outcome == Journal::TakeOver::PARTIAL && file < files.size()) {
+        // Only the first file of a task has a range; length 0 still means to the end
+        uint64_t length = 0;
+        if (file == 0 && task.length != 0) {
+            length = task.offset + task.length > resumeAt ? task.offset + task.length - resumeAt : 0;
+        }
+        if (file != 0 || task.length == 0 || length != 0) {
+            Task piece(files[file], task.action, resumeAt, length);
+            piece.attempts = task.attempts;
+            rest.push_back(std::move(piece));
+        }
+    }
+    if (file + 1 < files.size()) {
+        Task batch(files[file + 1], task.action);
+        batch.batchFiles.assign(files.begin() + file + 2, files.end());
+        batch.attempts = task.attempts;
+        rest.push_back(std::move(batch));
+    }
+    return rest;
+}
+
+// Requeue the unfinished work of every record the dead worker held and free its entries.
+// The records are released before anything is pushed: an orphaned record holds back the
+// arena, and a push waiting for arena space would never return.
+// Workers that drained their queues stay until requeuing is cleared, so none exits
+// while the work is on its way back.
+void ProcessManagement::recoverWorker(size_t index) {
+    sharedMem->requeuing.store(1);
+    WorkerWatch &watch = sharedMem->watches()[index];
+    std::vector<Task> retry;
+    for (InFlight &entry : watch.entries) {
+        uint64_t stored = entry.position.load(std::memory_order_acquire);
+        if (stored == 0) {
+            continue;
+        }
+        SharedTaskQueue &queue = *queues[entry.shard.load()];
+        if (entry.executed.load(std::memory_order_acquire) == 0) {
+            std::vector<Task> work = orphanedWork(index, entry.ticket.load(), *queue.record(stored - 1));
+            for (Task &task : work) retry.push_back(std::move(task));
+        }
+        queue.releaseOrphan(stored - 1);
+        entry.position.store(0, std::memory_order_release);
+    }
+
+    if (respawns < RESPAWNS_PER_WORKER * workerPids.size()) {
+        if (spawnWorker(index)) {
+            respawns++;
+            std::cout << "Restarted worker " << index << " as PID " << workerPids[index] << std::endl;
+        }
+    } else {
+        std::cerr << "Worker " << index << " is not restarted: " << respawns << " workers were restarted already"
+                  << std::endl;
+    }
+    if (liveWorkers == 0) {
+        // Nobody is left to drain the queues. The run ends the normal way: what was held
+        // and what the producer still submits is reported, and a producer waiting for
+        // queue space gets its push refused.
+        std::cerr << "No workers left, stopping the run" << std::endl;
+        for (const Task &task : retry) {
+            recordDropped(task, "not run: no workers were left");
+        }
+        for (const auto &held : retrying) {
+            recordDropped(held.second, "not run: no workers were left");
+        }
+        retrying.clear();
+        stopped.store(true);
+        for (auto &queue : queues) {
+            queue->abandon();
+        }
+        finishQueues();
+        sharedMem->requeuing.store(0);
+        return;
+    }
+    // Back on the dead worker's node, where its replacement runs
+    for (Task &task : retry) {
+        retrying.emplace_back(places[index].node, std::move(task));
+    }
+    requeueRetrying();
+}
+
+// Push what the supervisor holds for requeueing, as far as it goes without waiting. The
+// producer holds its lock while it waits for queue space, and only workers make space:
+// were the supervisor to wait on it, a worker dying meanwhile would never be reaped.
+// What does not fit is tried again on the next tick; requeuing stays set until then.
+void ProcessManagement::requeueRetrying() {
+    auto next = retrying.begin();
+    while (next != retrying.end() && queues[next->first]->tryPush(next->second)) {
+        const Task &task = next->second;
+        std::cout << "Requeued " << task.toString() << " (attempt " << task.attempts + 1 << ")" << std::endl;
+        ++next;
+    }
+    retrying.erase(retrying.begin(), next);
+    sharedMem->requeuing.store(retrying.empty() ? 0 : 1);
+}
+
+void ProcessManagement::superviseWorkers() {
+    sigset_t children;
+    sigemptyset(&children);
+    sigaddset(&children, SIGCHLD);
+    // The timeout only bounds how long a finished run waits to notice it is finishing
+    const struct timespec tick = {0, 100 * 1000 * 1000};
+
+    while (true) {
+        pid_t pid;
         int status;
-        if (waitpid(pid, &status, 0) == -1) {
-            perror("waitpid failed");
-        } else {
-            std::cout << "Worker PID " << pid << " exited with status " << WEXITSTATUS(status) << std::endl;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto slot = std::find(workerPids.begin(), workerPids.end(), pid);
+            if (slot == workerPids.end()) {
+                continue;
+            }
+            size_t index = slot - workerPids.begin();
+            *slot = 0;
+            liveWorkers--;
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                std::cout << "Worker PID " << pid << " exited with status 0" << std::endl;
+                continue;
+            }
+            if (WIFSIGNALED(status)) {
+                std::cerr << "Worker PID " << pid << " was killed by signal " << WTERMSIG(status) << " ("
+                          << strsignal(WTERMSIG(status)) << ")" << std::endl;
+            } else {
+                std::cerr << "Worker PID " << pid << " exited with status " << WEXITSTATUS(status) << std::endl;
+            }
+            recoverWorker(index);
+        }
+        if (!retrying.empty()) {
+            requeueRetrying();
+        }
+        if (finishing.load() && liveWorkers == 0) {
+            break;
         }
+        sigtimedwait(&children, nullptr, &tick);
+    }
+    dropLeftovers();
+}
+
+// Once the respawn budget is spent, work can be requeued after the last worker saw the
+// queues empty and was on its way out. Nobody takes it any more: report it.
+void ProcessManagement::dropLeftovers() {
+    for (auto &queue : queues) {
+        while (const TaskRecord *record = queue->tryPop()) {
+            Task task = record->toTask();
+            std::cerr << "Not run: " << task.toString() << ", no worker was left to take it" << std::endl;
+            recordDropped(task, "not run: no workers were left");
+            queue->release(record);
+            stopped.store(true);
+        }
+    }
+}
+
+// Mark the queues finished and wake every sleeping worker: the active ones exit as
+// soon as the remaining tasks are drained, parked ones right away
+void ProcessManagement::finishQueues() {
+    for (auto &queue : queues) {
+        queue->finish();
+    }
+    sharedMem->finished.store(1);
+    sharedMem->activeEvent.fetch_add(1);
+    futexWake(sharedMem->activeEvent, INT_MAX);
+}
+
+void ProcessManagement::waitForWorkers() {
+    finishQueues();
+
+    std::cout << "Waiting for worker processes to finish..." << std::endl;
+    finishing.store(true);
+    if (supervisor.joinable()) {
+        supervisor.join();
     }
+    pthread_sigmask(SIG_SETMASK, &savedMask, nullptr);
 }
 
 ProcessManagement::~ProcessManagement() {
+    if (sharedMem == MAP_FAILED) {
+        return; // No workers were ever created
+    }
+    if (supervisor.joinable()) {
+        // The run was abandoned: let the workers drain the queues and exit
+        finishQueues();
+        finishing.store(true);
+        supervisor.join();
+    }
+
     // Unmap shared memory
-    if (sharedMem != MAP_FAILED) {
-        if (munmap(sharedMem, sizeof(SharedMemory)) == -1) {
-            perror("munmap failed");
-        }
+    queues.clear();
+    if (munmap(sharedMem, sharedSize) == -1) {
+        perror("munmap failed");
     }
 
     // Close shared memory file descriptor
@@ -183,20 +619,4 @@ ProcessManagement::~ProcessManagement() {
     if (shm_unlink(SHM_NAME) == -1) {
         perror("shm_unlink failed");
     }
-
-    // Close semaphores
-    if (sem_close(itemsSemaphore) == -1) {
-        perror("sem_close itemsSemaphore failed");
-    }
-    if (sem_close(emptySlotsSemaphore) == -1) {
-        perror("sem_close emptySlotsSemaphore failed");
-    }
-
-    // Unlink semaphores (delete them from the system)
-    if (sem_unlink("/items_semaphore") == -1) {
-        perror("sem_unlink itemsSemaphore failed");
-    }
-    if (sem_unlink("/empty_slots_semaphore") == -1) {
-        perror("sem_unlink emptySlotsSemaphore failed");
-    }
 }
\ No newline at end of file
@@ -1,47 +1,127 @@
 #ifndef PROCESS_MANAGEMENT_HPP
 #define PROCESS_MANAGEMENT_HPP
 #include "Task.hpp"
+#include "SharedTaskQueue.hpp"
+#include "WorkerEngine.hpp"
+#include "Topology.hpp"
 #include <queue>
 #include <memory>
 #include <atomic>
-#include <semaphore.h>
-#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector> // Added for storing child PIDs
+#include <signal.h>
+#include <sys/types.h>
 
-class ProcessManagement {
-    sem_t* itemsSemaphore;
-    sem_t* emptySlotsSemaphore;
+// A record a worker popped and has not released yet, so the supervisor can queue its
+// work again if the worker dies. The io_uring pipeline holds several at a time.
+struct InFlight {
+    std::atomic<uint64_t> position; // Arena position + 1 of the record, 0 when the entry is free
+    std::atomic<uint64_t> ticket;   // The worker's number for the task (see Journal::setTicket)
+    std::atomic<uint32_t> executed; // Done, only the release was left
+    std::atomic<uint32_t> shard;    // The queue the record came from
+};
+
+const size_t IN_FLIGHT_ENTRIES = 64;
 
+// Replacements for crashed workers over a run, per configured worker
+const size_t RESPAWNS_PER_WORKER = 8;
+
+struct alignas(64) WorkerWatch {
+    std::atomic<uint64_t> tickets; // Tasks taken on this worker slot, across respawns
+    InFlight entries[IN_FLIGHT_ENTRIES];
+};
+
+class ProcessManagement : public WorkerEngine {
 public:
-    ProcessManagement();
+    ProcessManagement(const EngineOptions &options = EngineOptions());
     ~ProcessManagement();
 
-    // Producer method: submits a task string to the shared queue
-    bool submitTaskToSharedQueue(const std::string& taskString);
+    // WorkerEngine interface
+    void createWorkers(int numWorkers) override { createWorkerProcesses(numWorkers); }
+    bool submitTask(const Task &task) override { return submitTaskToSharedQueue(task); }
+
+    // Producer method: writes the task as a binary record into the shared queue
+    bool submitTaskToSharedQueue(const Task &task);
 
     // Consumer method: executed by worker processes
-    void executeTaskFromSharedQueue();
+    void executeTaskFromSharedQueue(size_t worker);
 
     // New: Method to create worker processes
     void createWorkerProcesses(int numWorkers);
 
-    // New: Method to wait for worker processes to finish
-    void waitForWorkers();
+    // Marks the queue finished and waits until the supervisor has seen every worker exit
+    void waitForWorkers() override;
+    std::vector<WorkerStats> workerStats() const override;
+    void setActiveWorkers(size_t count) override;
+    bool stoppedEarly() const override { return stopped.load(); }
 
 private:
-    struct SharedMemory {
-        std::atomic<size_t> size; // Current number of tasks in the queue
-        char tasks[1000][256];    // Array to store task strings
-        int front;                // Index of the front of the queue
-        int rear;                 // Index of the rear of the queue
-        std::atomic<bool> producerFinished; // Flag for workers to know when no more tasks will be added
+    // Header of the segment. One WorkerCounters line per worker follows it, then one
+    // WorkerWatch per worker, then one SharedTaskQueue region (ring, then record arena)
+    // per queue shard, each starting on a page of its own so it can be placed on a node.
+    struct alignas(64) SharedMemory {
+        size_t queueDepth;  // Per shard
+        size_t arenaBytes;  // Per shard
+        size_t workerCount;
+        size_t shardCount;
+        size_t shardOffset; // Of the first shard region, page aligned
+        size_t shardBytes;  // Per shard region, whole pages
+        std::atomic<uint32_t> requeuing; // Set while the supervisor queues a dead worker's work again
+        std::atomic<uint32_t> activeWorkers; // Workers from this index on are parked
+        std::atomic<uint32_t> activeEvent;   // Futex word, bumped when activeWorkers changes or the run ends
+        std::atomic<uint32_t> finished;
+
+        WorkerCounters *counters() { return reinterpret_cast<WorkerCounters *>(this + 1); }
+        const WorkerCounters *counters() const { return reinterpret_cast<const WorkerCounters *>(this + 1); }
+        WorkerWatch *watches() { return reinterpret_cast<WorkerWatch *>(counters() + workerCount); }
+        char *shard(size_t index) { return reinterpret_cast<char *>(this) + shardOffset + index * shardBytes; }
     };
 
+    void createSharedMemory(size_t numWorkers, size_t shards);
+
+    // The queue a task goes to: the one with the fewest queued, so a node whose
+    // workers ran out of work gets the next task and they need not steal it
+    SharedTaskQueue &shortestQueue();
+
+    // A worker's next record: from its own shard, else stolen from the others.
+    // Blocking sleeps on the own shard and returns nullptr once every shard is
+    // finished and drained; shard receives the queue the record came from.
+    // A parked worker takes nothing: it sleeps, and leaves once the run is finished.
+    const TaskRecord *takeTask(size_t worker, bool blocking, uint64_t &position, uint32_t &shard);
+
+    // Fork the worker for slot index; false when fork failed
+    bool spawnWorker(size_t index);
+
+    // Parent thread: reaps workers as SIGCHLD arrives, queues the work of a crashed
+    // one again and starts a replacement, so the pool keeps its size
+    void superviseWorkers();
+    void recoverWorker(size_t index);
+    void requeueRetrying();
+    void dropLeftovers();
+    void finishQueues();
+    std::vector<Task> orphanedWork(size_t index, uint64_t ticket, const TaskRecord &record);
+
     SharedMemory *sharedMem;
+    size_t sharedSize;
+    // One queue per NUMA node the workers are placed on (just one unless they are pinned);
+    // they point into sharedMem and are inherited by the workers
+    std::vector<std::unique_ptr<SharedTaskQueue>> queues;
+    std::atomic<size_t> nextShard; // Where the search for the shortest queue starts
+    std::vector<WorkerPlace> places; // Per worker slot; its node is its shard
+    // Supervisor thread only: dead workers' tasks not back in the queue yet, by shard
+    std::vector<std::pair<size_t, Task>> retrying;
     int shmFd;
     const char *SHM_NAME = "/my_queue";
-    std::mutex queueLock; // Protects sharedMem->front, sharedMem->rear, and tasks array
-    std::vector<pid_t> workerPids; // To store PIDs of worker processes
+    std::vector<pid_t> workerPids; // PID per worker slot, 0 once it exited
+    EngineOptions options;
+
+    std::thread supervisor;
+    std::atomic<bool> finishing;
+    std::atomic<bool> stopped; // Work was left undone for want of workers
+    sigset_t savedMask;   // Signal mask from before SIGCHLD was blocked
+    size_t liveWorkers;
+    size_t respawns;
 };
 
 #endif
\ No newline at end of file
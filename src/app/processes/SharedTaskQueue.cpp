@@ -0,0 +1,196 @@
+#include "SharedTaskQueue.hpp"
+#include <algorithm>
+#include <iostream>
+#include <climits>
+#include <limits.h>
+
+size_t SharedTaskQueue::regionSize(size_t depth, size_t arenaBytes) {
+    return TaskRing::regionSize(depth) + sizeof(TaskArena) + ((arenaBytes + 7) & ~static_cast<size_t>(7));
+}
+
+size_t SharedTaskQueue::defaultArenaBytes(size_t depth) {
+    // Typical paths are far below 512 bytes; the floor keeps room for a couple of
+    // records with PATH_MAX paths and a PATH_MAX output root
+    return std::max<size_t>(TaskRing::roundCapacity(depth) * 512, 4 * TaskRecord::sizeFor(PATH_MAX, PATH_MAX));
+}
+
+SharedTaskQueue::SharedTaskQueue(void *region, size_t depth, size_t arenaBytes) {
+    char *base = static_cast<char *>(region);
+    ring = reinterpret_cast<TaskRing *>(base);
+    ring->init(depth);
+
+    arena = reinterpret_cast<TaskArena *>(base + TaskRing::regionSize(depth));
+    arena->capacity = (arenaBytes + 7) & ~static_cast<size_t>(7);
+    arena->releasedEvent.store(0);
+    arena->waitingProducers.store(0);
+    arenaData = reinterpret_cast<char *>(arena + 1);
+}
+
+// Next fit: the gap at the cursor if bytes fit in it, else on past the record that ends
+// it, dropping released records on the way. Records never straddle the end of the
+// arena. False after a whole round without a gap large enough.
+bool SharedTaskQueue::findSpace(size_t bytes, size_t &position) {
+    size_t scanned = 0;
+    while (true) {
+        auto next = live.lower_bound(cursor);
+        while (next != live.end() &&
+               recordAt(*next)->position.load(std::memory_order_acquire) == TaskRecord::RELEASED) {
+            next = live.erase(next);
+        }
+        size_t gapEnd = next == live.end() ? arena->capacity : *next;
+        if (gapEnd - cursor >= bytes) {
+            position = round * arena->capacity + cursor;
+            live.insert(cursor);
+            cursor += bytes;
+            return true;
+        }
+        if (scanned >= arena->capacity) {
+            return false;
+        }
+        size_t after = next == live.end() ? arena->capacity : *next + recordAt(*next)->size;
+        scanned += after - cursor;
+        cursor = after;
+        if (cursor == arena->capacity) {
+            cursor = 0;
+            round++;
+        }
+    }
+}
+
+bool SharedTaskQueue::allocate(size_t bytes, size_t &position) {
+    if (bytes > arena->capacity) {
+        return false;
+    }
+
+    while (true) {
+        if (abandoned()) {
+            return false;
+        }
+        if (findSpace(bytes, position)) {
+            return true;
+        }
+
+        // Full: sleep until a consumer releases something (event-count pattern, see TaskRing)
+        arena->waitingProducers.fetch_add(1);
+        uint32_t event = arena->releasedEvent.load();
+        bool found = findSpace(bytes, position);
+        if (!found && !abandoned()) {
+            futexWait(arena->releasedEvent, event);
+        }
+        arena->waitingProducers.fetch_sub(1);
+        if (found) {
+            return true;
+        }
+    }
+}
+
+// The paths of a task as a record holds them: a batch's NUL separated
+static std::string recordPaths(const Task &task) {
+    std::string paths = task.filePath;
+    for (const std::string &file : task.batchFiles) {
+        paths += '\0';
+        paths += file;
+    }
+    return paths;
+}
+
+bool SharedTaskQueue::push(const Task &task) {
+    return push(task.action, recordPaths(task), task.offset, task.length, static_cast<uint16_t>(task.fileCount()),
+                task.outputRoot, static_cast<uint32_t>(task.sourcePrefix), task.attempts);
+}
+
+bool SharedTaskQueue::tryPush(const Task &task) {
+    std::unique_lock<std::mutex> lock(producerLock, std::try_to_lock);
+    if (!lock.owns_lock() || abandoned()) {
+        return false;
+    }
+
+    std::string paths = recordPaths(task);
+    size_t position;
+    if (!findSpace(TaskRecord::sizeFor(paths.size(), task.outputRoot.size()), position)) {
+        return false;
+    }
+    TaskRecord::write(recordAt(position), position, task.action, paths, task.offset, task.length,
+                      static_cast<uint16_t>(task.fileCount()), task.outputRoot,
+                      static_cast<uint32_t>(task.sourcePrefix), task.attempts);
+    if (!ring->tryPush(position)) {
+        release(recordAt(position));
+        return false;
+    }
+    return true;
+}
+
+bool SharedTaskQueue::push(Action action, const std::string &path, uint64_t offset, uint64_t length,
+                           uint16_t fileCount, const std::string &outputRoot, uint32_t sourcePrefix,
+                           uint8_t attempts) {
+    std::lock_guard<std::mutex> lock(producerLock);
+
+    size_t position;
+    if (!allocate(TaskRecord::sizeFor(path.size(), outputRoot.size()), position)) {
+        if (!abandoned()) {
+            std::cerr << "Task path too long for the queue arena: " << path << std::endl;
+        }
+        return false;
+    }
+    TaskRecord::write(recordAt(position), position, action, path, offset, length, fileCount, outputRoot, sourcePrefix,
+                      attempts);
+
+    // The ring's release store publishes the record contents along with its position
+    if (!ring->push(position)) {
+        release(recordAt(position));
+        return false;
+    }
+    return true;
+}
+
+const TaskRecord *SharedTaskQueue::pop(uint64_t *position) {
+    uint64_t value;
+    if (!ring->pop(value)) {
+        return nullptr;
+    }
+    if (position != nullptr) *position = value;
+    return record(value);
+}
+
+const TaskRecord *SharedTaskQueue::tryPop(uint64_t *position) {
+    uint64_t value;
+    if (!ring->tryPop(value)) {
+        return nullptr;
+    }
+    if (position != nullptr) *position = value;
+    return record(value);
+}
+
+// No producer lock: a producer may be asleep in push holding it, waiting for exactly this
+// space. The space is only reused once the record is released, and a reused one holds a
+// later position, so the exchange fails both when the consumer got to release it itself
+// and when the space was handed out again since.
+void SharedTaskQueue::releaseOrphan(uint64_t position) {
+    uint64_t expected = position;
+    if (recordAt(position)->position.compare_exchange_strong(expected, TaskRecord::RELEASED,
+                                                             std::memory_order_acq_rel)) {
+        wakeProducers();
+    }
+}
+
+void SharedTaskQueue::release(const TaskRecord *record) {
+    const_cast<TaskRecord *>(record)->position.store(TaskRecord::RELEASED, std::memory_order_release);
+    wakeProducers();
+}
+
+void SharedTaskQueue::wakeProducers() {
+    arena->releasedEvent.fetch_add(1);
+    if (arena->waitingProducers.load() > 0) {
+        futexWake(arena->releasedEvent, 1);
+    }
+}
+
+void SharedTaskQueue::finish() {
+    ring->finish();
+}
+
+void SharedTaskQueue::abandon() {
+    ring->abandon();
+    arena->releasedEvent.fetch_add(1);
+    futexWake(arena->releasedEvent, INT_MAX);
+}
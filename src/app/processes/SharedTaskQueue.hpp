@@ -0,0 +1,112 @@
+#ifndef SHARED_TASK_QUEUE_HPP
+#define SHARED_TASK_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include "Task.hpp"
+#include "TaskRecord.hpp"
+#include "TaskRing.hpp"
+
+const size_t DEFAULT_QUEUE_DEPTH = 1024;
+
+// Task queue laid out in a shared-memory region:
+//   [TaskRing + slots][TaskArena header][arena bytes]
+// The producer writes each task as a variable-length TaskRecord into the arena
+// (a circular byte buffer) and pushes the record's arena position through the ring.
+// Consumers pop a position, use the record in place and release it when done.
+// The producer keeps the arena offsets of the records it handed out and allocates
+// next-fit from a cursor that circles the arena, skipping records still in use: a
+// record a worker holds for a long time (a multi-GB file) only takes its own bytes,
+// and the space released around it is reused.
+class SharedTaskQueue {
+public:
+    // Bytes of shared memory needed for the given ring depth and arena size
+    static size_t regionSize(size_t depth, size_t arenaBytes);
+
+    // Default arena size for a depth: room for depth records of typical paths
+    static size_t defaultArenaBytes(size_t depth);
+
+    // Initialize a queue in region, which must be regionSize(depth, arenaBytes) bytes
+    // of MAP_SHARED memory; forked children keep using the same object
+    SharedTaskQueue(void *region, size_t depth, size_t arenaBytes);
+
+    // Producer side, blocks while the ring or the arena is full; false once the queue
+    // is abandoned. Thread safe within the producing process. For a batch, path holds
+    // fileCount NUL-separated paths (see TaskRecord).
+    bool push(Action action, const std::string &path, uint64_t offset, uint64_t length, uint16_t fileCount = 1,
+              const std::string &outputRoot = std::string(), uint32_t sourcePrefix = 0, uint8_t attempts = 0);
+    bool push(const Task &task);
+
+    // Push without waiting: false when another thread of the process is pushing, or the
+    // ring or the arena is full. For a thread that must not wait on the producer.
+    bool tryPush(const Task &task);
+
+    // Consumer side. pop blocks and returns nullptr once the queue is finished and drained;
+    // tryPop returns nullptr when nothing is queued right now.
+    // position, when given, receives the record's arena position (see releaseOrphan).
+    const TaskRecord *pop(uint64_t *position = nullptr);
+    const TaskRecord *tryPop(uint64_t *position = nullptr);
+
+    // Hand a popped record back so its arena space can be reused
+    void release(const TaskRecord *record);
+
+    // The record at an arena position a consumer popped (positions grow every time the
+    // cursor goes round, so one is never handed out twice)
+    const TaskRecord *record(uint64_t position) const {
+        return reinterpret_cast<const TaskRecord *>(arenaData + position % arena->capacity);
+    }
+
+    // Release the record a dead consumer popped at position, unless it got to release
+    // it itself and the space was reused since. Never waits on the producer.
+    void releaseOrphan(uint64_t position);
+
+    // No more pushes: wake every consumer so they exit once the queue is drained
+    void finish();
+
+    // No consumer is left: finish, and fail every push from now on, including those
+    // waiting for space
+    void abandon();
+    bool abandoned() const { return ring->abandoned.load(); }
+
+    size_t depth() const { return ring->capacity; }
+
+    // Records pushed and not popped yet, a snapshot for picking the shortest of several queues
+    size_t queued() const { return ring->size(); }
+
+    // True when record is one of this queue's
+    bool holds(const TaskRecord *record) const {
+        const char *address = reinterpret_cast<const char *>(record);
+        return address >= arenaData && address < arenaData + arena->capacity;
+    }
+
+private:
+    struct alignas(64) TaskArena {
+        size_t capacity;  // Bytes of record space, multiple of 8
+        std::atomic<uint32_t> releasedEvent; // Futex word, bumped on every release
+        std::atomic<uint32_t> waitingProducers;
+    };
+
+    TaskRecord *recordAt(size_t position) {
+        return reinterpret_cast<TaskRecord *>(arenaData + position % arena->capacity);
+    }
+    bool findSpace(size_t bytes, size_t &position);
+    bool allocate(size_t bytes, size_t &position);
+    void wakeProducers();
+
+    TaskRing *ring;
+    TaskArena *arena;
+    char *arenaData;
+    std::mutex producerLock; // Only excludes producer threads of the same process
+
+    // Producer state, under producerLock. Arena offsets of the records handed out; a
+    // released one is dropped once the cursor runs into it.
+    std::set<size_t> live;
+    size_t cursor = 0; // Arena offset of the next allocation
+    uint64_t round = 0; // Times the cursor went round the arena
+};
+
+#endif
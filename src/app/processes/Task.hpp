@@ -4,9 +4,15 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
 // #include "../fileHandling/IO.hpp" // This header is needed for IO class if used
 
-enum class Action {
+// A task that took this many workers down with it is not queued again
+const uint8_t MAX_TASK_ATTEMPTS = 3;
+
+enum class Action : uint8_t {
     ENCRYPT,
     DECRYPT
 };
@@ -18,29 +24,68 @@ struct Task {
     // The consumer process will open its own fstream based on filePath.
     std::fstream f_stream;
     Action action;
+    // Byte range [offset, offset + length) of the file this task covers.
+    // A length of 0 means "through the end of the file", so a default task is the whole file.
+    // The key stream at any byte depends only on its file offset (the ciphers are
+    // seekable), so ranges of the same file can be processed independently by different workers.
+    size_t offset = 0;
+    size_t length = 0;
+    // Small-file batch: further whole files handled by the same task after filePath.
+    // Only whole-file tasks carry a batch.
+    std::vector<std::string> batchFiles;
+    // Out of place: every file of the task is written to outputRoot + "/" + the part of
+    // its path after the first sourcePrefix characters, and the source is only read.
+    // An empty outputRoot means in place.
+    std::string outputRoot;
+    size_t sourcePrefix = 0;
+    // Workers that died running this task; a task is dropped after MAX_TASK_ATTEMPTS
+    uint8_t attempts = 0;
 
     // Constructor for consumer side (will open its own fstream)
-    Task(std::string filepath, Action action) : filePath(filepath), action(action) {}
+    Task(std::string filepath, Action action, size_t offset = 0, size_t length = 0)
+        : filePath(filepath), action(action), offset(offset), length(length) {}
 
     // Constructor for producer side (just to create the string) - fstream is a dummy here
     Task(std::string filepath, std::fstream &&stream, Action action) : filePath(filepath), f_stream(std::move(stream)), action(action)  {}
 
     // Constructor for producer side (just to create the string) - fstream is a dummy here
-    Task(std::string filepath, std::fstream &&stream, std::string actionString) : filePath(filepath), f_stream(std::move(stream))  {
+    Task(std::string filepath, std::fstream &&stream, std::string actionString, size_t offset = 0, size_t length = 0)
+        : filePath(filepath), f_stream(std::move(stream)), offset(offset), length(length)  {
         for (char& c : actionString) c = std::toupper(c);
         if(actionString == "ENCRYPT") action = Action::ENCRYPT;
         else if(actionString == "DECRYPT") action = Action::DECRYPT;
         else throw std::runtime_error("Invalid action type");
     }
 
+    Task(Task &&) = default;
+    Task &operator=(Task &&) = default;
+
     ~Task() {
         if (f_stream.is_open())
             f_stream.close();
     }
 
+    bool isWholeFile() const { return offset == 0 && length == 0; }
+    size_t fileCount() const { return 1 + batchFiles.size(); }
+    bool isOutOfPlace() const { return !outputRoot.empty(); }
+
+    // Everything but the stream, for handing the task to another queue
+    Task copyDescription() const {
+        Task copy(filePath, action, offset, length);
+        copy.batchFiles = batchFiles;
+        copy.outputRoot = outputRoot;
+        copy.sourcePrefix = sourcePrefix;
+        copy.attempts = attempts;
+        return copy;
+    }
+
+    // Format: "path,ACTION" for a whole file, "path,ACTION,offset,length" for a range.
+    // A batch task is described by its first file only.
     std::string toString() const { // Made const as it doesn't modify the object
         std::ostringstream oss;
         oss << filePath << "," << (action == Action::ENCRYPT ? "ENCRYPT" : "DECRYPT");
+        if (!isWholeFile())
+            oss << "," << offset << "," << length;
         return oss.str();
     }
 
@@ -48,10 +93,20 @@ struct Task {
         std::istringstream iss(taskData);
         std::string filePath;
         std::string actionString;
+        size_t offset = 0;
+        size_t length = 0;
 
-        if(!(getline(iss, filePath, ',') && getline(iss, actionString)))
+        if(!(getline(iss, filePath, ',') && getline(iss, actionString, ',')))
             throw std::runtime_error("Invalid task data format");
 
+        std::string rangeString;
+        if(getline(iss, rangeString)) {
+            char comma;
+            std::istringstream range(rangeString);
+            if(!(range >> offset >> comma >> length) || comma != ',')
+                throw std::runtime_error("Invalid task range format");
+        }
+
         if(!(actionString == "ENCRYPT" || actionString == "DECRYPT"))
             throw std::runtime_error("Invalid Action type");
         Action action = (actionString == "ENCRYPT" ? Action::ENCRYPT : Action::DECRYPT);
@@ -64,7 +119,7 @@ struct Task {
         // will handle opening the file.
         // For now, we'll return a Task object without an open f_stream.
         // The `executeCryption` function *must* open the file itself.
-        return Task(filePath, action);
+        return Task(filePath, action, offset, length);
     }
 };
 
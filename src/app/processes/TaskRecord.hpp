@@ -0,0 +1,79 @@
+#ifndef TASK_RECORD_HPP
+#define TASK_RECORD_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "Task.hpp"
+
+// Compact binary form of a Task as it sits in the shared-memory arena.
+// Workers use it in place: path points into the arena and is NUL terminated,
+// so there is nothing to parse and nothing to copy out.
+// A small-file batch holds fileCount NUL-terminated paths back to back;
+// path is the first of them and nextPath steps to the following one.
+// An out-of-place record stores its output root after the last path.
+struct TaskRecord {
+    // Value of position once the consumer is done with the record
+    static constexpr uint64_t RELEASED = UINT64_MAX;
+
+    uint32_t size;                  // Bytes the record takes in the arena, 8-byte aligned
+    std::atomic<uint64_t> position; // Arena position it was queued at, RELEASED when done
+    Action action;
+    uint8_t attempts;               // Same meaning as Task::attempts
+    uint16_t fileCount;             // Paths in the record, 1 unless it is a batch
+    uint32_t pathLength;            // All paths with their separators, without the final NUL
+    uint32_t outputLength;          // Output root after the paths, 0 in place
+    uint32_t sourcePrefix;          // Same meaning as Task::sourcePrefix
+    uint64_t offset;                // Byte range, same meaning as Task::offset/length
+    uint64_t length;
+    char path[8];                   // Inline path, really pathLength + 1 bytes
+
+    static size_t sizeFor(size_t pathLength, size_t outputLength = 0) {
+        size_t bytes = offsetof(TaskRecord, path) + pathLength + 1 + (outputLength ? outputLength + 1 : 0);
+        return (bytes + 7) & ~static_cast<size_t>(7);
+    }
+
+    const char *nextPath(const char *current) const { return current + strlen(current) + 1; }
+    const char *outputRoot() const { return outputLength ? path + pathLength + 1 : nullptr; }
+
+    // Lay out a record at `at`, which must have sizeFor(path.size(), outputRoot.size()) bytes,
+    // for arena position `position`. path holds fileCount NUL-separated paths for a batch.
+    static TaskRecord *write(void *at, uint64_t position, Action action, const std::string &path, uint64_t offset, uint64_t length,
+                             uint16_t fileCount = 1, const std::string &outputRoot = std::string(),
+                             uint32_t sourcePrefix = 0, uint8_t attempts = 0) {
+        TaskRecord *record = static_cast<TaskRecord *>(at);
+        record->size = static_cast<uint32_t>(sizeFor(path.size(), outputRoot.size()));
+        record->position.store(position, std::memory_order_relaxed);
+        record->action = action;
+        record->attempts = attempts;
+        record->fileCount = fileCount;
+        record->pathLength = static_cast<uint32_t>(path.size());
+        record->outputLength = static_cast<uint32_t>(outputRoot.size());
+        record->sourcePrefix = sourcePrefix;
+        record->offset = offset;
+        record->length = length;
+        memcpy(record->path, path.c_str(), path.size() + 1);
+        if (!outputRoot.empty()) {
+            memcpy(record->path + path.size() + 1, outputRoot.c_str(), outputRoot.size() + 1);
+        }
+        return record;
+    }
+
+    // The task the record describes, for queueing it again
+    Task toTask() const {
+        Task task(path, action, offset, length);
+        for (const char *file = nextPath(path); task.fileCount() < fileCount; file = nextPath(file)) {
+            task.batchFiles.push_back(file);
+        }
+        if (outputLength) {
+            task.outputRoot = outputRoot();
+        }
+        task.sourcePrefix = sourcePrefix;
+        task.attempts = attempts;
+        return task;
+    }
+};
+
+#endif
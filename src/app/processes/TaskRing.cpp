@@ -0,0 +1,174 @@
+#include "TaskRing.hpp"
+#include <new>
+#include <cerrno>
+#include <cstdio>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex words must be plain 32-bit integers");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit integers");
+static_assert(sizeof(TaskRing) % alignof(TaskRing::Slot) == 0, "slots must start aligned after the header");
+
+void futexWait(std::atomic<uint32_t> &word, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+}
+
+void futexWake(std::atomic<uint32_t> &word, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+size_t TaskRing::roundCapacity(size_t capacity) {
+    size_t rounded = 2;
+    while (rounded < capacity) rounded <<= 1;
+    return rounded;
+}
+
+size_t TaskRing::regionSize(size_t capacity) {
+    return sizeof(TaskRing) + roundCapacity(capacity) * sizeof(Slot);
+}
+
+void TaskRing::init(size_t requestedCapacity) {
+    capacity = roundCapacity(requestedCapacity);
+    enqueuePos.store(0);
+    dequeuePos.store(0);
+    itemsEvent.store(0);
+    waitingConsumers.store(0);
+    spaceEvent.store(0);
+    waitingProducers.store(0);
+    finished.store(false);
+    abandoned.store(false);
+    for (size_t i = 0; i < capacity; i++) {
+        new (&slots()[i]) Slot();
+        slots()[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool TaskRing::pushSlot(uint64_t value) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Slot &slot = slots()[pos & (capacity - 1)];
+        size_t seq = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.value = value;
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // Slot still holds the task from one lap ago: full
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool TaskRing::popSlot(uint64_t &value) {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Slot &slot = slots()[pos & (capacity - 1)];
+        size_t seq = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                value = slot.value;
+                slot.sequence.store(pos + capacity, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // Producer has not filled this slot yet: empty
+        } else {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void TaskRing::notifyItem() {
+    itemsEvent.fetch_add(1);
+    if (waitingConsumers.load() > 0) {
+        futexWake(itemsEvent, 1);
+    }
+}
+
+void TaskRing::notifySpace() {
+    spaceEvent.fetch_add(1);
+    if (waitingProducers.load() > 0) {
+        futexWake(spaceEvent, 1);
+    }
+}
+
+bool TaskRing::tryPush(uint64_t value) {
+    if (abandoned.load() || !pushSlot(value)) {
+        return false;
+    }
+    notifyItem();
+    return true;
+}
+
+bool TaskRing::tryPop(uint64_t &value) {
+    if (!popSlot(value)) {
+        return false;
+    }
+    notifySpace();
+    return true;
+}
+
+// Sleeping follows the event-count pattern: register as a waiter, snapshot the
+// event word, retry once, and only then sleep on the snapshot. A push/pop that
+// lands after the snapshot changes the word, so the futex wait returns at once
+// and no wake-up can be lost.
+bool TaskRing::push(uint64_t value) {
+    while (!pushSlot(value)) {
+        waitingProducers.fetch_add(1);
+        uint32_t event = spaceEvent.load();
+        if (abandoned.load()) {
+            waitingProducers.fetch_sub(1);
+            return false;
+        }
+        if (!pushSlot(value)) {
+            futexWait(spaceEvent, event);
+            waitingProducers.fetch_sub(1);
+            continue;
+        }
+        waitingProducers.fetch_sub(1);
+        break;
+    }
+
+    notifyItem();
+    return true;
+}
+
+bool TaskRing::pop(uint64_t &value) {
+    while (!popSlot(value)) {
+        waitingConsumers.fetch_add(1);
+        uint32_t event = itemsEvent.load();
+        if (popSlot(value)) {
+            waitingConsumers.fetch_sub(1);
+            break;
+        }
+        if (finished.load()) {
+            waitingConsumers.fetch_sub(1);
+            return false; // Drained and nothing more is coming
+        }
+        futexWait(itemsEvent, event);
+        waitingConsumers.fetch_sub(1);
+    }
+
+    notifySpace();
+    return true;
+}
+
+void TaskRing::finish() {
+    finished.store(true);
+    itemsEvent.fetch_add(1);
+    futexWake(itemsEvent, INT_MAX);
+}
+
+void TaskRing::abandon() {
+    abandoned.store(true);
+    spaceEvent.fetch_add(1);
+    futexWake(spaceEvent, INT_MAX);
+    finish();
+}
@@ -0,0 +1,82 @@
+#ifndef TASK_RING_HPP
+#define TASK_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded multi-producer/multi-consumer ring that lives in shared memory.
+// It carries 64-bit values (arena positions of task records); the slots follow
+// the header directly, so the ring takes regionSize(capacity) bytes.
+// Every slot carries a sequence number that says whose turn it is:
+//   sequence == pos      -> slot is free for the producer that claims pos
+//   sequence == pos + 1  -> slot holds the value for the consumer that claims pos
+// Producers and consumers claim positions with a CAS on enqueuePos/dequeuePos,
+// so no lock is needed and it works across fork()ed processes.
+// Idle consumers (and producers facing a full ring) sleep on a futex instead of polling.
+struct alignas(64) TaskRing {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        uint64_t value;
+    };
+
+    size_t capacity; // Power of two so positions map to slots with a mask
+
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+
+    // Futex words, bumped on every push/pop so sleepers can detect a change
+    alignas(64) std::atomic<uint32_t> itemsEvent;
+    std::atomic<uint32_t> waitingConsumers;
+    alignas(64) std::atomic<uint32_t> spaceEvent;
+    std::atomic<uint32_t> waitingProducers;
+
+    std::atomic<bool> finished; // Set once no more values will be pushed
+    std::atomic<bool> abandoned; // Set once no consumer is left: pushes fail
+
+    // Bytes needed for a ring of the given capacity (rounded up to a power of two)
+    static size_t regionSize(size_t capacity);
+    static size_t roundCapacity(size_t capacity);
+
+    // Must be called once, on memory of regionSize(capacity) bytes,
+    // before the ring is shared with other processes
+    void init(size_t capacity);
+
+    // Non-blocking attempts, false when the ring is full or abandoned / empty
+    bool tryPush(uint64_t value);
+    bool tryPop(uint64_t &value);
+
+    // Blocking versions. push returns false once the ring is abandoned, pop once
+    // it is finished and drained.
+    bool push(uint64_t value);
+    bool pop(uint64_t &value);
+
+    // Wake every sleeper and let consumers exit once the ring is drained
+    void finish();
+
+    // Finish, and fail every push from now on, waking producers that wait for space
+    void abandon();
+
+    // Values pushed and not popped yet; a snapshot that may be stale at once
+    size_t size() const {
+        size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+        size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    Slot *slots() { return reinterpret_cast<Slot *>(this + 1); }
+
+    // Claim a slot and copy in/out; no futex bookkeeping
+    bool pushSlot(uint64_t value);
+    bool popSlot(uint64_t &value);
+    void notifyItem();
+    void notifySpace();
+};
+
+// Shared helpers for the futex-based sleeps of the queue structures.
+// Shared (not FUTEX_PRIVATE) operations, the words are mapped into several processes.
+void futexWait(std::atomic<uint32_t> &word, uint32_t expected);
+void futexWake(std::atomic<uint32_t> &word, int count);
+
+#endif
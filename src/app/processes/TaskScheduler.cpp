@@ -0,0 +1,127 @@
+#include "TaskScheduler.hpp"
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <queue>
+#include <climits>
+#include <limits.h>
+
+static const double MODEL_BYTES_PER_SECOND = 2e9;
+static const double MODEL_TASK_SECONDS = 20e-6;
+static const double MODEL_FILE_SECONDS = 15e-6;
+
+void SchedulePlan::add(Task &&task, size_t bytes) {
+    tasks.push_back(std::move(task));
+    taskBytes.push_back(bytes);
+}
+
+// One task per chunk; the last chunk runs to the end of the file (length 0)
+static void addChunks(SchedulePlan &plan, const WalkEntry &file, Action action, size_t chunkSize) {
+    size_t offset = 0;
+    while (true) {
+        bool lastChunk = chunkSize == 0 || file.size - offset <= chunkSize;
+        size_t length = lastChunk ? 0 : chunkSize;
+
+        // The worker opens the file itself from the path in the task record.
+        plan.add(Task(file.path, action, offset, length), lastChunk ? file.size - offset : length);
+
+        if (lastChunk) break;
+        offset += chunkSize;
+    }
+}
+
+SchedulePlan planInOrder(const std::vector<WalkEntry> &files, Action action, size_t chunkSize) {
+    SchedulePlan plan;
+    for (const WalkEntry &file : files) {
+        addChunks(plan, file, action, chunkSize);
+    }
+    return plan;
+}
+
+SchedulePlan planBySize(const std::vector<WalkEntry> &files, Action action, size_t chunkSize,
+                        const BatchLimits &limits) {
+    std::vector<const WalkEntry *> bySize;
+    bySize.reserve(files.size());
+    for (const WalkEntry &file : files) bySize.push_back(&file);
+    std::stable_sort(bySize.begin(), bySize.end(),
+        [](const WalkEntry *a, const WalkEntry *b) { return a->size > b->size; });
+
+    // Large files and their chunks, largest task first
+    SchedulePlan large;
+    auto firstSmall = bySize.begin();
+    for (; firstSmall != bySize.end() && (*firstSmall)->size >= limits.smallFileBytes; ++firstSmall) {
+        addChunks(large, **firstSmall, action, chunkSize);
+    }
+    std::vector<size_t> order(large.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+        [&large](size_t a, size_t b) { return large.taskBytes[a] > large.taskBytes[b]; });
+
+    SchedulePlan plan;
+    for (size_t i : order) {
+        plan.add(std::move(large.tasks[i]), large.taskBytes[i]);
+    }
+
+    // Small files, still largest first, packed into batches. The packed paths must
+    // fit one record of the shared queue, so a batch stays below PATH_MAX bytes of paths.
+    size_t batch = SIZE_MAX; // Index of the open batch in the plan
+    size_t batchBytes = 0;
+    size_t batchPathBytes = 0;
+    for (auto it = firstSmall; it != bySize.end(); ++it) {
+        const WalkEntry &file = **it;
+        bool fits = batch != SIZE_MAX && plan.tasks[batch].fileCount() < limits.batchFiles &&
+                    batchBytes + file.size <= limits.batchBytes &&
+                    batchPathBytes + file.path.size() + 1 <= PATH_MAX;
+        if (fits) {
+            plan.tasks[batch].batchFiles.push_back(file.path);
+            batchBytes += file.size;
+            batchPathBytes += file.path.size() + 1;
+            plan.taskBytes[batch] = batchBytes;
+            continue;
+        }
+        plan.add(Task(file.path, action), file.size);
+        batch = plan.size() - 1;
+        batchBytes = file.size;
+        batchPathBytes = file.path.size() + 1;
+    }
+    return plan;
+}
+
+ScheduleReport simulateSchedule(const SchedulePlan &plan, size_t workers) {
+    ScheduleReport report;
+    report.tasks = plan.size();
+    report.workerBusySeconds.assign(std::max<size_t>(workers, 1), 0.0);
+
+    // Min-heap of (time the worker is free, worker)
+    using FreeAt = std::pair<double, size_t>;
+    std::priority_queue<FreeAt, std::vector<FreeAt>, std::greater<FreeAt>> idle;
+    for (size_t i = 0; i < report.workerBusySeconds.size(); i++) idle.push({0.0, i});
+
+    for (size_t i = 0; i < plan.size(); i++) {
+        FreeAt next = idle.top();
+        idle.pop();
+        double cost = MODEL_TASK_SECONDS + MODEL_FILE_SECONDS * plan.tasks[i].fileCount() +
+                      plan.taskBytes[i] / MODEL_BYTES_PER_SECOND;
+        report.workerBusySeconds[next.second] += cost;
+        idle.push({next.first + cost, next.second});
+    }
+
+    report.makespanSeconds = 0;
+    while (!idle.empty()) {
+        report.makespanSeconds = std::max(report.makespanSeconds, idle.top().first);
+        idle.pop();
+    }
+    return report;
+}
+
+void printScheduleReport(std::ostream &out, const char *name, const ScheduleReport &report) {
+    out << std::fixed << std::setprecision(3)
+        << name << ": " << report.tasks << " tasks, makespan " << report.makespanSeconds * 1000 << " ms" << std::endl;
+    for (size_t i = 0; i < report.workerBusySeconds.size(); i++) {
+        double utilization = report.makespanSeconds > 0 ? report.workerBusySeconds[i] / report.makespanSeconds : 0;
+        out << "  worker " << i << ": busy " << report.workerBusySeconds[i] * 1000 << " ms, utilization "
+            << std::setprecision(1) << utilization * 100 << "%" << std::setprecision(3) << std::endl;
+    }
+    out << std::defaultfloat;
+}
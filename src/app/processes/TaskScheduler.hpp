@@ -0,0 +1,48 @@
+#ifndef TASK_SCHEDULER_HPP
+#define TASK_SCHEDULER_HPP
+
+#include <cstddef>
+#include <vector>
+#include <iosfwd>
+#include "Task.hpp"
+#include "../fileHandling/DirectoryWalker.hpp"
+
+// Files below smallFileBytes are packed into batch tasks of at most
+// batchFiles files and batchBytes bytes of data
+struct BatchLimits {
+    size_t smallFileBytes = 256 << 10;
+    size_t batchFiles = 64;
+    size_t batchBytes = 4 << 20;
+};
+
+// Tasks in dispatch order, with the bytes each one covers
+struct SchedulePlan {
+    std::vector<Task> tasks;
+    std::vector<size_t> taskBytes;
+
+    void add(Task &&task, size_t bytes);
+    size_t size() const { return tasks.size(); }
+};
+
+// Scheduler stage between the directory walk and the worker queue.
+// planInOrder keeps walk order, one task per file or chunk, as the producer always did.
+// planBySize dispatches the largest tasks first (LPT), so a big file found late no
+// longer sets the makespan, and packs runs of small files into batch tasks so they
+// stop paying one queue round trip each.
+SchedulePlan planInOrder(const std::vector<WalkEntry> &files, Action action, size_t chunkSize);
+SchedulePlan planBySize(const std::vector<WalkEntry> &files, Action action, size_t chunkSize,
+                        const BatchLimits &limits = BatchLimits());
+
+// Simulated run of a plan: workers take the next task in order as soon as they are free.
+// The cost of a task is a fixed overhead per task and per file plus its bytes over a
+// nominal bandwidth (rough figures from bench/xor_bench and bench/queue_bench).
+struct ScheduleReport {
+    size_t tasks;
+    double makespanSeconds;
+    std::vector<double> workerBusySeconds;
+};
+
+ScheduleReport simulateSchedule(const SchedulePlan &plan, size_t workers);
+void printScheduleReport(std::ostream &out, const char *name, const ScheduleReport &report);
+
+#endif
@@ -0,0 +1,195 @@
+#include "ThreadManagement.hpp"
+#include <iostream>
+#include <algorithm>
+#include "../encryptDecrypt/Cryption.hpp"
+#include "Journal.hpp"
+#include "Trace.hpp"
+
+void ThreadManagement::createWorkers(int numWorkers) {
+    std::cout << "Creating " << numWorkers << " worker threads..." << std::endl;
+    counters.reset(new WorkerCounters[numWorkers]);
+    workerCount = numWorkers;
+    activeCount.store(numWorkers);
+    const Topology &topology = Topology::get();
+    size_t nodes = placement == Placement::NONE ? 1 : topology.nodesFor(numaNodes, numWorkers);
+    for (int i = 0; i < numWorkers; ++i) {
+        counters[i].reset();
+        queues.push_back(std::make_unique<WorkerQueue>());
+        places.push_back(placement == Placement::NONE ? WorkerPlace{0, -1} : topology.place(i, nodes));
+    }
+    if (placement != Placement::NONE) {
+        std::cout << "Pinning worker threads to " << (placement == Placement::CORE ? "CPUs" : "nodes") << " of "
+                  << nodes << " NUMA node" << (nodes == 1 ? "" : "s") << std::endl;
+    }
+    for (int i = 0; i < numWorkers; ++i) {
+        workers.emplace_back(&ThreadManagement::workerLoop, this, i);
+    }
+}
+
+bool ThreadManagement::submitTask(const Task &task) {
+    if (queues.empty()) {
+        return false;
+    }
+    TRACE_SCOPE("submit", "files", task.fileCount());
+    WorkerQueue &queue = *queues[nextQueue];
+    nextQueue = (nextQueue + 1) % queues.size();
+    {
+        // Counted under idleLock so a worker about to sleep cannot miss it, and before
+        // the task is published so a worker that takes it never decrements first
+        std::lock_guard<std::mutex> lock(idleLock);
+        pendingTasks.fetch_add(1);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.tasks.push_back(task.copyDescription());
+    }
+    idleCondition.notify_one();
+    return true;
+}
+
+// One queue lock per task but a single pending-count update and wake-up per batch
+size_t ThreadManagement::submitTasks(const std::vector<Task> &tasks) {
+    if (queues.empty() || tasks.empty()) {
+        return 0;
+    }
+    TRACE_SCOPE("submit", "tasks", tasks.size());
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        pendingTasks.fetch_add(tasks.size());
+    }
+    for (const Task &task : tasks) {
+        WorkerQueue &queue = *queues[nextQueue];
+        nextQueue = (nextQueue + 1) % queues.size();
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.tasks.push_back(task.copyDescription());
+    }
+    idleCondition.notify_all();
+    return tasks.size();
+}
+
+bool ThreadManagement::popLocal(size_t self, std::unique_ptr<Task> &task) {
+    WorkerQueue &queue = *queues[self];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::make_unique<Task>(std::move(queue.tasks.front()));
+    queue.tasks.pop_front();
+    return true;
+}
+
+// Workers on the own node first: their tasks were dealt to the same node's memory
+bool ThreadManagement::steal(size_t self, std::unique_ptr<Task> &task) {
+    for (bool sameNode : {true, false}) {
+        for (size_t i = 1; i < queues.size(); ++i) {
+            size_t other = (self + i) % queues.size();
+            if ((places[other].node == places[self].node) != sameNode) {
+                continue;
+            }
+            WorkerQueue &victim = *queues[other];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::make_unique<Task>(std::move(victim.tasks.front()));
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadManagement::workerLoop(size_t self) {
+    WorkerCounters &me = counters[self];
+    Topology::get().bind(places[self], placement);
+    Journal::attachWorker(self);
+    Trace::attachWorker(self);
+    std::unique_ptr<Task> task;
+    uint64_t waitStart = monotonicNs();
+    while (true) {
+        if (self >= activeCount.load()) {
+            // Parked: the deque keeps being dealt to, the active workers steal from it
+            std::unique_lock<std::mutex> lock(idleLock);
+            uint64_t idleStart = monotonicNs();
+            idleCondition.wait(lock, [this, self] { return self < activeCount.load() || finished; });
+            waitStart = monotonicNs();
+            WorkerCounters::add(me.idleNs, waitStart - idleStart);
+            TRACE_SPAN("parked", idleStart, waitStart);
+            if (self >= activeCount.load()) {
+                break;
+            }
+            continue;
+        }
+        if (popLocal(self, task) || steal(self, task)) {
+            uint64_t start = monotonicNs();
+            WorkerCounters::add(me.queueWaitNs, start - waitStart);
+            TRACE_SPAN("dequeue", waitStart, start);
+            pendingTasks.fetch_sub(1);
+            if (logTasks) {
+                std::cout << "[Thread " << self << "] Executing task: " << task->toString();
+                if (!task->batchFiles.empty()) {
+                    std::cout << " (+" << task->batchFiles.size() << " more files)";
+                }
+                std::cout << std::endl;
+            }
+            size_t bytes = 0;
+            AllocationMark mark;
+            executeCryption(*task, &bytes);
+            mark.addSince(me);
+            waitStart = monotonicNs();
+            WorkerCounters::add(me.busyNs, waitStart - start);
+            TRACE_SPAN("task", start, waitStart, "bytes", bytes);
+            WorkerCounters::add(me.tasks, 1);
+            WorkerCounters::add(me.files, task->offset == 0 ? task->fileCount() : 0); // A chunked file counts once
+            WorkerCounters::add(me.bytes, bytes);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idleLock);
+        uint64_t idleStart = monotonicNs();
+        WorkerCounters::add(me.queueWaitNs, idleStart - waitStart);
+        TRACE_SPAN("dequeue", waitStart, idleStart);
+        idleCondition.wait(lock, [this] { return pendingTasks.load() > 0 || finished; });
+        waitStart = monotonicNs();
+        WorkerCounters::add(me.idleNs, waitStart - idleStart);
+        TRACE_SPAN("idle", idleStart, waitStart);
+        if (pendingTasks.load() == 0 && finished) {
+            break;
+        }
+    }
+}
+
+std::vector<WorkerStats> ThreadManagement::workerStats() const {
+    std::vector<WorkerStats> stats;
+    for (size_t i = 0; i < workerCount; i++) {
+        stats.push_back(WorkerStats::from(counters[i]));
+    }
+    return stats;
+}
+
+void ThreadManagement::setActiveWorkers(size_t count) {
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        activeCount.store(std::max<size_t>(1, count));
+    }
+    idleCondition.notify_all();
+}
+
+void ThreadManagement::waitForWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        finished = true;
+    }
+    idleCondition.notify_all();
+
+    std::cout << "Waiting for worker threads to finish..." << std::endl;
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+ThreadManagement::~ThreadManagement() {
+    if (!workers.empty()) {
+        waitForWorkers();
+    }
+}
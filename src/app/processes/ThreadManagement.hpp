@@ -0,0 +1,59 @@
+#ifndef THREAD_MANAGEMENT_HPP
+#define THREAD_MANAGEMENT_HPP
+#include "WorkerEngine.hpp"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+// In-process engine: a std::thread pool with one deque per worker.
+// The producer deals tasks round-robin; each worker takes from the front of its
+// own deque and, when that is empty, steals from the front of the others'.
+// Both ends are the front so tasks run in dispatch order, largest first.
+// Pinned workers steal from the workers of their own NUMA node before the others.
+// No fork, no shared-memory segment, and the process-wide state stays warm.
+class ThreadManagement : public WorkerEngine {
+public:
+    ThreadManagement(const EngineOptions &options = EngineOptions())
+        : logTasks(options.logTasks), placement(options.placement), numaNodes(options.numaNodes) {}
+    ~ThreadManagement();
+
+    void createWorkers(int numWorkers) override;
+    bool submitTask(const Task &task) override;
+    size_t submitTasks(const std::vector<Task> &tasks) override;
+    void waitForWorkers() override;
+    std::vector<WorkerStats> workerStats() const override;
+    void setActiveWorkers(size_t count) override;
+
+private:
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t self);
+    bool popLocal(size_t self, std::unique_ptr<Task> &task);
+    bool steal(size_t self, std::unique_ptr<Task> &task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::unique_ptr<WorkerCounters[]> counters; // One per worker
+    size_t workerCount = 0;
+    bool logTasks;
+    Placement placement;
+    size_t numaNodes;
+    std::vector<WorkerPlace> places; // Per worker
+    std::vector<std::thread> workers;
+    size_t nextQueue = 0; // Round-robin position of the producer
+
+    // Idle workers sleep here until a task is submitted or the run is finished
+    std::mutex idleLock;
+    std::condition_variable idleCondition;
+    std::atomic<size_t> pendingTasks{0};
+    std::atomic<size_t> activeCount{0}; // Workers from this index on are parked
+    bool finished = false;
+};
+
+#endif
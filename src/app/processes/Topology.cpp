@@ -0,0 +1,158 @@
+#include "Topology.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+static const char *NODE_DIRECTORY = "/sys/devices/system/node";
+
+// Node masks for the memory policy calls cover this many nodes
+static const size_t MAX_NODES = 1024;
+static const size_t BITS_PER_WORD = 8 * sizeof(unsigned long);
+
+bool parsePlacement(const std::string &text, Placement &placement) {
+    if (text == "none") placement = Placement::NONE;
+    else if (text == "core") placement = Placement::CORE;
+    else if (text == "node") placement = Placement::NODE;
+    else return false;
+    return true;
+}
+
+const char *placementName(Placement placement) {
+    switch (placement) {
+        case Placement::CORE: return "core";
+        case Placement::NODE: return "node";
+        default: return "none";
+    }
+}
+
+// sysfs CPU list, e.g. "0-3,8-11"
+static std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        if (range.empty() || !std::isdigit(static_cast<unsigned char>(range[0]))) continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+Topology::Topology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("sched_getaffinity failed");
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < online && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &allowed);
+    }
+
+    DIR *dir = opendir(NODE_DIRECTORY);
+    if (dir != nullptr) {
+        while (struct dirent *entry = readdir(dir)) {
+            int id;
+            char tail;
+            if (sscanf(entry->d_name, "node%d%c", &id, &tail) != 1) continue;
+            std::ifstream file(std::string(NODE_DIRECTORY) + "/" + entry->d_name + "/cpulist");
+            std::string list;
+            std::getline(file, list);
+            NumaNode node{id, {}};
+            for (int cpu : parseCpuList(list)) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+            }
+            // Memory-only nodes, and nodes the process may not run on, get no workers
+            if (!node.cpus.empty()) nodeList.push_back(node);
+        }
+        closedir(dir);
+    }
+    std::sort(nodeList.begin(), nodeList.end(), [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+
+    if (nodeList.empty()) {
+        NumaNode node{0, {}};
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+        }
+        if (node.cpus.empty()) node.cpus.push_back(0);
+        nodeList.push_back(node);
+    }
+}
+
+const Topology &Topology::get() {
+    static const Topology topology;
+    return topology;
+}
+
+size_t Topology::cpuCount() const {
+    size_t count = 0;
+    for (const NumaNode &node : nodeList) count += node.cpus.size();
+    return count;
+}
+
+size_t Topology::nodesFor(size_t maxNodes, size_t workers) const {
+    size_t nodes = maxNodes == 0 ? nodeList.size() : std::min(maxNodes, nodeList.size());
+    return std::max<size_t>(1, std::min(nodes, workers));
+}
+
+WorkerPlace Topology::place(size_t worker, size_t nodesUsed) const {
+    nodesUsed = std::max<size_t>(1, std::min(nodesUsed, nodeList.size()));
+    size_t node = worker % nodesUsed;
+    const std::vector<int> &cpus = nodeList[node].cpus;
+    return {node, cpus[(worker / nodesUsed) % cpus.size()]};
+}
+
+bool Topology::bind(const WorkerPlace &place, Placement placement) const {
+    if (placement == Placement::NONE) {
+        return true;
+    }
+    const NumaNode &node = nodeList[place.node];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (placement == Placement::CORE) {
+        CPU_SET(place.cpu, &set);
+    } else {
+        for (int cpu : node.cpus) CPU_SET(cpu, &set);
+    }
+    // pid 0 is the calling thread, so this works for worker threads as well
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity failed");
+        return false;
+    }
+
+    // Buffers are allocated on first use, after this, and so land on the node.
+    // Preferred rather than bound: a full node falls back to the others.
+    if (nodeList.size() > 1 && static_cast<size_t>(node.id) < MAX_NODES) {
+        unsigned long mask[MAX_NODES / BITS_PER_WORD] = {};
+        mask[node.id / BITS_PER_WORD] |= 1UL << (node.id % BITS_PER_WORD);
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MAX_NODES + 1) == -1) {
+            std::cerr << "set_mempolicy for node " << node.id << " failed: " << strerror(errno) << std::endl;
+        }
+    }
+    return true;
+}
+
+void Topology::preferMemory(void *address, size_t length, size_t node) const {
+    if (nodeList.size() <= 1 || length == 0) {
+        return;
+    }
+    int id = nodeList[node].id;
+    if (static_cast<size_t>(id) >= MAX_NODES) {
+        return;
+    }
+    unsigned long mask[MAX_NODES / BITS_PER_WORD] = {};
+    mask[id / BITS_PER_WORD] |= 1UL << (id % BITS_PER_WORD);
+    if (syscall(SYS_mbind, address, length, MPOL_PREFERRED, mask, MAX_NODES + 1, 0) == -1) {
+        std::cerr << "mbind to node " << id << " failed: " << strerror(errno) << std::endl;
+    }
+}
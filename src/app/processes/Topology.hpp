@@ -0,0 +1,67 @@
+#ifndef TOPOLOGY_HPP
+#define TOPOLOGY_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Where workers run:
+//   NONE  wherever the scheduler puts them (the default)
+//   CORE  one CPU each, spread over the NUMA nodes
+//   NODE  any CPU of one node each, spread over the nodes
+// Pinned workers also allocate their memory on their node.
+enum class Placement {
+    NONE,
+    CORE,
+    NODE,
+};
+
+// "none", "core" or "node"; false for anything else
+bool parsePlacement(const std::string &text, Placement &placement);
+const char *placementName(Placement placement);
+
+// A NUMA node and the CPUs of it this process may run on
+struct NumaNode {
+    int id;
+    std::vector<int> cpus;
+};
+
+// The slot a worker is placed in: a node (an index into Topology::nodes()) and a CPU of it
+struct WorkerPlace {
+    size_t node;
+    int cpu;
+};
+
+// The NUMA nodes and CPUs of the machine, read from sysfs once and restricted to the
+// CPUs the process was started on. A machine (or a kernel) without NUMA shows up as a
+// single node with every allowed CPU. No libnuma: the placement calls are plain syscalls.
+class Topology {
+    public:
+        static const Topology &get();
+
+        const std::vector<NumaNode> &nodes() const { return nodeList; }
+        size_t cpuCount() const;
+
+        // Nodes a run uses: the first maxNodes (0: all), and never more than workers
+        size_t nodesFor(size_t maxNodes, size_t workers) const;
+
+        // Worker i goes to node i % nodesUsed, so consecutive workers alternate between
+        // the nodes, and takes the next CPU of that node
+        WorkerPlace place(size_t worker, size_t nodesUsed) const;
+
+        // Pin the calling thread (a forked worker or a worker thread) to the place and
+        // make the memory it allocates from now on come from that node first.
+        // False when the kernel refused the pinning.
+        bool bind(const WorkerPlace &place, Placement placement) const;
+
+        // Prefer node for the pages of [address, address + length), which must be page
+        // aligned and not touched yet. A no-op on a single-node machine.
+        void preferMemory(void *address, size_t length, size_t node) const;
+
+    private:
+        Topology();
+
+        std::vector<NumaNode> nodeList;
+};
+
+#endif
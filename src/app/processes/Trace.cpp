@@ -0,0 +1,149 @@
+#include "Trace.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static Trace *activeTrace = nullptr;
+
+// Walker threads of consecutive walks look for their ring by name one at a time
+static std::mutex attachLock;
+
+Trace::Trace(size_t workers, size_t threads)
+    : workers(workers), ringCount(workers + threads), startNs(monotonicNs()) {
+    // The claim counter gets a cache line of its own ahead of the rings
+    mappedBytes = sizeof(TraceRing) * (ringCount + 1);
+    void *memory = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("mmap trace rings failed");
+        throw std::runtime_error("Failed to create the trace rings");
+    }
+    claimed = new (memory) std::atomic<size_t>(0);
+    rings = reinterpret_cast<TraceRing *>(static_cast<char *>(memory) + sizeof(TraceRing));
+    for (size_t i = 0; i < ringCount; i++) {
+        new (&rings[i].written) std::atomic<uint64_t>(0);
+        new (&rings[i].pid) std::atomic<int32_t>(0);
+        rings[i].name[0] = '\0';
+    }
+}
+
+Trace::~Trace() {
+    if (activeTrace == this) {
+        activeTrace = nullptr;
+        currentRing = nullptr;
+    }
+    munmap(claimed, mappedBytes);
+}
+
+void Trace::activate(Trace *trace) {
+    activeTrace = trace;
+}
+
+void Trace::attachWorker(size_t worker) {
+    currentRing = nullptr;
+    if (activeTrace == nullptr || worker >= activeTrace->workers) {
+        return;
+    }
+    TraceRing &ring = activeTrace->rings[worker];
+    snprintf(ring.name, sizeof(ring.name), "worker %zu", worker);
+    ring.pid.store(getpid(), std::memory_order_relaxed);
+    currentRing = &ring;
+}
+
+void Trace::attachThread(const char *name) {
+    currentRing = nullptr;
+    if (activeTrace == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(attachLock);
+    Trace &trace = *activeTrace;
+    size_t taken = trace.claimed->load();
+    for (size_t i = trace.workers; i < trace.workers + taken; i++) {
+        if (strncmp(trace.rings[i].name, name, TRACE_NAME_LENGTH) == 0) {
+            currentRing = &trace.rings[i];
+            return;
+        }
+    }
+    if (trace.workers + taken == trace.ringCount) {
+        return; // More threads than rings: this one goes untraced
+    }
+    TraceRing &ring = trace.rings[trace.workers + taken];
+    snprintf(ring.name, sizeof(ring.name), "%s", name);
+    ring.pid.store(getpid(), std::memory_order_relaxed);
+    trace.claimed->store(taken + 1);
+    currentRing = &ring;
+}
+
+uint64_t Trace::events() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < ringCount; i++) {
+        total += std::min<uint64_t>(rings[i].written.load(std::memory_order_acquire), TRACE_RING_EVENTS);
+    }
+    return total;
+}
+
+uint64_t Trace::dropped() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < ringCount; i++) {
+        uint64_t written = rings[i].written.load(std::memory_order_acquire);
+        if (written > TRACE_RING_EVENTS) total += written - TRACE_RING_EVENTS;
+    }
+    return total;
+}
+
+// Complete ("X") events with microsecond timestamps from the start of the trace; a
+// thread_name record labels every ring and tid tells the rings apart, so each worker
+// gets its own track under its process
+bool Trace::writeChromeJson(const std::string &path) const {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Unable to write the trace: " << path << std::endl;
+        return false;
+    }
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+    bool first = true;
+    bool parentNamed = false;
+    for (size_t i = 0; i < ringCount; i++) {
+        const TraceRing &ring = rings[i];
+        uint64_t written = ring.written.load(std::memory_order_acquire);
+        if (written == 0) continue;
+        int32_t pid = ring.pid.load(std::memory_order_relaxed);
+        out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+            << ", \"tid\": " << i + 1 << ", \"args\": {\"name\": \"" << ring.name << "\"}}";
+        first = false;
+        // A worker process is named after its worker; threads share the parent's name
+        if (pid != getpid()) {
+            out << ",\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+                << ", \"args\": {\"name\": \"cryption " << ring.name << "\"}}";
+        } else if (!parentNamed) {
+            out << ",\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+                << ", \"args\": {\"name\": \"cryption\"}}";
+            parentNamed = true;
+        }
+        for (uint64_t n = written > TRACE_RING_EVENTS ? written - TRACE_RING_EVENTS : 0; n < written; n++) {
+            const TraceEvent &event = ring.events[n % TRACE_RING_EVENTS];
+            // A worker's clock reads are after the trace was made, but be safe with a killed one
+            uint64_t start = event.startNs > startNs ? event.startNs - startNs : 0;
+            out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": " << pid << ", \"tid\": " << i + 1
+                << ", \"ts\": " << start / 1e3 << ", \"dur\": " << event.durationNs / 1e3;
+            if (event.argName != nullptr) {
+                out << ", \"args\": {\"" << event.argName << "\": " << event.arg << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n],\n\"displayTimeUnit\": \"ms\",\n\"otherData\": {\"dropped_events\": " << dropped() << "}}\n";
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write the trace: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,125 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "WorkerMetrics.hpp"
+
+// Trace points of the task lifecycle (--trace FILE): walking, submitting, queue waits,
+// opening, reading, transforming and writing back. Every traced thread records complete
+// events into its own ring in a shared mapping made before the workers fork, without
+// locks: only that thread writes the ring. Once the run is over the parent merges the
+// rings into Chrome trace JSON, one timeline per worker (chrome://tracing, ui.perfetto.dev).
+//
+// Built with CRYPTION_NO_TRACE (make TRACE=0) the trace points compile to nothing.
+// Otherwise a trace point of an untraced run costs a thread-local load and a branch.
+
+// Events a ring keeps; older ones are overwritten and counted as dropped
+const size_t TRACE_RING_EVENTS = 1 << 16;
+const size_t TRACE_NAME_LENGTH = 32;
+
+#ifdef CRYPTION_NO_TRACE
+const bool TRACE_POINTS = false;
+#else
+const bool TRACE_POINTS = true;
+#endif
+
+struct TraceEvent {
+    const char *name;    // String literals: forked workers share the parent's image
+    const char *argName; // What arg counts, nullptr for none
+    uint64_t startNs;    // monotonicNs()
+    uint64_t durationNs;
+    uint64_t arg;
+};
+
+// The events of one thread (a worker, the producer, a directory walker thread)
+struct alignas(64) TraceRing {
+    std::atomic<uint64_t> written; // Events recorded so far; the last TRACE_RING_EVENTS are kept
+    std::atomic<int32_t> pid;
+    char name[TRACE_NAME_LENGTH];
+    TraceEvent events[TRACE_RING_EVENTS];
+
+    void record(const char *event, uint64_t startNs, uint64_t endNs, const char *argName, uint64_t arg) {
+        uint64_t at = written.load(std::memory_order_relaxed);
+        events[at % TRACE_RING_EVENTS] = {event, argName, startNs, endNs - startNs, arg};
+        written.store(at + 1, std::memory_order_release);
+    }
+};
+
+class Trace {
+    public:
+        // Rings for workers workers and up to threads other threads of the parent
+        Trace(size_t workers, size_t threads);
+        ~Trace();
+        Trace(const Trace &) = delete;
+        Trace &operator=(const Trace &) = delete;
+
+        // Make trace the one threads attached from now on record into
+        // (set before the workers are created, so forked workers inherit it)
+        static void activate(Trace *trace);
+        // Bind the calling worker to its ring; a no-op without an active trace
+        static void attachWorker(size_t worker);
+        // Bind a thread of the parent to the ring called name, which a thread of the same
+        // name had before it (walker threads come and go with every walk)
+        static void attachThread(const char *name);
+        // The calling thread's ring, nullptr when it is not traced
+        static TraceRing *current() { return currentRing; }
+
+        // Every ring's events as Chrome trace JSON; false when path cannot be written
+        bool writeChromeJson(const std::string &path) const;
+        uint64_t events() const;
+        uint64_t dropped() const;
+
+    private:
+        static inline thread_local TraceRing *currentRing = nullptr;
+
+        size_t workers;
+        size_t ringCount;
+        uint64_t startNs;
+        std::atomic<size_t> *claimed; // Rings of parent threads taken, in the mapping
+        TraceRing *rings;
+        size_t mappedBytes;
+};
+
+// Records the scope it lives in as one event of the calling thread
+class TraceScope {
+    public:
+        explicit TraceScope(const char *name, const char *argName = nullptr, uint64_t arg = 0)
+            : ring(Trace::current()), name(name), argName(argName), arg(arg), startNs(ring ? monotonicNs() : 0) {}
+        ~TraceScope() {
+            if (ring != nullptr) ring->record(name, startNs, monotonicNs(), argName, arg);
+        }
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        TraceRing *ring;
+        const char *name;
+        const char *argName;
+        uint64_t arg;
+        uint64_t startNs;
+};
+
+// An event of the calling thread from timestamps it already took
+inline void traceSpan(const char *name, uint64_t startNs, uint64_t endNs, const char *argName = nullptr,
+                      uint64_t arg = 0) {
+    if (TraceRing *ring = Trace::current()) ring->record(name, startNs, endNs, argName, arg);
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef CRYPTION_NO_TRACE
+#define TRACE_SCOPE(...) ((void)0)
+// Unevaluated, so timestamps taken only for it do not count as unused
+#define TRACE_SPAN(...) ((void)sizeof((traceSpan(__VA_ARGS__), 0)))
+#else
+// TRACE_SCOPE("read") or TRACE_SCOPE("read", "bytes", length)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+// TRACE_SPAN("idle", startNs, endNs) or TRACE_SPAN("task", startNs, endNs, "files", count)
+#define TRACE_SPAN(...) traceSpan(__VA_ARGS__)
+#endif
+
+#endif
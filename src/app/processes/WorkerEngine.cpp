@@ -0,0 +1,22 @@
+#include "WorkerEngine.hpp"
+#include "ProcessManagement.hpp"
+#include "ThreadManagement.hpp"
+#include <stdexcept>
+
+size_t WorkerEngine::submitTasks(const std::vector<Task> &tasks) {
+    size_t submitted = 0;
+    for (const Task &task : tasks) {
+        if (submitTask(task)) submitted++;
+    }
+    return submitted;
+}
+
+std::unique_ptr<WorkerEngine> createWorkerEngine(const std::string &engineName, const EngineOptions &options) {
+    if (engineName.empty() || engineName == "processes") {
+        return std::make_unique<ProcessManagement>(options);
+    }
+    if (engineName == "threads") {
+        return std::make_unique<ThreadManagement>(options);
+    }
+    throw std::runtime_error("Unknown worker engine: " + engineName);
+}
@@ -0,0 +1,56 @@
+#ifndef WORKER_ENGINE_HPP
+#define WORKER_ENGINE_HPP
+
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <vector>
+#include "Task.hpp"
+#include "SharedTaskQueue.hpp"
+#include "WorkerMetrics.hpp"
+#include "Topology.hpp"
+
+// Settings every engine takes; queueDepth and uring only matter to the process engine
+struct EngineOptions {
+    size_t queueDepth = DEFAULT_QUEUE_DEPTH;
+    bool uring = false;    // Workers keep many files in flight through io_uring
+    bool logTasks = false; // One "Executing task" line per task
+    Placement placement = Placement::NONE;
+    size_t numaNodes = 0;  // Nodes to spread pinned workers over, 0: all of them
+};
+
+// Common interface of the worker engines: forked worker processes fed through
+// shared memory (ProcessManagement) or an in-process thread pool (ThreadManagement)
+class WorkerEngine {
+public:
+    virtual ~WorkerEngine() = default;
+
+    // Start the workers, before any task is submitted
+    virtual void createWorkers(int numWorkers) = 0;
+
+    // Producer side: hand one task to the workers
+    virtual bool submitTask(const Task &task) = 0;
+
+    // Hand over a batch of tasks at once; returns how many were accepted.
+    // The default submits them one by one.
+    virtual size_t submitTasks(const std::vector<Task> &tasks);
+
+    // No more tasks are coming: let the workers drain the queue and wait for them
+    virtual void waitForWorkers() = 0;
+
+    // Snapshot of every worker's counters; valid while the run goes on and after it
+    virtual std::vector<WorkerStats> workerStats() const = 0;
+
+    // Only workers 0..count-1 take tasks; the others wait until the count is raised
+    // again, or leave once the run is finished. Every worker is active at first.
+    virtual void setActiveWorkers(size_t count) = 0;
+
+    // True once the run lost all its workers with work left: it must exit non-zero
+    virtual bool stoppedEarly() const { return false; }
+};
+
+// "processes" (default) or "threads"; throws on anything else.
+std::unique_ptr<WorkerEngine> createWorkerEngine(const std::string &engineName,
+                                                 const EngineOptions &options = EngineOptions());
+
+#endif
@@ -0,0 +1,120 @@
+#include "WorkerMetrics.hpp"
+#include "WorkerEngine.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+void WorkerCounters::reset() {
+    tasks.store(0);
+    files.store(0);
+    bytes.store(0);
+    busyNs.store(0);
+    idleNs.store(0);
+    queueWaitNs.store(0);
+    allocations.store(0);
+    bufferMaps.store(0);
+}
+
+WorkerStats WorkerStats::from(const WorkerCounters &counters) {
+    WorkerStats stats;
+    stats.tasks = counters.tasks.load(std::memory_order_relaxed);
+    stats.files = counters.files.load(std::memory_order_relaxed);
+    stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+    stats.busySeconds = counters.busyNs.load(std::memory_order_relaxed) / 1e9;
+    stats.idleSeconds = counters.idleNs.load(std::memory_order_relaxed) / 1e9;
+    stats.queueWaitSeconds = counters.queueWaitNs.load(std::memory_order_relaxed) / 1e9;
+    stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+    stats.bufferMaps = counters.bufferMaps.load(std::memory_order_relaxed);
+    return stats;
+}
+
+ProgressReporter::ProgressReporter(const WorkerEngine &engine, double intervalSeconds)
+    : engine(engine), intervalSeconds(intervalSeconds), startNs(monotonicNs()), lastNs(startNs),
+      lastFiles(0), lastBytes(0), stopping(false) {
+    thread = std::thread(&ProgressReporter::run, this);
+}
+
+ProgressReporter::~ProgressReporter() {
+    stop();
+}
+
+void ProgressReporter::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping) return;
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    auto interval = std::chrono::duration<double>(intervalSeconds);
+    while (!wake.wait_for(guard, interval, [this] { return stopping; })) {
+        printLine();
+    }
+}
+
+// "[progress] 12.0s files 4100 (350/s) 1530.2 MB (128.4 MB/s) busy 93% queue 1% idle 6%"
+// Rates cover the last interval; the shares are over all workers since the start.
+void ProgressReporter::printLine() {
+    uint64_t now = monotonicNs();
+    WorkerStats total;
+    for (const WorkerStats &worker : engine.workerStats()) {
+        total.files += worker.files;
+        total.bytes += worker.bytes;
+        total.busySeconds += worker.busySeconds;
+        total.idleSeconds += worker.idleSeconds;
+        total.queueWaitSeconds += worker.queueWaitSeconds;
+    }
+    double interval = (now - lastNs) / 1e9;
+    double accounted = total.busySeconds + total.idleSeconds + total.queueWaitSeconds;
+    auto share = [accounted](double seconds) { return accounted > 0 ? 100 * seconds / accounted : 0.0; };
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1)
+         << "[progress] " << (now - startNs) / 1e9 << "s files " << total.files
+         << " (" << std::setprecision(0) << (total.files - lastFiles) / interval << "/s) "
+         << std::setprecision(1) << total.bytes / 1048576.0 << " MB ("
+         << (total.bytes - lastBytes) / 1048576.0 / interval << " MB/s) "
+         << std::setprecision(0) << "busy " << share(total.busySeconds) << "% queue "
+         << share(total.queueWaitSeconds) << "% idle " << share(total.idleSeconds) << "%\n";
+    std::cout << line.str() << std::flush;
+
+    lastNs = now;
+    lastFiles = total.files;
+    lastBytes = total.bytes;
+}
+
+void writeSummaryJson(std::ostream &out, const std::vector<WorkerStats> &workers, double elapsedSeconds) {
+    WorkerStats total;
+    for (const WorkerStats &worker : workers) {
+        total.tasks += worker.tasks;
+        total.files += worker.files;
+        total.bytes += worker.bytes;
+        total.allocations += worker.allocations;
+        total.bufferMaps += worker.bufferMaps;
+    }
+    out << std::setprecision(6)
+        << "{\n  \"elapsed_seconds\": " << elapsedSeconds
+        << ",\n  \"tasks\": " << total.tasks
+        << ",\n  \"files\": " << total.files
+        << ",\n  \"bytes\": " << total.bytes
+        << ",\n  \"files_per_second\": " << (elapsedSeconds > 0 ? total.files / elapsedSeconds : 0)
+        << ",\n  \"mb_per_second\": " << (elapsedSeconds > 0 ? total.bytes / 1048576.0 / elapsedSeconds : 0)
+        << ",\n  \"allocations\": " << total.allocations
+        << ",\n  \"allocations_per_task\": " << (total.tasks > 0 ? double(total.allocations) / total.tasks : 0)
+        << ",\n  \"buffer_maps\": " << total.bufferMaps
+        << ",\n  \"workers\": [\n";
+    for (size_t i = 0; i < workers.size(); i++) {
+        const WorkerStats &worker = workers[i];
+        out << "    {\"worker\": " << i << ", \"tasks\": " << worker.tasks << ", \"files\": " << worker.files
+            << ", \"bytes\": " << worker.bytes << ", \"busy_seconds\": " << worker.busySeconds
+            << ", \"idle_seconds\": " << worker.idleSeconds << ", \"queue_wait_seconds\": " << worker.queueWaitSeconds
+            << ", \"allocations\": " << worker.allocations << ", \"buffer_maps\": " << worker.bufferMaps
+            << ", \"utilization\": " << (elapsedSeconds > 0 ? worker.busySeconds / elapsedSeconds : 0) << "}"
+            << (i + 1 < workers.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
@@ -0,0 +1,101 @@
+#ifndef WORKER_METRICS_HPP
+#define WORKER_METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "AllocationCounter.hpp"
+#include "../fileHandling/BufferPool.hpp"
+
+// Live counters of one worker. Only that worker writes them (plain load + store,
+// no read-modify-write) and the parent reads them whenever it likes. Each worker
+// gets its own cache line, so workers updating their counters never share a line.
+//   busy       executing tasks
+//   queueWait  taking a task off the queue when one was ready
+//   idle       waiting for the producer with the queue empty
+//   allocations  heap allocations made while executing tasks
+//   bufferMaps   pool buffers mapped while executing tasks (pool misses)
+struct alignas(64) WorkerCounters {
+    std::atomic<uint64_t> tasks;
+    std::atomic<uint64_t> files;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> busyNs;
+    std::atomic<uint64_t> idleNs;
+    std::atomic<uint64_t> queueWaitNs;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bufferMaps;
+
+    void reset();
+    static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+};
+
+static_assert(sizeof(WorkerCounters) == 64, "one cache line per worker");
+
+// A snapshot of WorkerCounters
+struct WorkerStats {
+    uint64_t tasks = 0;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    double busySeconds = 0;
+    double idleSeconds = 0;
+    double queueWaitSeconds = 0;
+    uint64_t allocations = 0;
+    uint64_t bufferMaps = 0;
+
+    static WorkerStats from(const WorkerCounters &counters);
+};
+
+// steady_clock is CLOCK_MONOTONIC, comparable across processes
+inline uint64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The calling worker's allocation counts at one point, to charge what a task made since
+struct AllocationMark {
+    uint64_t allocations = allocationCount();
+    uint64_t bufferMaps = BufferPool::local().mapped();
+
+    void addSince(WorkerCounters &counters) const {
+        WorkerCounters::add(counters.allocations, allocationCount() - allocations);
+        WorkerCounters::add(counters.bufferMaps, BufferPool::local().mapped() - bufferMaps);
+    }
+};
+
+class WorkerEngine;
+
+// Parent-side thread that prints a progress line every interval until stopped
+class ProgressReporter {
+    public:
+        ProgressReporter(const WorkerEngine &engine, double intervalSeconds);
+        ~ProgressReporter();
+        void stop();
+
+    private:
+        void run();
+        void printLine();
+
+        const WorkerEngine &engine;
+        double intervalSeconds;
+        uint64_t startNs;
+        uint64_t lastNs;
+        uint64_t lastFiles;
+        uint64_t lastBytes;
+        std::mutex lock;
+        std::condition_variable wake;
+        bool stopping;
+        std::thread thread;
+};
+
+// Totals and per-worker counters of a finished run as a JSON object
+void writeSummaryJson(std::ostream &out, const std::vector<WorkerStats> &workers, double elapsedSeconds);
+
+#endif